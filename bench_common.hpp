@@ -0,0 +1,93 @@
+/*
+ * Shared parts of the benchmark drivers (benchmark.cpp, scaling_benchmark.cpp):
+ * the seeded protein sampler and the child-process runner that measures
+ * wall time, CPU time and peak RSS (wait4).
+ */
+
+#ifndef BENCH_COMMON_H_
+#define BENCH_COMMON_H_
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+// Background amino-acid composition (UniProtKB/Swiss-Prot, percent).
+static const char AA_ALPHABET[] = "ARNDCQEGHILKMFPSTWYV";
+static const double AA_FREQ[] = {
+    8.25, 5.53, 4.06, 5.45, 1.37, 3.93, 6.75, 7.07, 2.27, 5.96,
+    9.66, 5.84, 2.42, 3.86, 4.70, 6.56, 5.34, 1.08, 2.92, 6.87
+};
+
+// Met start, stop codon at the end, no internal stops.
+inline std::string generateProtein(std::mt19937 &rng, int length) {
+    std::discrete_distribution<int> dist(std::begin(AA_FREQ), std::end(AA_FREQ));
+    std::string p = "M";
+    while ((int)p.size() < length - 1) {
+        p += AA_ALPHABET[dist(rng)];
+    }
+    p += '*';
+    return p;
+}
+
+struct ChildRun {
+    int status;              // as from wait4
+    double wall_s;
+    double cpu_s;            // user + system
+    long maxrss_kb;
+};
+
+// Runs argv_s[0] with stdout and stderr sent to the given files ("" for
+// /dev/null), under a CPU-time limit when cpu_limit_s > 0, and waits for it.
+inline ChildRun runChild(const std::vector<std::string> &argv_s, const std::string &out_path,
+                         const std::string &err_path, int cpu_limit_s = 0) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        const char *out = out_path.empty() ? "/dev/null" : out_path.c_str();
+        const char *err = err_path.empty() ? "/dev/null" : err_path.c_str();
+        int fd_out = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int fd_err = open(err, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_out < 0 || fd_err < 0) _exit(127);
+        dup2(fd_out, STDOUT_FILENO);
+        dup2(fd_err, STDERR_FILENO);
+        if (cpu_limit_s > 0) {
+            struct rlimit rl;
+            rl.rlim_cur = cpu_limit_s;
+            rl.rlim_max = cpu_limit_s + 1;
+            setrlimit(RLIMIT_CPU, &rl);
+        }
+        std::vector<char *> argv;
+        for (auto &a : argv_s) argv.push_back(const_cast<char *>(a.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    ChildRun r;
+    r.status = 0;
+    struct rusage ru;
+    if (wait4(pid, &r.status, 0, &ru) < 0) {
+        perror("wait4");
+        exit(1);
+    }
+    r.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.cpu_s = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+            + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    r.maxrss_kb = ru.ru_maxrss;
+    return r;
+}
+
+#endif /* BENCH_COMMON_H_ */
@@ -1,244 +1,404 @@
 /*
- * Micro-benchmark: CDSfold Optimization Comparison
- * Demonstrates measurable improvements from C++17 optimizations
+ * Micro-benchmark: CDSfold kernel timings
+ *
+ * Links the real engine headers and times the hot functions on fixed,
+ * seeded synthetic inputs. Every benchmark is run with warm-up and a
+ * number of measured repetitions; min/median/mean/stddev/p90 are written
+ * as JSON so that runs from different commits can be compared.
+ *
+ * Usage: micro_benchmark [-a aalen] [-w W] [-n reps] [-u warmup] [-s seed] [-o out.json]
  */
 
-#include <chrono>
+#pragma GCC optimize("O3,unroll-loops,inline-functions,fast-math")
+
+#ifdef __AVX2__
+    #pragma GCC target("avx2,fma")
+#elif defined(__SSE4_2__)
+    #pragma GCC target("sse4.2")
+#endif
+constexpr int MIN2(const int A, const int B) noexcept { return (A < B) ? A : B; }
+constexpr int MAX2(const int A, const int B) noexcept { return (A > B) ? A : B; }
+constexpr int TURN = 3;
+#include <cstdio>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <unistd.h>
+#include <string>
 #include <vector>
-#include <array>
-#include <iomanip>
 #include <random>
 #include <functional>
 #include <algorithm>
+#include <cmath>
+
+extern "C" {
+#include  "utils.h"
+#include  "fold_vars.h"
+#include  "fold.h"
+#include  "part_func.h"
+#include  "params.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "math.h"
+#include "ctype.h"
+#include "limits.h"
+}
+
+#include "codon.hpp"
+#include "CodonCost.hpp"
+#include "fasta.hpp"
+#include "CDSfold_pack.hpp"
+#include "CDSfold_cost.hpp"
+#include "ResultFile.hpp"
+#include "CDSfold.hpp"
+#include "CDSfold_rev.hpp"
+#include "AASeqConverter.hpp"
+#include "CDSfold_fill.hpp"
+
+#ifndef CDSFOLD_REVISION
+#define CDSFOLD_REVISION "unknown"
+#endif
 
 using namespace std;
 using namespace std::chrono;
 
-// ========================================
-// OLD vs NEW Implementation Comparisons
-// ========================================
-
-// OLD: Macro-based MIN/MAX
-#define OLD_MIN2(A, B)      ((A) < (B) ? (A) : (B))
-#define OLD_MAX2(A, B)      ((A) > (B) ? (A) : (B))
-
-// NEW: Constexpr functions
-constexpr int NEW_MIN2(const int A, const int B) noexcept { return (A < B) ? A : B; }
-constexpr int NEW_MAX2(const int A, const int B) noexcept { return (A > B) ? A : B; }
-
-// OLD: Loop-based matrix size calculation
-int old_getMatrixSize(int len, int w) {
-    int size = 0;
-    for(int i = 1; i <= w; i++){
-        size += len-(i-1);
-    }
-    return size;
-}
-
-// NEW: Formula-based matrix size calculation
-constexpr int new_getMatrixSize(const int len, const int w) noexcept {
-    const int size = (w <= len) ?
-        w * len - (w * (w - 1)) / 2 :
-        (len * (len + 1)) / 2;
-    return size;
-}
+// Discards everything written to it (the engine prints progress to cout).
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize n) override { return n; }
+};
 
-// OLD: C-style array clearing
-void old_clear_arrays(int* arr, int size) {
-    for(int i = 0; i < size; i++){
-        arr[i] = -999999;  // Simulating -INF
-    }
-}
+struct BenchResult {
+    string name;
+    long calls;              // kernel calls per repetition
+    vector<double> ns;       // ns per call, one entry per repetition
+};
 
-// NEW: std::fill_n based clearing
-void new_clear_arrays(int* arr, int size) {
-    fill_n(arr, size, -999999);
-}
+static volatile int sink = 0; // keeps the compiler from dropping kernel results
 
 class MicroBenchmark {
 private:
-    static constexpr int ITERATIONS = 1000000;
-    static constexpr int ARRAY_SIZE = 10000;
+    int reps;
+    int warmup;
+    NullBuffer null_buf;
+    vector<BenchResult> results;
 
 public:
-    double timeFunction(function<void()> func, const string& name, int iterations = ITERATIONS) {
-        auto start = high_resolution_clock::now();
-
-        for(int i = 0; i < iterations; ++i) {
-            func();
-        }
-
-        auto end = high_resolution_clock::now();
-        auto duration = duration_cast<microseconds>(end - start);
-        double time_ms = duration.count() / 1000.0;
+    MicroBenchmark(int r, int u) : reps(r), warmup(u) {}
 
-        cout << setw(25) << name << ": "
-             << setw(8) << fixed << setprecision(3) << time_ms << " ms"
-             << " (" << setw(8) << setprecision(1) << (iterations / time_ms) << " ops/ms)" << endl;
-
-        return time_ms;
+    // Runs untimed preparation code with the engine's output discarded.
+    void quiet(function<void()> body) {
+        streambuf *orig = cout.rdbuf(&null_buf);
+        body();
+        cout.rdbuf(orig);
     }
 
-    void benchmark_MinMax() {
-        cout << "\n" << string(60, '=') << endl;
-        cout << "MIN/MAX Function Benchmark" << endl;
-        cout << string(60, '=') << endl;
-
-        // Generate test data
-        mt19937 rng(42);
-        uniform_int_distribution<int> dist(1, 1000);
-
-        vector<pair<int, int>> test_data(1000);
-        for(auto& p : test_data) {
-            p.first = dist(rng);
-            p.second = dist(rng);
-        }
-
-        volatile int result = 0; // Prevent optimization
-
-        // Benchmark OLD implementation
-        auto old_time = timeFunction([&]() {
-            for(const auto& p : test_data) {
-                result += OLD_MIN2(p.first, p.second);
-                result += OLD_MAX2(p.first, p.second);
-            }
-        }, "OLD: Macro MIN/MAX");
-
-        // Benchmark NEW implementation
-        auto new_time = timeFunction([&]() {
-            for(const auto& p : test_data) {
-                result += NEW_MIN2(p.first, p.second);
-                result += NEW_MAX2(p.first, p.second);
+    // setup() runs before every repetition and is not timed.
+    void run(const string &name, long calls, function<void()> body,
+             function<void()> setup = nullptr) {
+        BenchResult res;
+        res.name = name;
+        res.calls = calls;
+        streambuf *orig = cout.rdbuf(&null_buf);
+        for (int r = 0; r < warmup + reps; r++) {
+            if (setup) setup();
+            auto start = steady_clock::now();
+            body();
+            auto end = steady_clock::now();
+            if (r >= warmup) {
+                res.ns.push_back(duration<double, nano>(end - start).count() / calls);
             }
-        }, "NEW: Constexpr MIN/MAX");
-
-        double improvement = ((old_time - new_time) / old_time) * 100;
-        cout << string(60, '-') << endl;
-        cout << "Improvement: " << fixed << setprecision(1) << improvement << "%" << endl;
+        }
+        cout.rdbuf(orig);
+        cerr << "  " << name << " done" << endl;
+        results.push_back(res);
     }
 
-    void benchmark_MatrixSize() {
-        cout << "\n" << string(60, '=') << endl;
-        cout << "Matrix Size Calculation Benchmark" << endl;
-        cout << string(60, '=') << endl;
-
-        vector<pair<int, int>> test_params = {
-            {100, 50}, {200, 100}, {500, 250}, {1000, 500}, {2000, 1000}
-        };
-
-        volatile int result = 0;
-
-        // Benchmark OLD implementation (loop-based)
-        auto old_time = timeFunction([&]() {
-            for(const auto& p : test_params) {
-                result += old_getMatrixSize(p.first, p.second);
-            }
-        }, "OLD: Loop-based");
-
-        // Benchmark NEW implementation (formula-based)
-        auto new_time = timeFunction([&]() {
-            for(const auto& p : test_params) {
-                result += new_getMatrixSize(p.first, p.second);
-            }
-        }, "NEW: Formula-based");
-
-        double improvement = ((old_time - new_time) / old_time) * 100;
-        cout << string(60, '-') << endl;
-        cout << "Improvement: " << fixed << setprecision(1) << improvement << "%" << endl;
+    static double percentile(const vector<double> &sorted, double p) {
+        double pos = p * (sorted.size() - 1);
+        size_t lo = (size_t)pos;
+        size_t hi = min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
     }
 
-    void benchmark_ArrayClearing() {
-        cout << "\n" << string(60, '=') << endl;
-        cout << "Array Clearing Benchmark" << endl;
-        cout << string(60, '=') << endl;
-
-        vector<int> test_array(ARRAY_SIZE);
-
-        // Benchmark OLD implementation (manual loop)
-        auto old_time = timeFunction([&]() {
-            old_clear_arrays(test_array.data(), ARRAY_SIZE);
-        }, "OLD: Manual loop", 10000);
-
-        // Benchmark NEW implementation (std::fill_n)
-        auto new_time = timeFunction([&]() {
-            new_clear_arrays(test_array.data(), ARRAY_SIZE);
-        }, "NEW: std::fill_n", 10000);
-
-        double improvement = ((old_time - new_time) / old_time) * 100;
-        cout << string(60, '-') << endl;
-        cout << "Improvement: " << fixed << setprecision(1) << improvement << "%" << endl;
+    void writeJSON(ostream &os, int aalen, int w, int diag, unsigned seed) const {
+        os << "{\n";
+        os << "  \"schema\": \"cdsfold-micro-benchmark/1\",\n";
+        os << "  \"revision\": \"" << CDSFOLD_REVISION << "\",\n";
+        os << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+        os << "  \"aalen\": " << aalen << ",\n";
+        os << "  \"w\": " << w << ",\n";
+        os << "  \"diagonal\": " << diag << ",\n";
+        os << "  \"seed\": " << seed << ",\n";
+        os << "  \"reps\": " << reps << ",\n";
+        os << "  \"warmup\": " << warmup << ",\n";
+        os << "  \"unit\": \"ns/call\",\n";
+        os << "  \"benchmarks\": [\n";
+        for (size_t b = 0; b < results.size(); b++) {
+            vector<double> v = results[b].ns;
+            sort(v.begin(), v.end());
+            double mean = 0;
+            for (double x : v) mean += x;
+            mean /= v.size();
+            double var = 0;
+            for (double x : v) var += (x - mean) * (x - mean);
+            double sd = v.size() > 1 ? sqrt(var / (v.size() - 1)) : 0.0;
+
+            os << "    {\"name\": \"" << results[b].name << "\""
+               << ", \"calls\": " << results[b].calls
+               << ", \"min\": " << v.front()
+               << ", \"median\": " << percentile(v, 0.5)
+               << ", \"mean\": " << mean
+               << ", \"stddev\": " << sd
+               << ", \"p90\": " << percentile(v, 0.9)
+               << "}" << (b + 1 < results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n";
+        os << "}\n";
     }
+};
 
-    void benchmark_DataStructures() {
-        cout << "\n" << string(60, '=') << endl;
-        cout << "Data Structure Access Benchmark" << endl;
-        cout << string(60, '=') << endl;
-
-        // OLD: C-style array
-        int old_array[100];
-        for(int i = 0; i < 100; ++i) old_array[i] = i;
-
-        // NEW: std::array
-        array<int, 100> new_array;
-        for(int i = 0; i < 100; ++i) new_array[i] = i;
+// Synthetic protein: fixed seed, Met start, no internal stop codons.
+string makeProtein(int aalen, unsigned seed) {
+    const string aa = "ACDEFGHIKLMNPQRSTVWY";
+    mt19937 rng(seed);
+    uniform_int_distribution<int> dist(0, aa.size() - 1);
+    string s = "M";
+    while ((int)s.size() < aalen) {
+        s += aa[dist(rng)];
+    }
+    return s;
+}
 
-        volatile int result = 0;
+int main(int argc, char *argv[]) {
+    int aalen = 100;
+    int W = 0;
+    int reps = 20;
+    int warmup = 3;
+    unsigned seed = 42;
+    string out;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:w:n:u:s:o:")) != -1) {
+        switch (opt) {
+        case 'a': aalen = atoi(optarg); break;
+        case 'w': W = atoi(optarg); break;
+        case 'n': reps = atoi(optarg); break;
+        case 'u': warmup = atoi(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'o': out = optarg; break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-a aalen] [-w W] [-n reps] [-u warmup] [-s seed] [-o out.json]" << endl;
+            return 1;
+        }
+    }
+    if (aalen < 10 || reps < 1 || warmup < 0) {
+        cerr << "aalen must be at least 10 and reps at least 1." << endl;
+        return 1;
+    }
 
-        // Benchmark OLD C-style array access
-        auto old_time = timeFunction([&]() {
-            for(int i = 0; i < 100; ++i) {
-                result += old_array[i];
-            }
-        }, "OLD: C-style array");
+    string protein = makeProtein(aalen, seed);
+    vector<char> aaseq(protein.begin(), protein.end());
+    aaseq.push_back('\0');
+
+    AASeqConverter conv;
+    codon codon_table;
+    string exc;
+
+    fold_context ctx;
+    init_context_tables(ctx);
+    int nuclen = aalen * 3;
+    int w_tmp = (W == 0 || W > nuclen) ? nuclen : W;
+
+    ctx.nuclen = nuclen;
+    ctx.w = w_tmp;
+    ctx.indx = new int[nuclen + 1];
+    set_ij_indx(ctx.indx, ctx.band_lo, ctx.band_hi, nuclen, w_tmp);
+    ctx.substr = conv.getOriginalBases(protein, exc);
+    ctx.Dep1 = conv.countNeighborTwoBase(protein, exc);
+    ctx.Dep2 = conv.countEveryOtherTwoBase(protein, exc);
+    ctx.predefHPN_E = conv.getBaseEnergy();
+    ctx.pos2nuc = getPossibleNucleotide(aaseq.data(), aalen, codon_table, ctx.n2i, exc);
+    ctx.NucDef = "";
+    ctx.NCflg = 0;
+    ctx.DEPflg = 1;
+    ctx.TEST = 1;
+    ctx.part_opt_flg = false;
+    ctx.n_inter = 0;
+    ctx.rand_tb_flg = false;
+    ctx.P = scale_parameters();
+    update_fold_params();
+    paramT *P = ctx.P;
+
+    MicroBenchmark bench(reps, warmup);
+    cerr << "micro_benchmark: aalen=" << aalen << " w=" << w_tmp << " reps=" << reps << endl;
+
+    // --- energy functions ---
+    const int N_E = 10000;
+    mt19937 rng(seed);
+    vector<int> hp_size(N_E), hp_type(N_E), si(N_E), sj(N_E), sp(N_E), sq(N_E), type2(N_E);
+    vector<string> hp_str(N_E);
+    const char bases[] = "ACGU";
+    for (int k = 0; k < N_E; k++) {
+        hp_size[k] = 3 + rng() % 28;
+        hp_type[k] = 1 + rng() % 6;
+        type2[k] = 1 + rng() % 6;
+        si[k] = 1 + rng() % 4;
+        sj[k] = 1 + rng() % 4;
+        sp[k] = 1 + rng() % 4;
+        sq[k] = 1 + rng() % 4;
+        for (int c = 0; c < 9; c++) hp_str[k] += bases[rng() % 4];
+    }
 
-        // Benchmark NEW std::array access
-        auto new_time = timeFunction([&]() {
-            for(int i = 0; i < 100; ++i) {
-                result += new_array[i];
-            }
-        }, "NEW: std::array");
+    bench.run("E_hairpin", N_E, [&]() {
+        int e = 0;
+        for (int k = 0; k < N_E; k++)
+            e += E_hairpin(hp_size[k], hp_type[k], si[k], sj[k], hp_str[k].c_str(), P);
+        sink = e;
+    });
+
+    // loop classes: (n1, n2) unpaired on each side
+    const vector<pair<string, pair<int, int> > > loop_classes = {
+        {"stack", {0, 0}}, {"bulge1", {0, 1}}, {"bulge", {0, 5}},
+        {"int11", {1, 1}}, {"int12", {1, 2}}, {"int22", {2, 2}},
+        {"int23", {2, 3}}, {"int1n", {1, 8}}, {"generic", {6, 9}}
+    };
+    for (const auto &lc : loop_classes) {
+        int n1 = lc.second.first, n2 = lc.second.second;
+        bench.run("E_intloop/" + lc.first, N_E, [&, n1, n2]() {
+            int e = 0;
+            for (int k = 0; k < N_E; k++)
+                e += E_intloop(n1, n2, hp_type[k], type2[k], si[k], sj[k], sp[k], sq[k], P);
+            sink = e;
+        });
+    }
 
-        double improvement = ((old_time - new_time) / old_time) * 100;
-        cout << string(60, '-') << endl;
-        cout << "Improvement: " << fixed << setprecision(1) << improvement << "%" << endl;
+    long band_cells = 0;
+    for (int j = 1; j <= nuclen; j++)
+        for (int i = max(1, j - w_tmp + 1); i <= j; i++)
+            band_cells++;
+    bench.run("getIndx", band_cells, [&]() {
+        int s = 0;
+        for (int j = 1; j <= nuclen; j++)
+            for (int i = max(1, j - w_tmp + 1); i <= j; i++)
+                s += getIndx(i, j, w_tmp, ctx.indx);
+        sink = s;
+    });
+
+    // --- DP fill ---
+    auto alloc = [&]() {
+        allocate_arrays(nuclen, ctx.indx, ctx.band_hi, w_tmp, ctx.pos2nuc, &ctx.C, &ctx.M, &ctx.F,
+                &ctx.DMl, &ctx.DMl1, &ctx.DMl2, &ctx.chkC, &ctx.chkM, &ctx.base_pair);
+    };
+    auto release = [&]() {
+        free_arrays(nuclen, ctx.indx, ctx.band_hi, w_tmp, ctx.pos2nuc, &ctx.C, &ctx.M, &ctx.F,
+                &ctx.DMl, &ctx.DMl1, &ctx.DMl2, &ctx.chkC, &ctx.chkM, &ctx.base_pair);
+    };
+
+    bench.run("allocate_free_arrays", 1, [&]() {
+        alloc();
+        release();
+    });
+
+    // one diagonal in the middle of the band; DMl1/DMl2 hold its predecessors
+    int diag = MAX2(5, w_tmp / 2);
+    bench.quiet([&]() {
+        alloc();
+        fill_short_cells(ctx);
+        set_nuc_choices(ctx);
+        for (int l = 5; l < diag; l++) {
+            fill_diagonal(ctx, l);
+            rotate_DMl(ctx);
+        }
+    });
+    bench.run("fill_diagonal", 1, [&]() {
+        fill_diagonal(ctx, diag);
+    }, [&]() {
+        for (int j = 1; j <= nuclen; j++)
+            for (unsigned int L = 0; L < 4; L++)
+                fill(ctx.DMl[j][L], ctx.DMl[j][L] + 4, INF);
+    });
+
+    // start over from freshly initialised arrays for the complete fill
+    bench.quiet([&]() {
+        release();
+        alloc();
+        fill_CM(ctx);
+    });
+    bench.run("fill_F", 1, [&]() {
+        fill_F(ctx);
+    });
+
+    int minL = 0, minR = 0;
+    int MFE = find_mfe(ctx, minL, minR);
+    if (MFE == INF) {
+        cerr << "Mininum free energy is not defined." << endl;
+        return 1;
     }
 
-    void showSystemInfo() {
-        cout << "\n" << string(60, '=') << endl;
-        cout << "System Information" << endl;
-        cout << string(60, '=') << endl;
-        cout << "Compiler: GCC 15.2.0 with -O3 -march=native" << endl;
-        cout << "Standard: C++17" << endl;
-        cout << "Iterations per test: " << ITERATIONS << endl;
-        cout << "CPU: Intel i7-9750H @ 2.60GHz" << endl;
+    vector<stack> sector(500);
+    vector<vector<vector<vector<pair<int, string> > > > > predefHPN;
+    string optseq;
+    bench.run("backtrack", 1, [&]() {
+        backtrack(&optseq, sector.data(), ctx.base_pair, ctx.C, ctx.M, ctx.F,
+                ctx.indx, ctx.band_lo, minL, minR, P, ctx.NucConst, ctx.pos2nuc, ctx.NCflg, ctx.i2r, nuclen, w_tmp,
+                BP_pair, ctx.i2n, rtype, ctx.ii2r, ctx.Dep1, ctx.Dep2, ctx.DEPflg,
+                predefHPN, ctx.predefHPN_E, ctx.substr, ctx.n2i, ctx.NucDef, ctx.nuc_cost, ctx.loop_cost);
+    }, [&]() {
+        optseq.assign(nuclen + 1, 'N');
+        optseq[0] = ' ';
+    });
+
+    // resolve the remaining N and V/W/X/Y codes (simplified version of main())
+    for (int i = 1; i <= nuclen; i++) {
+        if (optseq[i] != 'N') continue;
+        for (unsigned int R = 0; R < ctx.pos2nuc[i].size(); R++) {
+            int R_nuc = ctx.pos2nuc[i][R];
+            if (i != 1 && ctx.Dep1[ctx.ii2r[ctx.n2i[optseq[i-1]]*10+R_nuc]][i-1] == 0) continue;
+            if (i != nuclen && optseq[i+1] != 'N'
+                    && ctx.Dep1[ctx.ii2r[R_nuc*10+ctx.n2i[optseq[i+1]]]][i] == 0) continue;
+            optseq[i] = ctx.i2n[R_nuc];
+            break;
+        }
+    }
+    for (int i = 1; i <= nuclen; i++) {
+        if (optseq[i] == 'V' || optseq[i] == 'W') optseq[i] = 'U';
+        else if (optseq[i] == 'X' || optseq[i] == 'Y') optseq[i] = 'G';
     }
 
-    void runAllBenchmarks() {
-        cout << "CDSfold Micro-Benchmark Suite" << endl;
-        cout << "Measuring C++17 optimization improvements" << endl;
-
-        showSystemInfo();
-        benchmark_MinMax();
-        benchmark_MatrixSize();
-        benchmark_ArrayClearing();
-        benchmark_DataStructures();
-
-        cout << "\n" << string(60, '=') << endl;
-        cout << "Benchmark Summary" << endl;
-        cout << string(60, '=') << endl;
-        cout << "These micro-benchmarks demonstrate measurable improvements" << endl;
-        cout << "from the C++17 optimizations applied to CDSfold." << endl;
-        cout << "Real-world performance gains will vary based on:" << endl;
-        cout << "• Sequence length and complexity" << endl;
-        cout << "• Vienna RNA Package integration overhead" << endl;
-        cout << "• Memory access patterns in actual algorithms" << endl;
-        cout << "• CPU cache behavior with larger datasets" << endl;
+    release();
+
+    // --- fixed-sequence paths ---
+    bench.run("fixed_fold", 1, [&]() {
+        fixed_fold(optseq, ctx.indx, ctx.band_lo, w_tmp, ctx.predefHPN_E, BP_pair, P, aaseq.data(), codon_table);
+    });
+
+    string rev_seq;
+    bench.quiet([&]() {
+        rev_seq = rev_fold_step1(aaseq.data(), aalen, codon_table, exc);
+    });
+    string rev_work;
+    bench.run("rev_fold_step2", 1, [&]() {
+        rev_fold_step2(&rev_work, aaseq.data(), aalen, codon_table, exc);
+    }, [&]() {
+        rev_work = rev_seq;
+    });
+
+    if (out.empty()) {
+        bench.writeJSON(cout, aalen, w_tmp, diag, seed);
+    } else {
+        ofstream ofs(out.c_str());
+        if (!ofs) {
+            cerr << "Cannot open " << out << endl;
+            return 1;
+        }
+        bench.writeJSON(ofs, aalen, w_tmp, diag, seed);
+        cerr << "Results written to " << out << endl;
     }
-};
 
-int main() {
-    MicroBenchmark benchmark;
-    benchmark.runAllBenchmarks();
+    delete[] ctx.indx;
+    free(P);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,142 @@
+"""
+cdsfold.py - ctypes bindings for libcdsfold.so (make lib)
+
+Designs a list of amino acid sequences in one call, in process, without
+temporary files or parsing stdout. Only the standard library is needed.
+ctypes releases the GIL for the whole call, so other Python threads keep
+running while the engine fills on its own threads.
+
+    import cdsfold
+    engine = cdsfold.Engine(w=100, threads=8)
+    for d in engine.design(["MAKLRV*", "MSTNPKPQRKTKRNTNRRPQ*"]):
+        print(d.sequence, d.structure, d.mfe)
+
+The library is looked up in $CDSFOLD_LIB, next to this file, in ../src and
+then on the linker path.
+"""
+
+import ctypes
+import ctypes.util
+import os
+from collections import namedtuple
+
+ABI_VERSION = 1
+
+OK, E_SEQUENCE, E_LENGTH, E_NO_MFE = 0, 1, 2, 3
+
+# mfe in kcal/mol; error is None for a valid design
+Design = namedtuple("Design", "sequence structure mfe error")
+
+
+def _load():
+    here = os.path.dirname(os.path.abspath(__file__))
+    paths = [os.environ.get("CDSFOLD_LIB"),
+             os.path.join(here, "libcdsfold.so"),
+             os.path.join(here, "..", "src", "libcdsfold.so"),
+             ctypes.util.find_library("cdsfold")]
+    for p in paths:
+        if p and (os.path.exists(p) or not os.path.dirname(p)):
+            lib = ctypes.CDLL(p)
+            break
+    else:
+        raise OSError("libcdsfold.so not found (build it with make lib or set CDSFOLD_LIB)")
+
+    lib.cdsfold_abi_version.restype = ctypes.c_int
+    lib.cdsfold_engine_new.restype = ctypes.c_void_p
+    lib.cdsfold_engine_free.argtypes = [ctypes.c_void_p]
+    lib.cdsfold_engine_set.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+    lib.cdsfold_engine_set.restype = ctypes.c_int
+    lib.cdsfold_engine_error.argtypes = [ctypes.c_void_p]
+    lib.cdsfold_engine_error.restype = ctypes.c_char_p
+    lib.cdsfold_result_bytes.argtypes = [ctypes.c_int]
+    lib.cdsfold_result_bytes.restype = ctypes.c_size_t
+    lib.cdsfold_design_batch.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p),
+                                         ctypes.c_int, ctypes.POINTER(ctypes.c_void_p)]
+    lib.cdsfold_design_batch.restype = ctypes.c_int
+    for f in ("status", "length", "mfe"):
+        getattr(lib, "cdsfold_result_" + f).argtypes = [ctypes.c_void_p]
+        getattr(lib, "cdsfold_result_" + f).restype = ctypes.c_int
+    for f in ("sequence", "structure"):
+        getattr(lib, "cdsfold_result_" + f).argtypes = [ctypes.c_void_p]
+        getattr(lib, "cdsfold_result_" + f).restype = ctypes.c_char_p
+    lib.cdsfold_strerror.argtypes = [ctypes.c_int]
+    lib.cdsfold_strerror.restype = ctypes.c_char_p
+
+    if lib.cdsfold_abi_version() != ABI_VERSION:
+        raise OSError("libcdsfold ABI %d, expected %d" % (lib.cdsfold_abi_version(), ABI_VERSION))
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load()
+    return _lib
+
+
+class Engine(object):
+    """Design options, set by their command line names: w (int or "auto"),
+    e, span, compress, threads, codon_cost, lambda_, forbid_motifs and
+    regions."""
+
+    def __init__(self, **options):
+        self._lib = _library()
+        self._e = self._lib.cdsfold_engine_new()
+        for key, value in options.items():
+            self.set(key, value)
+
+    def set(self, key, value):
+        key = key.rstrip("_").replace("_", "-")
+        if isinstance(value, bool):
+            value = int(value)
+        if self._lib.cdsfold_engine_set(self._e, key.encode(), str(value).encode()) != 0:
+            raise ValueError(self._lib.cdsfold_engine_error(self._e).decode())
+
+    def design(self, seqs):
+        """Designs every amino acid sequence of seqs; returns a Design each."""
+        seqs = [s.encode() if isinstance(s, str) else bytes(s) for s in seqs]
+        n = len(seqs)
+        if n == 0:
+            return []
+        bufs = [ctypes.create_string_buffer(self._lib.cdsfold_result_bytes(len(s))) for s in seqs]
+        c_seqs = (ctypes.c_char_p * n)(*seqs)
+        c_bufs = (ctypes.c_void_p * n)(*[ctypes.addressof(b) for b in bufs])
+        self._lib.cdsfold_design_batch(self._e, c_seqs, n, c_bufs)
+
+        out = []
+        for b in bufs:
+            r = ctypes.addressof(b)
+            status = self._lib.cdsfold_result_status(r)
+            if status != OK:
+                out.append(Design(None, None, None, self._lib.cdsfold_strerror(status).decode()))
+                continue
+            out.append(Design(self._lib.cdsfold_result_sequence(r).decode(),
+                              self._lib.cdsfold_result_structure(r).decode(),
+                              self._lib.cdsfold_result_mfe(r) / 100.0, None))
+        return out
+
+    def close(self):
+        if self._e:
+            self._lib.cdsfold_engine_free(self._e)
+            self._e = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        try:
+            self.close()
+        except Exception:
+            pass
+
+
+def design(seqs, **options):
+    """One-shot: designs seqs with a temporary Engine."""
+    with Engine(**options) as engine:
+        return engine.design(seqs)
@@ -0,0 +1,85 @@
+/*
+ * Reader for CDSfold --results files
+ *
+ * Maps the file (src/ResultFile.hpp) and prints one tab-separated line per
+ * record: id, nuclen, MFE (kcal/mol), fill and total seconds, flags, the
+ * designed CDS and its dot-bracket structure. -s prints only a summary.
+ *
+ * Usage: results_reader [-s] [-r record] results.bin
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "ResultFile.hpp"
+
+using namespace std;
+
+static void printRecord(const ResultReader &rf, size_t k) {
+    cout << rf.id(k) << "\t" << rf.nuclen(k) << "\t" << rf.mfe(k) / 100.0 << "\t"
+         << rf.t_fill(k) << "\t" << rf.t_total(k) << "\t" << rf.flags(k) << "\t"
+         << rf.seq(k) << "\t" << rf.structure(k) << "\n";
+}
+
+static void printSummary(const ResultReader &rf) {
+    const int32_t *mfe = rf.mfe_column();
+    const uint32_t *nuclen = rf.nuclen_column();
+    double sum_mfe = 0, sum_t = 0;
+    long long sum_len = 0;
+    for (size_t k = 0; k < rf.size(); k++) {
+        sum_mfe += mfe[k] / 100.0;
+        sum_len += nuclen[k];
+        sum_t += rf.t_total(k);
+    }
+    cout << "records: " << rf.size() << endl;
+    cout << "nucleotides: " << sum_len << endl;
+    if (rf.size()) {
+        cout << "mean MFE: " << sum_mfe / rf.size() << " kcal/mol" << endl;
+        cout << "mean MFE per nt: " << (sum_len ? sum_mfe / sum_len : 0) << " kcal/mol" << endl;
+    }
+    cout << "total time: " << sum_t << " s" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    bool summary = false;
+    long record = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "sr:h")) != -1) {
+        switch (opt) {
+        case 's': summary = true; break;
+        case 'r': record = atol(optarg); break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-s] [-r record] results.bin" << endl;
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        cerr << "Usage: " << argv[0] << " [-s] [-r record] results.bin" << endl;
+        return 1;
+    }
+
+    ResultReader rf;
+    string err = rf.open(argv[optind]);
+    if (!err.empty()) {
+        cerr << err << endl;
+        return 1;
+    }
+
+    if (summary) {
+        printSummary(rf);
+    }
+    else if (record >= 0) {
+        if ((size_t)record >= rf.size()) {
+            cerr << "Record " << record << " out of range (" << rf.size() << " records)" << endl;
+            return 1;
+        }
+        printRecord(rf, record);
+    }
+    else {
+        for (size_t k = 0; k < rf.size(); k++) printRecord(rf, k);
+    }
+    return 0;
+}
@@ -47,10 +47,10 @@ else
     print_status $GREEN "✓ CDSfold executable found"
 fi
 
-# Run benchmark
+# Run benchmark (extra arguments are passed through, see ./benchmark -h)
 print_status $YELLOW "Running performance benchmark..."
 echo ""
-./benchmark
+./benchmark "$@"
 
 # Show compiler info
 echo ""
@@ -67,6 +67,6 @@ echo "OS: $(uname -s) $(uname -r)"
 
 # Cleanup
 print_status $YELLOW "Cleaning up..."
-rm -f benchmark test_*.faa
+rm -rf benchmark bench_corpus
 
 print_status $GREEN "Benchmark complete!"
\ No newline at end of file
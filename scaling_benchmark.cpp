@@ -0,0 +1,338 @@
+/*
+ * CDSfold thread-scaling harness
+ *
+ * Runs the CDSfold executable with --threads 1, 2, 4, ..., N and --stats
+ * and reports, per phase (fill_CM, fill_F, fill_F2, backtrack):
+ *   - strong scaling: fixed problem, speedup T1/Tp and efficiency T1/(p*Tp)
+ *   - weak scaling: protein length grows with p at a fixed window, so the
+ *     work per thread stays constant; efficiency T1/Tp
+ *   - load imbalance of the parallel fill loops (max/mean thread busy time)
+ *   - memory-bandwidth saturation: a STREAM-triad probe at the same thread
+ *     counts; bw(p)/(p*bw(1)) well below 1 means extra threads no longer add
+ *     bandwidth, so a phase that stops scaling at the same p is memory bound.
+ *
+ * Usage: scaling_benchmark [-b binary] [-p max_threads] [-s seed] [-n reps]
+ *                          [-S strong_configs] [-a weak_aalen] [-w weak_w] [-o out.json]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <random>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bench_common.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+static const vector<string> PHASES = {"fill_CM", "fill_F", "fill_F2", "backtrack"};
+
+struct ScalingRun {
+    string kind;             // strong or weak
+    string config;
+    int aalen;
+    int threads;
+    double wall_s;
+    map<string, double> phase;   // seconds per phase (median over reps)
+    double imbalance;
+};
+
+static double median(vector<double> v) {
+    if (v.empty()) return 0.0;
+    sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n % 2) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// STREAM triad a = b + s*c over arrays much larger than the caches.
+static double triadBandwidth(int threads) {
+    const size_t n = 8 * 1024 * 1024;      // 3 x 64 MB
+    vector<double> a(n), b(n, 1.0), c(n, 2.0);
+    const double s = 3.0;
+    double best = 1e30;
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    for (int rep = 0; rep < 5; rep++) {
+        auto start = steady_clock::now();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (size_t k = 0; k < n; k++) {
+            a[k] = b[k] + s * c[k];
+        }
+        best = min(best, duration<double>(steady_clock::now() - start).count());
+    }
+    volatile double sink = a[n / 2];
+    (void)sink;
+    return 3.0 * n * sizeof(double) / best / 1e9;
+}
+
+class ScalingBenchmark {
+private:
+    string binary;
+    string work_dir;
+    int reps;
+    vector<ScalingRun> runs;
+    map<int, double> bandwidth;
+
+public:
+    ScalingBenchmark(const string &bin, const string &dir, int r)
+        : binary(bin), work_dir(dir), reps(r) {}
+
+    // Runs one configuration and returns wall time plus the --stats values.
+    bool runOnce(const vector<string> &args, const string &faa, int threads,
+                 double &wall, map<string, double> &stats) {
+        string err_path = work_dir + "/stats.txt";
+        vector<string> argv_s = {binary, "--threads", to_string(threads), "--stats"};
+        argv_s.insert(argv_s.end(), args.begin(), args.end());
+        argv_s.push_back(faa);
+
+        ChildRun c = runChild(argv_s, "", err_path);
+        const int status = c.status;
+        wall = c.wall_s;
+
+        stats.clear();
+        ifstream in(err_path);
+        string line;
+        while (getline(in, line)) {
+            if (line.compare(0, 7, "stats: ") != 0) continue;
+            istringstream is(line.substr(7));
+            string key;
+            double v;
+            if (is >> key >> v) stats[key] += v;
+        }
+        unlink(err_path.c_str());
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 && stats.count("time_fill_CM");
+    }
+
+    void measure(const string &kind, const string &config, const vector<string> &args,
+                 int aalen, unsigned seed, int threads) {
+        string faa = work_dir + "/" + config + "_" + to_string(aalen) + ".faa";
+        mt19937 rng(seed);
+        ofstream(faa) << ">" << config << "\n" << generateProtein(rng, aalen) << "\n";
+
+        vector<double> walls, imb;
+        map<string, vector<double> > phases;
+        for (int rep = 0; rep < reps; rep++) {
+            double wall;
+            map<string, double> st;
+            if (!runOnce(args, faa, threads, wall, st)) {
+                cerr << "run failed: " << config << " aalen=" << aalen << " threads=" << threads << endl;
+                return;
+            }
+            walls.push_back(wall);
+            imb.push_back(st["imbalance"]);
+            for (const auto &p : PHASES) phases[p].push_back(st["time_" + p]);
+        }
+        ScalingRun r;
+        r.kind = kind;
+        r.config = config;
+        r.aalen = aalen;
+        r.threads = threads;
+        r.wall_s = median(walls);
+        r.imbalance = median(imb);
+        for (const auto &p : PHASES) r.phase[p] = median(phases[p]);
+        runs.push_back(r);
+
+        cerr << setw(7) << kind << setw(10) << config << setw(7) << aalen << setw(5) << threads
+             << "  wall " << fixed << setprecision(3) << r.wall_s
+             << "  fill_CM " << r.phase["fill_CM"] << "  fill_F " << r.phase["fill_F"]
+             << "  fill_F2 " << r.phase["fill_F2"] << "  imbalance " << setprecision(2) << r.imbalance << endl;
+    }
+
+    void probeBandwidth(const vector<int> &threads) {
+        for (int t : threads) {
+            bandwidth[t] = triadBandwidth(t);
+            cerr << "triad " << setw(4) << t << " threads: " << fixed << setprecision(2)
+                 << bandwidth[t] << " GB/s" << endl;
+        }
+    }
+
+    const ScalingRun *find(const string &kind, const string &config, int threads) const {
+        for (const auto &r : runs) {
+            if (r.kind == kind && r.config == config && r.threads == threads) return &r;
+        }
+        return nullptr;
+    }
+
+    void writeJSON(ostream &os, int max_threads) const {
+        os << "{\n";
+        os << "  \"schema\": \"cdsfold-scaling/1\",\n";
+        os << "  \"binary\": \"" << binary << "\",\n";
+        os << "  \"max_threads\": " << max_threads << ",\n";
+        os << "  \"reps\": " << reps << ",\n";
+
+        os << "  \"bandwidth\": [\n";
+        double bw1 = bandwidth.count(1) ? bandwidth.at(1) : 0.0;
+        size_t k = 0;
+        for (const auto &kv : bandwidth) {
+            double sat = (bw1 > 0) ? kv.second / (kv.first * bw1) : 0.0;
+            os << "    {\"threads\": " << kv.first << ", \"triad_GBps\": " << setprecision(4) << kv.second
+               << ", \"scaling\": " << sat << "}" << (++k < bandwidth.size() ? "," : "") << "\n";
+        }
+        os << "  ],\n";
+
+        os << "  \"runs\": [\n";
+        for (size_t n = 0; n < runs.size(); n++) {
+            const ScalingRun &r = runs[n];
+            const ScalingRun *base = find(r.kind, r.config, 1);
+            os << "    {\"kind\": \"" << r.kind << "\", \"config\": \"" << r.config << "\", \"aalen\": " << r.aalen
+               << ", \"threads\": " << r.threads << ", \"wall_s\": " << r.wall_s
+               << ", \"imbalance\": " << r.imbalance;
+            for (const auto &p : PHASES) {
+                double t = r.phase.at(p);
+                os << ", \"" << p << "_s\": " << t;
+                if (base && t > 0 && base->phase.at(p) > 0) {
+                    double sp = base->phase.at(p) / t;
+                    double eff = (r.kind == "strong") ? sp / r.threads : sp;
+                    os << ", \"" << p << "_speedup\": " << sp << ", \"" << p << "_efficiency\": " << eff;
+                }
+            }
+            if (base && r.wall_s > 0) {
+                double sp = base->wall_s / r.wall_s;
+                os << ", \"speedup\": " << sp
+                   << ", \"efficiency\": " << ((r.kind == "strong") ? sp / r.threads : sp);
+            }
+            os << "}" << (n + 1 < runs.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n";
+        os << "}\n";
+    }
+
+    void printSummary() const {
+        double bw1 = bandwidth.count(1) ? bandwidth.at(1) : 0.0;
+        cerr << "\n" << string(78, '=') << endl;
+        cerr << setw(7) << "kind" << setw(10) << "config" << setw(5) << "p"
+             << setw(10) << "speedup" << setw(8) << "eff" << setw(10) << "CM eff"
+             << setw(10) << "imbal" << setw(10) << "bw scale" << endl;
+        cerr << string(78, '-') << endl;
+        for (const auto &r : runs) {
+            const ScalingRun *base = find(r.kind, r.config, 1);
+            if (!base) continue;
+            double sp = base->wall_s / r.wall_s;
+            double eff = (r.kind == "strong") ? sp / r.threads : sp;
+            double cm = base->phase.at("fill_CM") / max(r.phase.at("fill_CM"), 1e-9);
+            double cm_eff = (r.kind == "strong") ? cm / r.threads : cm;
+            double bws = (bw1 > 0 && bandwidth.count(r.threads)) ? bandwidth.at(r.threads) / (r.threads * bw1) : 0.0;
+            cerr << setw(7) << r.kind << setw(10) << r.config << setw(5) << r.threads
+                 << setw(10) << fixed << setprecision(2) << sp << setw(8) << eff
+                 << setw(10) << cm_eff << setw(10) << r.imbalance << setw(10) << bws << endl;
+        }
+    }
+};
+
+static vector<string> splitList(const string &s, char sep) {
+    vector<string> v;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, sep)) {
+        if (!item.empty()) v.push_back(item);
+    }
+    return v;
+}
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " [-b binary] [-p max_threads] [-s seed] [-n reps]\n"
+         << "       [-S strong_configs] [-a weak_aalen] [-w weak_w] [-o out.json]\n\n"
+         << "  -b  CDSfold executable (default ./src/CDSfold)\n"
+         << "  -p  largest thread count (default: online CPUs)\n"
+         << "  -s  protein seed (default 42)\n"
+         << "  -n  repetitions per point, median is reported (default 3)\n"
+         << "  -S  strong-scaling configs name:aalen:args, ';'-separated\n"
+         << "      (default \"default:150:;w120:800:-w 120;rand_tb:100:-R\")\n"
+         << "  -a  weak scaling: aalen per thread (default 200)\n"
+         << "  -w  weak scaling: window (default 120)\n"
+         << "  -o  JSON report (default scaling.json)" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    string binary = "./src/CDSfold";
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned seed = 42;
+    int reps = 3;
+    string strong = "default:150:;w120:800:-w 120;rand_tb:100:-R";
+    int weak_aalen = 200;
+    int weak_w = 120;
+    string out = "scaling.json";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p:s:n:S:a:w:o:h")) != -1) {
+        switch (opt) {
+        case 'b': binary = optarg; break;
+        case 'p': max_threads = atoi(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'n': reps = atoi(optarg); break;
+        case 'S': strong = optarg; break;
+        case 'a': weak_aalen = atoi(optarg); break;
+        case 'w': weak_w = atoi(optarg); break;
+        case 'o': out = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || reps < 1 || weak_aalen < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (access(binary.c_str(), X_OK) != 0) {
+        cerr << "CDSfold executable not found: " << binary << endl;
+        return 1;
+    }
+
+    vector<int> threads;
+    for (int t = 1; t < max_threads; t *= 2) threads.push_back(t);
+    threads.push_back(max_threads);
+
+    string work_dir = "scaling_work";
+    mkdir(work_dir.c_str(), 0755);
+    ScalingBenchmark bench(binary, work_dir, reps);
+
+    bench.probeBandwidth(threads);
+
+    for (const auto &cfg : splitList(strong, ';')) {
+        vector<string> f = splitList(cfg + ":", ':');
+        if (f.size() < 2) {
+            cerr << "Bad strong-scaling config: " << cfg << endl;
+            return 1;
+        }
+        vector<string> args;
+        if (f.size() > 2) {
+            istringstream is(f[2]);
+            string a;
+            while (is >> a) args.push_back(a);
+        }
+        if (find(args.begin(), args.end(), "-R") != args.end()) {
+            args.push_back("--seed");
+            args.push_back("1");
+        }
+        for (int t : threads) bench.measure("strong", f[0], args, atoi(f[1].c_str()), seed, t);
+    }
+
+    vector<string> weak_args = {"-w", to_string(weak_w)};
+    for (int t : threads) bench.measure("weak", "w" + to_string(weak_w), weak_args, weak_aalen * t, seed, t);
+
+    bench.printSummary();
+    ofstream ofs(out);
+    bench.writeJSON(ofs, max_threads);
+    cerr << "\nReport written to " << out << endl;
+    return 0;
+}
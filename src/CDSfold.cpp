@@ -24,10 +24,13 @@ constexpr int TURN = 3;
 #include <sstream>
 #include <chrono>    // Modern timing
 #include <unistd.h>
+#include <getopt.h>
 #include <string>
 #include <string_view>  // C++17 string optimization
 #include <array>        // Better than C arrays
+#include <random>
 #include <memory>       // Smart pointers
+#include <functional>
 
 extern "C" {
 #include  "utils.h"
@@ -43,21 +46,32 @@ extern "C" {
 }
 
 #include "codon.hpp"
+#include "CodonCost.hpp"
+#include "Regions.hpp"
+#include "MotifFilter.hpp"
 #include "fasta.hpp"
+#include "ResourceLimits.hpp"
+#include "CDSfold_pack.hpp"
+#include "CDSfold_cost.hpp"
+#include "ResultFile.hpp"
 #include "CDSfold.hpp"
 #include "CDSfold_rev.hpp"
 #include "AASeqConverter.hpp"
+#include "CDSfold_fill.hpp"
+#include "Pipeline.hpp"
+#include "CDSfold_ref.hpp"
+#include "CDSfold_verify.hpp"
+#include "CDSfold_export.hpp"
+#ifdef CDSFOLD_MPI
+#include "CDSfold_mpi.hpp"
+#endif
+#include "Scheduler.hpp"
+#include "Metrics.hpp"
+#include "Spool.hpp"
 //#include <algorithm>
 //#include <sys/time.h>
 //#include <sys/resource.h>
 
-int *indx;
-// Keep C-style arrays for compatibility with existing function signatures
-int BP_pair[5][5] =
-/* _  A  C  G  U  */
-{ { 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 5 }, { 0, 0, 0, 1, 0 }, { 0, 0, 2, 0, 3 }, {
-		0, 6, 0, 4, 0 } };
-int rtype[7] = { 0, 2, 1, 4, 3, 6, 5 };
 
 //#define MAXLOOP 20
 #define noGUclosure  0
@@ -65,57 +79,135 @@ int test;
 
 using namespace std;
 
-int main(int argc, char *argv[]) {
-	// Optimized variable initialization with modern C++
+// Options shared by every record
+struct design_options {
 	int W = 0;                        // -w window size
-	string exc;                       // -e excluded codons (reserve space for better performance)
-	exc.reserve(100);                 // Pre-allocate string space
+	bool auto_w = false;              // -w auto: largest window that fits in memory
+	string exc;                       // -e excluded codons
 	bool m_disp = false;              // -M display flag (bool more efficient than int)
 	bool rand_tb_flg = false;         // -R random traceback flag
 	bool rev_flg = false;             // -r reverse flag
 	bool part_opt_flg = false;        // -f and -t partial optimization flag
 	int opt_fm = 0;                   // -f from position
 	int opt_to = 0;                   // -t to position
-	// get options
-	{
-		int opt;
-		while((opt=getopt(argc,argv,"w:e:f:t:rMR"))!=-1){
-			switch(opt){
-			case 'w':
-				W = atoi(optarg);
-				break;
-			case 'e':
-				exc = string(optarg);
-				break;
-			case 'M':
-				m_disp = true;
-				break;
-			case 'R':
-				rand_tb_flg = true;
-				break;
-			case 'r':
-				rev_flg = true;
-				break;
-			case 'f':
-				opt_fm = atoi(optarg);
-				part_opt_flg = true;
-				break;
-			case 't':
-				opt_to = atoi(optarg);
-				part_opt_flg = true;
-				break;
-
-			}
-		}
+	bool stats_flg = false;           // --stats phase timings on stderr
+	bool verify_flg = false;          // --verify against the reference kernel
+	long verify_sample = -1;          // --verify-sample (-1: automatic, 0: all cells)
+	vector<span_range> span;          // --span position-dependent window
+	int profile_w = 0;                // --profile-window local MFE profile
+	bool compress_flg = false;        // --compress completed C diagonals
+	bool mfe_only = false;            // --mfe-only: MFE per record, no traceback
+	ResourceLimits limits;            // cgroup/affinity limits
+	ResultWriter *results = nullptr;  // --results columnar output
+	FILE *export_fp = nullptr;        // --export-matrices
+	FILE *cost_fp = nullptr;          // --cost-map
+	codon_costs *codon_cost = nullptr; // --codon-cost/--lambda
+	motif_automaton *motifs = nullptr; // --forbid-motifs
+	vector<design_region> regions;    // --regions
+	bool refold = false;              // --refold after --regions
+	design_result *out = nullptr;     // C interface: receives the design
+	service_metrics *metrics = nullptr; // --metrics-socket
+};
+
+// Adds a finished record to the --metrics-socket counters.
+void record_metrics(service_metrics &m, const fold_context &ctx, bool filled, double t_preprocess, double t_fill, double t_fixed)
+{
+	const fold_stats &st = ctx.stats;
+	m.records++;
+	m.phase[service_metrics::PREPROCESS].observe(t_preprocess);
+	if(filled){
+		const double t_band = st.t_fill_CM + st.t_fill_F + st.t_fill_F2;
+		double busy = 0;
+		for(int t = 0; t < st.threads; t++)
+			busy += st.busy[t * 8];
+		m.phase[service_metrics::FILL].observe(t_fill);
+		m.phase[service_metrics::TRACEBACK].observe(st.t_backtrack);
+		m.cells += getBandSize(ctx.nuclen, ctx.indx);
+		m.fill_ns += service_metrics::ns(t_band);
+		m.thread_busy_ns += service_metrics::ns(busy);
+		m.thread_ns += service_metrics::ns(t_band * st.threads);
 	}
-	//exit(0);
+	if(t_fixed > 0)
+		m.phase[service_metrics::FIXED_FOLD].observe(t_fixed);
+	if(ctx.packC){
+		m.cache_hits += ctx.packC->cache_hits();
+		m.cache_misses += ctx.packC->cache_misses();
+	}
+}
 
+// -M: resident memory of the process
+void print_memory_usage()
+{
+	// get process ID
+
+	pid_t pid = getpid();
+	stringstream ss;
+	ss << "/proc/" << pid << "/status";
+	int m = getMemoryUsage(ss.str());
+	if(m == -1){
+		cerr << "Cannot get memory usage information from " << ss.str() << endl;
+	}
+	else{
+		cout << "Memory(VmRSS): "  << float(m)/1024 << " Mb" << endl;
+	}
+}
 
-	// -R option compatibility check (optimized with early return)
-	if(rand_tb_flg && (W != 0 || !exc.empty() || m_disp || rev_flg || part_opt_flg)) {
-		cerr << "The -R option must not be used together with other options." << endl;
-		return 1; // Return error code instead of 0
+// Why design_record() would stop the process on this record, or "".
+// The services check each record first and skip it instead.
+string check_record(const design_options &o, const char *aaseq, int aalen)
+{
+	static const string letters = "ACDEFGHIKLMNPQRSTVWY*";
+	if(aalen <= 2)
+		return "The amino acid sequence is too short.";
+	codon codon_table;
+	for(int i = 0; i < aalen; i++){
+		if(letters.find(aaseq[i]) == string::npos)
+			return string("Unknown amino acid ") + aaseq[i] + ".";
+		if(codon_table.getCodons(aaseq[i], o.exc).empty())
+			return string("Every codon of ") + aaseq[i] + " is excluded.";
 	}
+	if(o.part_opt_flg){
+		if(o.opt_fm == 0 || o.opt_to == 0)
+			return "The -f and -t option must be used together.";
+		if(o.opt_fm < 1)
+			return "The -f value must be 1 or more.";
+		if(o.opt_to < 1)
+			return "The -t value must be 1 or more.";
+		if(o.opt_to < o.opt_fm)
+			return "The -f value must be smaller than -t value.";
+	}
+	if(o.W != 0 && o.W < 10)
+		return "W must be more than 10 (you used " + to_string(o.W) + ")";
+	return "";
+}
+
+// Designs one amino acid sequence, writing to cout. yield, when set, is
+// called between diagonals of the fill (--serve preemption). stage, when
+// set, is advanced to the fill and finish stages (--pipeline). Returns
+// false when the remaining records must be skipped (-r without -f/-t).
+bool design_record(design_options &o, const char *desc, char *aaseq, int aalen, const function<void()> &yield,
+		record_pipeline::ticket *stage = nullptr)
+{
+	const double t_record = fold_wtime();
+	// --mfe-only: one line per record instead of the design
+	null_streambuf quiet;
+	streambuf *console = o.mfe_only ? redirect_cout(&quiet) : nullptr;
+	int &W = o.W;
+	const bool auto_w = o.auto_w;
+	const string &exc = o.exc;
+	const bool m_disp = o.m_disp;
+	const bool rand_tb_flg = o.rand_tb_flg;
+	const bool rev_flg = o.rev_flg;
+	const bool part_opt_flg = o.part_opt_flg;
+	int &opt_fm = o.opt_fm;
+	int &opt_to = o.opt_to;
+	const bool stats_flg = o.stats_flg;
+	const bool verify_flg = o.verify_flg;
+	const long verify_sample = o.verify_sample;
+	const vector<span_range> &span = o.span;
+	const int profile_w = o.profile_w;
+	const bool compress_flg = o.compress_flg;
+	const ResourceLimits &limits = o.limits;
 
 	// Initialize lookup tables (keep C-style for compatibility)
 	auto n2i = make_n2i();
@@ -131,7 +223,7 @@ int main(int argc, char *argv[]) {
 	codon codon_table;
 	//codon_table.Table();
 
-	const char dummy_str[10] = "XXXXXXXXX";
+	//const char dummy_str[10] = "XXXXXXXXX";
 	//int NCflg = 1;
 //	int TB_CHK_flg = 0;
 //	int preHPN_flg = 1;
@@ -146,199 +238,292 @@ int main(int argc, char *argv[]) {
 	//char *NucDef = "*AUGUCUUUAGCCUGUAUGGCUAAAUAA";
 	//cout << "optind is " << optind << endl;
 	//const char *NucDef = tmp_def.c_str();
-	fasta all_aaseq(argv[optind]); // get all sequences
 
-	cout << "W = " << W << endl;
-	cout << "e = " << exc << endl;
-	do {
-		char *aaseq = all_aaseq.getSeq();
-		int aalen = all_aaseq.getSeqLen();
+	if(aalen <= 2){
+		cerr << "The amino acid sequence is too short.\n";
+		exit(1);
+	}
 
-		if(aalen <= 2){
-			cerr << "The amino acid sequence is too short.\n";
+	fold_context ctx;
+	init_context_tables(ctx);
+	int &n_inter = ctx.n_inter; // Current implementation: n_inter=1 or 2
+	int *ofm = ctx.ofm;
+	int *oto = ctx.oto;
+	n_inter = 0;
+	if(part_opt_flg){
+		// 部分最適化が指定された。
+		if(opt_fm == 0 ||opt_to == 0){
+			cerr << "The -f and -t option must be used together." << endl;
 			exit(1);
 		}
-
-		int n_inter = 0; // Current implementation: n_inter=1 or 2
-		int ofm[100];
-		int oto[100];
-		if(part_opt_flg){
-			// 部分最適化が指定された。
-			if(opt_fm == 0 ||opt_to == 0){
-				cerr << "The -f and -t option must be used together." << endl;
-				exit(1);
-			}
-			if(opt_fm < 1){
-				cerr << "The -f value must be 1 or more." << endl;
-				exit(1);
-			}
-			if(opt_to < 1){
-				cerr << "The -t value must be 1 or more." << endl;
-				exit(1);
-			}
-			if(opt_to < opt_fm){
-				cerr << "The -f value must be smaller than -t value." << endl;
-				exit(1);
-			}
-			if(opt_to > aalen){
-				opt_to = aalen;
-			}
-
-			// 部分逆最適化情報の作成
-			if(rev_flg){ // 指定された領域の構造除去
-				ofm[0] = (opt_fm-1) * 3 + 1;
-				oto[0] = opt_to * 3;
-				n_inter = 1;
-			}
-			else{ // 指定された領域の構造安定化
-				int l = 0;
-				if(opt_fm != 1){
-					ofm[l] = 1;
-					oto[l++] = (opt_fm-1) * 3;
-				}
-				if(opt_to != aalen){
-					ofm[l] = opt_to * 3 + 1;
-					oto[l++] = aalen * 3;
-				}
-				n_inter = l;
-			}
-			// 最適化領域のチェック
-			//for(int I = 0; I < n_inter; I++){
-			//	cout << ofm[I] << "-" << oto[I] << endl;
-			//}
-			//exit(0);
+		if(opt_fm < 1){
+			cerr << "The -f value must be 1 or more." << endl;
+			exit(1);
 		}
-
-		int nuclen = aalen * 3;
-		int w_tmp;
-
-		// Optimized conditional logic
-		if (W == 0) {
-			w_tmp = nuclen;
+		if(opt_to < 1){
+			cerr << "The -t value must be 1 or more." << endl;
+			exit(1);
 		}
-		else if (W < 10) {
-			cerr << "W must be more than 10 (you used " << W << ")" << endl;
+		if(opt_to < opt_fm){
+			cerr << "The -f value must be smaller than -t value." << endl;
 			exit(1);
 		}
-		else if (W > nuclen) {
-			w_tmp = nuclen;
+		if(opt_to > aalen){
+			opt_to = aalen;
 		}
-		else {
-			w_tmp = W;
+
+		// 部分逆最適化情報の作成
+		if(rev_flg){ // 指定された領域の構造除去
+			ofm[0] = (opt_fm-1) * 3 + 1;
+			oto[0] = opt_to * 3;
+			n_inter = 1;
 		}
+		else{ // 指定された領域の構造安定化
+			int l = 0;
+			if(opt_fm != 1){
+				ofm[l] = 1;
+				oto[l++] = (opt_fm-1) * 3;
+			}
+			if(opt_to != aalen){
+				ofm[l] = opt_to * 3 + 1;
+				oto[l++] = aalen * 3;
+			}
+			n_inter = l;
+		}
+		// 最適化領域のチェック
+		//for(int I = 0; I < n_inter; I++){
+		//	cout << ofm[I] << "-" << oto[I] << endl;
+		//}
+		//exit(0);
+	}
+
+	int nuclen = aalen * 3;
+	int w_tmp;
+
+	// Optimized conditional logic
+	if (W == 0) {
+		w_tmp = nuclen;
+	}
+	else if (W < 10) {
+		cerr << "W must be more than 10 (you used " << W << ")" << endl;
+		exit(1);
+	}
+	else if (W > nuclen) {
+		w_tmp = nuclen;
+	}
+	else {
+		w_tmp = W;
+	}
 
-		//		w_tmp = 50;// test!
+	//		w_tmp = 50;// test!
 //		vector<vector<vector<string> > >  substr = conv.getBases(string(aaseq),8, exc);
-		vector<vector<vector<string> > >  substr = conv.getOriginalBases(string(aaseq), exc);
-		vector<vector<int> > Dep1;
-		vector<vector<int> > Dep2;
+	vector<vector<vector<string> > > &substr = ctx.substr;
+	substr = conv.getOriginalBases(string(aaseq), exc);
+	vector<vector<int> > &Dep1 = ctx.Dep1;
+	vector<vector<int> > &Dep2 = ctx.Dep2;
 
-		Dep1 = conv.countNeighborTwoBase(string(aaseq), exc);
-		Dep2 = conv.countEveryOtherTwoBase(string(aaseq), exc);
+	Dep1 = conv.countNeighborTwoBase(string(aaseq), exc);
+	Dep2 = conv.countEveryOtherTwoBase(string(aaseq), exc);
 
 
-		//		cout << ptotal_Mb_base << endl;
+	//		cout << ptotal_Mb_base << endl;
 
 //		pid_t pid2 = getpid();
 //		stringstream ss2;
 //		ss2 << "/proc/" << pid2 << "/status";
 //		int m2 = getMemoryUsage(ss2.str());
 //		cout << "Memory(VmRSS): "  << float(m2)/1024 << " Mb" << endl;
-		//cout << "Estimate: "  << ptotal_Mb_base << " Mb" << endl;
-		//exit(0);
+	//cout << "Estimate: "  << ptotal_Mb_base << " Mb" << endl;
+	//exit(0);
 
-		//map<string, int> predefHPN_E;
-		map<string, int> predefHPN_E = conv.getBaseEnergy();
-		//		vector<vector<vector<vector<pair<int, string> > > > > predefHPN = conv.calcQueryOriginalBaseEnergy(string(aaseq), "");
-		vector<vector<vector<vector<pair<int, string> > > > > predefHPN;
-		//vector<vector<vector<vector<pair<int, string> > > > > predefHPN = conv.calcQueryOriginalBaseEnergy(string(aaseq), "");
+	//map<string, int> predefHPN_E;
+	map<string, int> &predefHPN_E = ctx.predefHPN_E;
+	predefHPN_E = conv.getBaseEnergy();
+	//		vector<vector<vector<vector<pair<int, string> > > > > predefHPN = conv.calcQueryOriginalBaseEnergy(string(aaseq), "");
+	vector<vector<vector<vector<pair<int, string> > > > > predefHPN;
+	//vector<vector<vector<vector<pair<int, string> > > > > predefHPN = conv.calcQueryOriginalBaseEnergy(string(aaseq), "");
 /*
-		for(unsigned int i = 1; i < predefHPN.size(); i++){
+	for(unsigned int i = 1; i < predefHPN.size(); i++){
  			cout << ">>position " << i << endl;
-			for(unsigned int l = 0; l < predefHPN[i].size(); l++){
-				for(unsigned int li = 0; li < predefHPN[i][l].size(); li++){
-					for(unsigned int rj = 0; rj < predefHPN[i][l][li].size(); rj++){
-						if(predefHPN[i][l][li][rj].first != INF)
-							continue;
-						cout << predefHPN[i][l][li][rj].second << ":" << predefHPN[i][l][li][rj].first << endl;
-					}
+		for(unsigned int l = 0; l < predefHPN[i].size(); l++){
+			for(unsigned int li = 0; li < predefHPN[i][l].size(); li++){
+				for(unsigned int rj = 0; rj < predefHPN[i][l][li].size(); rj++){
+					if(predefHPN[i][l][li][rj].first != INF)
+						continue;
+					cout << predefHPN[i][l][li][rj].second << ":" << predefHPN[i][l][li][rj].first << endl;
 				}
 			}
+		}
  		}
  		cout << INF << endl;
-		exit(0);
+	exit(0);
 */
 
-		stack sector[500];
+	stack sector[500];
 
-		//vector<int> NucConst = createNucConstraint(NucDef, nuclen, n2i);
+	//vector<int> NucConst = createNucConstraint(NucDef, nuclen, n2i);
 
-		vector<int> NucConst;
-		if(NCflg){
-			NucConst = createNucConstraint(NucDef, nuclen, n2i);
-		}
-		//		for(int i = 1; i <= nuclen; i++)
-		//		printf("%d %d\n", i, NucConst[i]);
+	vector<int> &NucConst = ctx.NucConst;
+	if(NCflg){
+		NucConst = createNucConstraint(NucDef, nuclen, n2i);
+	}
+	//		for(int i = 1; i <= nuclen; i++)
+	//		printf("%d %d\n", i, NucConst[i]);
 
-		//createNucConstraint
+	//createNucConstraint
 
-		cout << aaseq << endl;
+	cout << aaseq << endl;
 //		cout << aalen << endl;
 
-		vector<vector<int> > pos2nuc = getPossibleNucleotide(aaseq, aalen, codon_table, n2i, exc);
+	vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	pos2nuc = getPossibleNucleotide(aaseq, aalen, codon_table, n2i, exc);
+	if(o.codon_cost){
+		set_nuc_cost(ctx.nuc_cost, *o.codon_cost, codon_table, exc, aaseq, aalen);
+		ctx.loop_cost = ctx.nuc_cost; // the region terms stay on pairs
+	}
+	if(!o.regions.empty())
+		add_region_cost(ctx.nuc_cost, o.regions, aalen);
+	int motif_blocked = 0;
+	if(o.motifs)
+		motif_blocked = block_motifs(*o.motifs, pos2nuc, Dep1, Dep2, substr, ii2r, i2n, nuclen);
 //		vector<vector<int> > pos2nuc = getPossibleNucleotide(aaseq, aalen, codon_table, n2i, 'R');
 //		showPos2Nuc(pos2nuc, i2n);
 //		exit(0);
-		indx = new int[nuclen + 1];
+	// -w auto, and a warning when the window does not fit in memory
+	long long budget = limits.memoryBudget() * 8 / 10;
+	if(auto_w){
+		w_tmp = auto_window(nuclen, budget, pos2nuc, compress_flg);
+		cout << "auto W = " << w_tmp << endl;
+	}
+	else if(budget > 0 && span.empty() && estimate_matrix_bytes(nuclen, w_tmp, pos2nuc, compress_flg) > budget){
+		cerr << "Warning: the matrices need about " << estimate_matrix_bytes(nuclen, w_tmp, pos2nuc, compress_flg) / (1024*1024)
+		     << " Mb but only " << budget / (1024*1024) << " Mb are available; consider -w auto or --compress." << endl;
+	}
 
-		set_ij_indx(indx, nuclen, w_tmp);
-		//set_ij_indx(indx, nuclen);
+	int *indx = new int[nuclen + 1];
+	vector<int> &band_lo = ctx.band_lo, &band_hi = ctx.band_hi;
 
-		string optseq;
-		optseq.resize(nuclen+1, 'N');
-		optseq[0] = ' ';
+	if(span.empty()){
+		set_ij_indx(indx, band_lo, band_hi, nuclen, w_tmp);
+	}
+	else{
+		set_ij_indx(indx, band_lo, band_hi, nuclen, w_tmp, span);
+		w_tmp = band_width(band_lo, nuclen);
+	}
+	//set_ij_indx(indx, nuclen);
 
-		string optseq_org;
-		optseq_org.resize(nuclen+1, 'N');
-		optseq_org[0] = ' ';
+	string optseq;
+	optseq.resize(nuclen+1, 'N');
+	optseq[0] = ' ';
 
+	string optseq_org;
+	optseq_org.resize(nuclen+1, 'N');
+	optseq_org[0] = ' ';
 
-		//	  int ***C, ***Mbl, ***Mbr, ***Mbb, ***M, ***F, ***Fbr, ***tFbr;
-		int ***C, ***M, ***F;
-		int ***F2;
-		int ***DMl,***DMl1,***DMl2;
-		int *chkC, *chkM;
-		bond *base_pair;
 
-			//		int n_inter = 1;
+	//	  int ***C, ***Mbl, ***Mbr, ***Mbb, ***M, ***F, ***Fbr, ***tFbr;
+	int ***&C = ctx.C, ***&M = ctx.M, ***&F = ctx.F;
+	int ***&F2 = ctx.F2;
+	int ***&DMl = ctx.DMl, ***&DMl1 = ctx.DMl1, ***&DMl2 = ctx.DMl2;
+	int *&chkC = ctx.chkC, *&chkM = ctx.chkM;
+	bond *&base_pair = ctx.base_pair;
 
+		//		int n_inter = 1;
 
-		paramT *P = NULL;
-		P = scale_parameters();
-		update_fold_params();
+
+	paramT *P = NULL;
+	P = scale_parameters();
+	update_fold_params();
+
+	ctx.nuclen = nuclen;
+	ctx.w = w_tmp;
+	ctx.indx = indx;
+	ctx.NucDef = NucDef;
+	ctx.NCflg = NCflg;
+	ctx.DEPflg = DEPflg;
+	ctx.TEST = TEST;
+	ctx.part_opt_flg = part_opt_flg;
+	ctx.rand_tb_flg = rand_tb_flg;
+	ctx.P = P;
 
 //		rev_flg = 0;
 //		if(rev_flg && num_interval == 0){
-		if(rev_flg && !part_opt_flg){
-			// reverse mode
-			string optseq_rev = rev_fold_step1(aaseq, aalen, codon_table, exc);
-			//			rev_fold_step2(&optseq_rev, aaseq, aalen, codon_table, exc, ofm, oto, 1);
-			rev_fold_step2(&optseq_rev, aaseq, aalen, codon_table, exc);
-			fixed_fold(optseq_rev, indx, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table);
-			free(P);
-			break; //returnすると、実行時間が表示されなくなるためbreakすること。
-		}
+	design_result res;
+	res.id = (desc[0] == '>') ? desc + 1 : desc;
+	res.flags = (rev_flg ? RESULT_REVERSE : 0) | (part_opt_flg ? RESULT_PARTIAL : 0)
+	          | (rand_tb_flg ? RESULT_RANDOM_TB : 0) | (w_tmp < nuclen ? RESULT_WINDOWED : 0)
+	          | (compress_flg ? RESULT_COMPRESS : 0);
+	double t_preprocess = 0, t_fixed = 0; // --metrics-socket
+	bool filled = false;
+	auto save_result = [&](){
+		res.t_fill = ctx.stats.t_fill_CM + ctx.stats.t_fill_F + ctx.stats.t_fill_F2;
+		res.t_total = fold_wtime() - t_record;
+		if(o.results)
+			o.results->append(res);
+		if(o.out)
+			*o.out = res;
+		if(o.metrics)
+			record_metrics(*o.metrics, ctx, filled, t_preprocess, res.t_fill + ctx.stats.t_alloc, t_fixed);
+	};
+
+	if(rev_flg && !part_opt_flg){
+		if(verify_flg)
+			cerr << "verify: -r without -f/-t does not run the DP fill, nothing to verify" << endl;
+		// reverse mode
+		string optseq_rev = rev_fold_step1(aaseq, aalen, codon_table, exc);
+		//			rev_fold_step2(&optseq_rev, aaseq, aalen, codon_table, exc, ofm, oto, 1);
+		rev_fold_step2(&optseq_rev, aaseq, aalen, codon_table, exc);
+		t_preprocess = fold_wtime() - t_record;
+		const double t_ff = fold_wtime();
+		fixed_fold(optseq_rev, indx, band_lo, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table, &res);
+		t_fixed = fold_wtime() - t_ff;
+		if(profile_w)
+			print_window_profile(optseq_rev, profile_w, predefHPN_E, BP_pair, P);
+		save_result();
+		free(P);
+		delete [] indx;
+		return false;
+	}
 
 
 
 
 
-		//		allocate_arrays(nuclen, indx, pos2nuc, pos2nuc, &C, &M, &F);
-		allocate_arrays(nuclen, indx, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair);
-		if(rand_tb_flg){
-			allocate_F2(nuclen, indx, w_tmp, pos2nuc, &F2);
-		}
-		//float ptotal_Mb = ptotal_Mb_alloc + ptotal_Mb_base;
+	//		allocate_arrays(nuclen, indx, pos2nuc, pos2nuc, &C, &M, &F);
+	if(stage)
+		stage->enter(record_pipeline::FILL);
+	double t_phase = fold_wtime();
+	t_preprocess = t_phase - t_record;
+	const long long workspace = estimate_matrix_bytes(nuclen, w_tmp, pos2nuc, compress_flg);
+	if(o.metrics)
+		o.metrics->add_workspace(workspace);
+#ifdef CDSFOLD_MPI
+	mpi_band part(nuclen, band_lo);
+	if(mpi_size > 1){
+		// own rows, plus the cells of higher rows this rank reads
+		allocate_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair, false,
+				[&part](int i, int j){ return part.keep(i, j); });
+	}
+	else
+#endif
+	if(o.mfe_only){
+		// the longer cells come and go with the strips of fill_mfe_only()
+		allocate_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair, false,
+				[](int i, int j){ return j - i + 1 <= 4 ? 3 : 0; });
+	}
+	else
+	allocate_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair, compress_flg);
+	if(rand_tb_flg){
+		allocate_F2(nuclen, indx, band_hi, w_tmp, pos2nuc, &F2);
+	}
+	if(compress_flg){
+		ctx.packC = new packed_cells(getBandSize(nuclen, indx), chkC);
+	}
+	ctx.stats.t_alloc = fold_wtime() - t_phase;
+	if(verify_flg){
+		clear_matrices(ctx);
+	}
+	//float ptotal_Mb = ptotal_Mb_alloc + ptotal_Mb_base;
 
 
 //		pid_t pid1 = getpid();
@@ -348,801 +533,835 @@ int main(int argc, char *argv[]) {
 //		cout << "Memory(VmRSS): "  << float(m1)/1024 << " Mb" << endl;
 //		exit(0);
 
-		// main routine
-		for (int l = 2; l <= 4; l++) {
-			for (int i = 1; i <= nuclen - l + 1; i++) {
-//				test = 1;
-				int j = i + l - 1;
-				//int ij = indx[j] + i;
-				int ij = getIndx(i, j, w_tmp, indx);
-
-				chkC[ij] = INF;
-				chkM[ij] = INF;
-
-				for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
-					int L_nuc = pos2nuc[i][L];
-					if(NCflg == 1 && i2r[L_nuc] != NucConst[i]){	continue;}
-					for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
-						int R_nuc = pos2nuc[j][R];
-						if(NCflg == 1 && i2r[R_nuc] != NucConst[j]){	continue;}
-						//L-R pair must be filtered
-//						if(j-1==1){
-//							cout << i << ":" << j << " " << L_nuc << "-" << R_nuc << " " << Dep1[ii2r[L_nuc*10+R_nuc]][i] <<endl;
-//						}
-						if(DEPflg && j-i == 1 && i <= nuclen - 1 && Dep1[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;} // nuclen - 1はいらないのでは？
-						if(DEPflg && j-i == 2 && i <= nuclen - 2 && Dep2[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;}
-
-						C[ij][L][R] = INF;
-						M[ij][L][R] = INF;
-						if(rand_tb_flg)
-							F2[ij][L][R] = 0;
-
-					}
-				}
-			}
+	ctx.yield = yield;
+	if(o.cost_fp){
+		ctx.cost = new cost_map(nuclen, w_tmp, fold_num_threads());
+	}
+
+	// main routine
+#ifdef CDSFOLD_MPI
+	if(mpi_size > 1){
+		mpi_fill_CM(ctx, part);
+		mpi_fill_F(ctx, part);
+	}
+	else
+#endif
+	if(o.mfe_only){
+		fill_mfe_only(ctx);
+	}
+	else{
+		fill_CM(ctx);
+		fill_F(ctx);
+	}
+	filled = true;
+
+	if(o.export_fp){
+		export_matrices(o.export_fp, ctx, res.id);
+	}
+	if(ctx.cost){
+		ctx.cost->write(o.cost_fp, res.id, aaseq);
+		delete ctx.cost;
+		ctx.cost = nullptr;
+	}
+
+	int minL, minR, MFE;
+	MFE = find_mfe(ctx, minL, minR);
+
+	if(MFE == INF){
+		if(!o.out){
+			printf("Mininum free energy is not defined.\n");
+			exit(1);
 		}
+		// the C interface reports the record (CDSFOLD_E_NO_MFE) and goes on
+		o.out->mfe = INF;
+		free_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair);
+		if(rand_tb_flg)
+			free_F2(nuclen, indx, band_hi, w_tmp, pos2nuc, &F2);
+		delete ctx.packC;
+		free(P);
+		delete [] indx;
+		return true;
+	}
 
-		//		cout << "TEST" << M[13][0][0] << endl;
-		// main routine
-		for (int l = 5; l <= nuclen; l++) {
-			if(l > w_tmp) break;
-			cout << "process:" << l << endl;
-
-			//	  for(int l = 5; l <= 5; l++){
-			for (int i = 1; i <= nuclen - l + 1; i++) {
-				int j = i + l - 1;
-
-				int opt_flg_ij = 1;
-				if(part_opt_flg){
-					for(int I = 0; I < n_inter; I++){
-						if((ofm[I] <= i && oto[I] >= i) ||
-								(ofm[I] <= j && oto[I] >= j)){
-							opt_flg_ij = 0;
-							break;
-						}
-					}
-				}
+	if(o.mfe_only){
+		redirect_cout(console);
+		cout << res.id << "\t" << float(MFE)/100 << endl;
+		res.mfe = MFE;
+		res.nuclen = nuclen;
+		res.flags |= RESULT_MFE_ONLY;
+		if(stats_flg){
+			print_stats(cerr, ctx);
+			limits.report(cerr);
+		}
+		if(m_disp){
+			print_memory_usage();
+		}
+		free_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair);
+		if(o.metrics)
+			o.metrics->add_workspace(-workspace);
+		save_result();
+		free(P);
+		delete [] indx;
+		return true;
+	}
+
+
+	if(rand_tb_flg){
+		fill_F2(ctx);
+	}
+
+//		string optseq;
+//		optseq.resize(nuclen+1, 'N');
+//		optseq[0] = ' ';
+//		backtrackR(&optseq, &*sector, &*base_pair, C, M, F,
+//					indx, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef);
+
+
+#ifdef CDSFOLD_MPI
+	if(mpi_size > 1 && mpi_rank > 0){
+		// the traceback runs on rank 0; serve it the cells of our rows
+		mpi_serve_cells(ctx);
+		if(stats_flg)
+			mpi_print_stats(cerr, part);
+		free_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair);
+		free(P);
+		delete [] indx;
+		return true;
+	}
+#endif
+
+	t_phase = fold_wtime();
+#ifdef CDSFOLD_MPI
+	if(mpi_size > 1){
+		function<int **(int)> fetchC = [&](int ij){ return mpi_fetch(ctx, part, 0, ij); };
+		function<int **(int)> fetchM = [&](int ij){ return mpi_fetch(ctx, part, 1, ij); };
+		backtrack(&optseq, &*sector, &*base_pair, cell_view(C, nullptr, &fetchC), cell_view(M, nullptr, &fetchM), F,
+				indx, band_lo, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef, ctx.nuc_cost, ctx.loop_cost);
+		mpi_stop_service();
+	}
+	else
+#endif
+	if(rand_tb_flg){
+		backtrack2(&optseq, &*sector, &*base_pair, cell_view(C, ctx.packC), M, F2,
+				indx, band_lo, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef);
+	}
+	else{
+		backtrack(&optseq, &*sector, &*base_pair, cell_view(C, ctx.packC), M, F,
+				indx, band_lo, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef, ctx.nuc_cost, ctx.loop_cost);
+	}
+
+	ctx.stats.t_backtrack = fold_wtime() - t_phase;
+	if(stage)
+		stage->enter(record_pipeline::FINISH);
+
+	if(verify_flg){
+		// compare every cell up to 4M cells, a sample of 200k cells above
+		long sample = verify_sample;
+		if(sample < 0)
+			sample = (getBandSize(nuclen, indx) > 4000000) ? 200000 : 0;
+		verify_record(ctx, optseq, MFE, sample);
+	}
 
+	if(!ctx.nuc_cost.empty()){
+		// the DP minimum includes the codon and region terms of the fixed
+		// nucleotides: nuc_cost at pairs, loop_cost elsewhere
+		vector<bool> paired(nuclen + 1, false);
+		for(int i = 1; i <= base_pair[0].i; i++){
+			const int bi = base_pair[i].i, bj = base_pair[i].j;
+			MFE -= pair_cost(ctx.nuc_cost, bi, n2i[optseq[bi]], bj, n2i[optseq[bj]]);
+			paired[bi] = paired[bj] = true;
+		}
+		for(int k = 1; k <= nuclen; k++)
+			if(!paired[k] && optseq[k] != 'N')
+				MFE -= nuc_row(ctx.loop_cost, k)[n2i[optseq[k]]];
+	}
+
+	if(o.codon_cost || !o.regions.empty()){
+		const codon_costs *cc = o.codon_cost;
+		const vector<design_region> &regions = o.regions;
+		fill_open_codons(optseq, [cc, &regions](int k, const string &c){
+				return (cc ? cc->lambda * cc->of(c) : 0) + region_codon_score(regions, k, c);
+			}, codon_table, exc, aaseq, aalen, Dep1, ii2r);
+	}
 
-				for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
-					int L_nuc = pos2nuc[i][L];
-//					cout << NCflg << endl;
-					if(NCflg == 1 && i2r[L_nuc] != NucConst[i]){	continue;}
-//					cout << "ok" << endl;
-
-					for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
-
-						int R_nuc = pos2nuc[j][R];
-
-						if(NCflg == 1 && i2r[R_nuc] != NucConst[j]){	continue;}
-
-						//int ij = indx[j] + i;
-						int ij = getIndx(i,j,w_tmp,indx);
-
-						C[ij][L][R] = INF;
-						M[ij][L][R] = INF;
-						//						cout << i << " " << j << ":" << M[ij][L][R] << endl;
-
-						int type = BP_pair[i2r[L_nuc]][i2r[R_nuc]];
-
-
-						if (type && opt_flg_ij) {
-							// hairpin
-							if((l == 5 || l ==6 || l == 8) && TEST){
-								for(unsigned int s = 0; s < substr[i][l].size(); s++){
-									string hpn = substr[i][l][s];
-									int hL_nuc  = n2i[hpn[0]];
-									int hL2_nuc = n2i[hpn[1]];
-									int hR2_nuc = n2i[hpn[l-2]];
-									int hR_nuc  = n2i[hpn[l-1]];
-									if(hL_nuc != i2r[L_nuc]) continue;
-									if(hR_nuc != i2r[R_nuc]) continue;
-
-									if(NCflg == 1){
-										string s1 = string(NucDef).substr(i, l);
-										if(hpn != s1) continue;
-									}
-
-//									cout << hpn << endl;
-//
-									if(DEPflg && L_nuc > 4 && Dep1[ii2r[L_nuc*10+hL2_nuc]][i] == 0){continue;}   // Dependencyをチェックした上でsubstringを求めているので, hpnの内部についてはチェックする必要はない。
-									if(DEPflg && R_nuc > 4 && Dep1[ii2r[hR2_nuc*10+R_nuc]][j-1] == 0){continue;} // ただし、L_nuc、R_nucがVWXYのときだけは、一つ内側との依存関係をチェックする必要がある。
-																											      // その逆に、一つ内側がVWXYのときはチェックの必要はない。既にチェックされているので。
-									if(predefHPN_E.count(hpn) > 0){
-										C[ij][L][R] = MIN2(predefHPN_E[hpn], C[ij][L][R]);
-
-									}
-									else{
-//										int energy = HairpinE(j - i - 1, type,
-//												i2r[hL2_nuc], i2r[hR2_nuc],
-//												dummy_str);
-										int energy = E_hairpin(j - i - 1, type,
-												i2r[hL2_nuc], i2r[hR2_nuc],
-												dummy_str, P);
-										C[ij][L][R] = MIN2(energy, C[ij][L][R]);
-									}
-								}
-								//exit(0);
-							}
-							else{
-								for (unsigned int L2 = 0;
-										L2 < pos2nuc[i + 1].size(); L2++) {
-									int L2_nuc = pos2nuc[i + 1][L2];
-									if(NCflg == 1 && i2r[L2_nuc] != NucConst[i+1]){	continue;}
-									//if(chkDep2){continue:}
-									for (unsigned int R2 = 0;
-											R2 < pos2nuc[j - 1].size(); R2++) {
-										int R2_nuc = pos2nuc[j - 1][R2];
-										if(NCflg == 1 && i2r[R2_nuc] != NucConst[j-1]){	continue;}
-
-										if(DEPflg && Dep1[ii2r[L_nuc*10+L2_nuc]][i] == 0){continue;}
-										if(DEPflg && Dep1[ii2r[R2_nuc*10+R_nuc]][j-1] == 0){continue;}
-
-										int energy;
-										//cout << j-i-1 << ":" << type << ":" << i2r[L2_nuc] << ":" << i2r[R2_nuc] << ":" << dummy_str << endl;
-										//										energy = HairpinE(j - i - 1, type,
-										//												i2r[L2_nuc], i2r[R2_nuc],
-										//												dummy_str);
-										energy = E_hairpin(j - i - 1, type,
-												i2r[L2_nuc], i2r[R2_nuc],
-												dummy_str, P);
-										//cout << "HairpinE(" << j-i-1 << "," << type << "," << i2r[L2_nuc] << "," << i2r[R2_nuc] << ")" << " at " << i << "," << j << ":" << energy << endl;
-										//cout << i << " " << j  << " " << energy << ":" << i2n[L_nuc] << "-" << i2n[R_nuc] << "<-" << i2n[L2_nuc] << "-" << i2n[R2_nuc] << endl;
-										C[ij][L][R] = MIN2(energy, C[ij][L][R]);
-
-										// check predefined hairpin energy
-										//if((l == 5 || l == 6 || l == 8) && preHPN_flg == 1){
-										//  if(predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].second != ""){
-										//		if(NCflg == 1){
-										//			string s1 = string(NucDef).substr(i, l);
-										//			if(predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].second == s1){
-										//				//C[ij][L][R] = MIN2(C[ij][L][R], predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].first);
-										//				C[ij][L][R] = predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].first; // Note that predefined hairpin is forced when it is found
-										//			}
-										//			}
-										//		else{
-										//			//一つ内側の塩基とのDependencyをチェックする。
-										//			string s1 = predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].second;
-										//			int preL2_nuc = n2i[s1[1]];
-										//			int preR2_nuc = n2i[s1[s1.size()-2]];
-//										//			cout << s1 << endl;
-										//			if(DEPflg && Dep1[ii2r[L_nuc*10+preL2_nuc]][i] == 0){continue;}
-										//			if(DEPflg && Dep1[ii2r[preR2_nuc*10+R_nuc]][j-1] == 0){continue;}
-										//			C[ij][L][R] = predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].first; // Note that predefined hairpin is forced when it is found
-										//		}
-//										//	exit(0);
-										//	}
-										//}
-									}
-
-								}
-							}
-
-							// interior loop
-							//cout << i+1 << " " <<  MIN2(j-2-TURN,i+MAXLOOP+1) << endl;
-							for (int p = i + 1;
-									p <= MIN2(j-2-TURN, i+MAXLOOP+1); p++) { // loop for position q, p
-								int minq = j - i + p - MAXLOOP - 2;
-								if (minq < p + 1 + TURN)
-									minq = p + 1 + TURN;
-								for (int q = minq; q < j; q++) {
-
-									int pq = getIndx(p,q,w_tmp, indx);
-
-									for (unsigned int Lp = 0;
-											Lp < pos2nuc[p].size(); Lp++) {
-										int Lp_nuc = pos2nuc[p][Lp];
-										if(NCflg == 1 && i2r[Lp_nuc] != NucConst[p]){	continue;}
-
-										if(DEPflg && p == i + 1 && Dep1[ii2r[L_nuc*10+Lp_nuc]][i] == 0){ continue;}
-										if(DEPflg && p == i + 2 && Dep2[ii2r[L_nuc*10+Lp_nuc]][i] == 0){ continue;}
-
-
-										for (unsigned int Rq = 0;
-												Rq < pos2nuc[q].size(); Rq++) { // nucleotide for p, q
-											int Rq_nuc = pos2nuc[q][Rq];
-											if(NCflg == 1 && i2r[Rq_nuc] != NucConst[q]){	continue;}
-
-											if(DEPflg && q == j - 1 && Dep1[ii2r[Rq_nuc*10+R_nuc]][q] == 0){ continue;}
-											if(DEPflg && q == j - 2 && Dep2[ii2r[Rq_nuc*10+R_nuc]][q] == 0){ continue;}
-
-											int type_2 =
-													BP_pair[i2r[Lp_nuc]][i2r[Rq_nuc]];
-
-											if (type_2 == 0)
-												continue;
-											type_2 = rtype[type_2];
-
-
-//											if (noGUclosure)
-//												if ((type_2 == 3)
-//														|| (type_2 == 4))
-//													if ((p > i + 1)
-//															|| (q < j - 1))
-//														continue; /* continue unless stack *//* no_close is removed. It is related with BONUS */
-
-											//											if(i==8&&j==19){
-//												cout << "test:" << p << "-" << q << endl;
-//											}
-
-											// for each intloops
-											for (unsigned int L2 = 0;
-													L2 < pos2nuc[i + 1].size();
-													L2++) { // nucleotide for i+1,j-1
-												int L2_nuc = pos2nuc[i + 1][L2];
-												if(NCflg == 1 && i2r[L2_nuc] != NucConst[i+1]){	continue;}
-
-												if(DEPflg && Dep1[ii2r[L_nuc*10+L2_nuc]][i] == 0){ continue;}
-
-
-												for (unsigned int R2 = 0;
-														R2
-																< pos2nuc[j - 1].size();
-														R2++) {
-													int R2_nuc =
-															pos2nuc[j - 1][R2];
-													if(NCflg == 1 && i2r[R2_nuc] != NucConst[j-1]){	continue;}
-
-													if(DEPflg && Dep1[ii2r[R2_nuc*10+R_nuc]][j-1] == 0){ continue;}
-
-													for (unsigned int Lp2 = 0;
-															Lp2
-																	< pos2nuc[p
-																			- 1].size();
-															Lp2++) { // nucleotide for p-1,q+1
-														int Lp2_nuc = pos2nuc[p
-																- 1][Lp2];
-														if(NCflg == 1 && i2r[Lp2_nuc] != NucConst[p-1]){ continue;}
-
-														if(DEPflg && Dep1[ii2r[Lp2_nuc*10+Lp_nuc]][p-1] == 0){ continue;}
-														if(p == i + 2 && L2_nuc != Lp2_nuc){ continue; } // check when a single nucleotide between i and p, this sentence confirm the dependency between Li_nuc and Lp2_nuc
-														if(DEPflg && i + 3 == p && Dep1[ii2r[L2_nuc*10+Lp2_nuc]][i+1] == 0){ continue;} // check dependency between i+1, p-1 (i,X,X,p)
-
-														for (unsigned int Rq2 =
-																0;
-																Rq2
-																		< pos2nuc[q
-																				+ 1].size();
-																Rq2++) {
-															int Rq2_nuc =
-																	pos2nuc[q
-																			+ 1][Rq2];
-															if(q == j - 2 && R2_nuc != Rq2_nuc){ continue; } // check when a single nucleotide between q and j,this sentence confirm the dependency between Rj_nuc and Rq2_nuc
-
-															if(NCflg == 1 && i2r[Rq2_nuc] != NucConst[q+1]){	continue;}
-
-															if(DEPflg && Dep1[ii2r[Rq_nuc*10+Rq2_nuc]][q] == 0){ continue;}
-															if(DEPflg && q + 3 == j && Dep1[ii2r[Rq2_nuc*10+R2_nuc]][q+1] == 0){ continue;} // check dependency between q+1, j-1 (q,X,X,j)
-
-															int int_energy =
-																	E_intloop(
-																			p
-																			- i
-																			- 1,
-																			j
-																			- q
-																			- 1,
-																			type,
-																			type_2,
-																			i2r[L2_nuc],
-																			i2r[R2_nuc],
-																			i2r[Lp2_nuc],
-																			i2r[Rq2_nuc],
-																			P);
-																	//LoopEnergy(p- i- 1,j- q- 1,type,type_2,i2r[L2_nuc],i2r[R2_nuc],i2r[Lp2_nuc],i2r[Rq2_nuc]);
-
-															//int energy =
-															//		int_energy
-															//		+ C[indx[q]
-															//			+ p][Lp][Rq];
-
-															int energy =
-																	int_energy
-																	+ C[pq][Lp][Rq];
-															C[ij][L][R] =
-																	MIN2(energy,
-																			C[ij][L][R]);
-
-														}
-
-													}
-												}
-											}
-										}
-									}
-								} /* end q-loop */
-							} /* end p-loop */
-
-							// multi-loop
-							for (unsigned int Li1 = 0;
-									Li1 < pos2nuc[i + 1].size(); Li1++) {
-								int Li1_nuc = pos2nuc[i+1][Li1];
-								if(NCflg == 1 && i2r[Li1_nuc] != NucConst[i+1]){	continue;}
-
-								if(DEPflg && Dep1[ii2r[L_nuc*10+Li1_nuc]][i] == 0){ continue;}
-
-								for (unsigned int Rj1 = 0;
-										Rj1 < pos2nuc[j - 1].size(); Rj1++) {
-									int Rj1_nuc = pos2nuc[j-1][Rj1];
-									if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j-1]){	continue;}
-
-									if(DEPflg && Dep1[ii2r[Rj1_nuc*10+R_nuc]][j-1] == 0){ continue;}
-									//if(DEPflg && j-i == 2 && i <= nuclen - 2 && Dep2[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;}
-									if(DEPflg && (j-1)-(i+1) == 2 && Dep2[ii2r[Li1_nuc*10+Rj1_nuc]][i+1] == 0){continue;} // 2014/10/8 i-jが近いときは、MLclosingする必要はないのでは。少なくとも3つのステムが含まれなければならない。それには、５＋５＋２（ヘアピン2個分＋2塩基）の長さが必要。
-
-									int energy = DMl2[i+1][Li1][Rj1]; // 長さが2個短いときの、複合マルチループ。i'=i+1を選ぶと、j'=(i+1)+(l-2)-1=i+l-2=j-1(because:j=i+l-1)
-									int tt = rtype[type];
-
-									energy += P->MLintern[tt];
-									if(tt > 2)
-										energy += P->TerminalAU;
-
-									energy += P->MLclosing;
-									//cout << "TEST:" << i << " " << j << " " << energy << endl;
-									C[ij][L][R] =
-											MIN2(energy,
-													C[ij][L][R]);
-
-//									if(C[ij][L][R] == -1130 && ij == 10091){
-//										exit(0);
-//									}
-
-
-								}
-							}
-
-
-//							cout << "ok" << endl;
-						}
-
-						else C[ij][L][R] = INF;
-
-
-						// fill M
-						// create M[ij] from C[ij]
-						if(type){
-					        int energy_M = C[ij][L][R];
-					        if(type > 2)
-					          energy_M += P->TerminalAU;
-
-					        energy_M += P->MLintern[type];
-					        M[ij][L][R] = energy_M;
-						}
-
-						// create M[ij] from M[i+1][j]
-						for (unsigned int Li1 = 0;
-								Li1 < pos2nuc[i + 1].size(); Li1++) {
-							int Li1_nuc = pos2nuc[i + 1][Li1];
-							if(NCflg == 1 && i2r[Li1_nuc] != NucConst[i + 1]){	continue;}
-							if(DEPflg && Dep1[ii2r[L_nuc*10+Li1_nuc]][i] == 0){ continue;}
-
-							//int energy_M = M[indx[j]+i+1][Li1][R]+P->MLbase;
-							int energy_M = M[getIndx(i+1, j, w_tmp, indx)][Li1][R]+P->MLbase;
-					        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
-						}
-
-						// create M[ij] from M[i][j-1]
-						for (unsigned int Rj1 = 0;
-								Rj1 < pos2nuc[j - 1].size(); Rj1++) {
-							int Rj1_nuc = pos2nuc[j - 1][Rj1];
-							if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j - 1]){	continue;}
-							if(DEPflg && Dep1[ii2r[Rj1_nuc*10+R_nuc]][j-1] == 0){ continue;}
-
-							//int energy_M = M[indx[j-1]+i][L][Rj1]+P->MLbase;
-							int energy_M = M[getIndx(i,j-1, w_tmp,indx)][L][Rj1]+P->MLbase;
-					        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
-						}
-
-
-						/* modular decomposition -------------------------------*/
-						for (int k = i + 2 + TURN; k <= j - TURN - 1; k++) { // Is this correct?
-							//cout << k << endl;
-							for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
-									Rk1++) {
-								int Rk1_nuc = pos2nuc[k-1][Rk1];
-								if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
-								//if(DEPflg && k == i + 2 && Dep1[ii2r[L_nuc*10+Rk1_nuc]][k-1] == 0){ continue;} // dependency between i and k - 1(=i+1)
-								//if(DEPflg && k == i + 3 && Dep2[ii2r[L_nuc*10+Rk1_nuc]][k-1] == 0){ continue;} // dependency between i and k - 1(=i+2)
-
-								for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
-										Lk++) {
-									int Lk_nuc = pos2nuc[k][Lk];
-									if(NCflg == 1 && i2r[Lk_nuc] != NucConst[k]){	continue;}
-									if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
-									//if(DEPflg && (k-1) - i + 1 == 2 && Dep2[ii2r[Rk1_nuc*10+L_nuc]][k-1] == 0){ continue;} // dependency between i and k - 1
-
-									//cout << i << " " << k-1 << ":" << M[indx[k-1]+i][L][Rk1] << "," << k << " " << j << ":" << M[indx[j]+k][Lk][R] << endl;
-									//int energy_M =  M[indx[k-1]+i][L][Rk1]+M[indx[j]+k][Lk][R];
-									int energy_M =  M[getIndx(i,k-1,w_tmp,indx)][L][Rk1]+M[getIndx(k,j,w_tmp,indx)][Lk][R];
-									DMl[i][L][R] = MIN2(energy_M, DMl[i][L][R]);
-							        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
-
-								}
-							}
-						}
-
-
-//						if(i == 3 && j == 7)
-						//cout << i << " " << j << ":" << C[ij][L][R] << " " << L << "-" << R << endl;
-						//vwxyがあるので、ここを複数回訪れることがある。
-						//なので、MIN2を取っておく。
-						//if(i2r[L_nuc] == NucConst[i] && i2r[R_nuc] == NucConst[j]){
-							chkC[ij] = MIN2(chkC[ij], C[ij][L][R]);
-							chkM[ij] = MIN2(chkM[ij], M[ij][L][R]);
-						//} このループは多分意味がない。
-					}
+	//塩基Nの修正
+	for(int i = 1; i <= nuclen; i++){
+		if(optseq[i] == 'N'){
+			for(unsigned int R = 0; R < pos2nuc[i].size(); R++){ // check denendency with the previous and next nucleotide
+				int R_nuc = pos2nuc[i][R];
+				if(NCflg == 1 && i2r[R_nuc] != NucConst[i]){	continue;}
+
+				if(i != 1 && optseq[i-1] != 'N'){ // check consistensy with the previous nucleotide
+					int R_prev_nuc = n2i[optseq[i-1]];
+					if(DEPflg && Dep1[ii2r[R_prev_nuc*10+R_nuc]][i-1] == 0){ continue;}
 				}
-			}
-			// rotate DMl arrays
-			int ***FF;
-			FF = DMl2; DMl2 = DMl1; DMl1 = DMl; DMl =FF;
-			for(int j = 1; j <= nuclen; j++){
-				for(unsigned int L = 0; L < 4; L++){
-					fill(DMl[j][L], DMl[j][L]+4,INF);
+				if(i != nuclen && optseq[i+1] != 'N'){ // check consistensy with the next nucleotide
+					int R_next_nuc = n2i[optseq[i+1]];
+					if(DEPflg && Dep1[ii2r[R_nuc*10+R_next_nuc]][i] == 0){ continue;}
+				}
+				if(i < nuclen - 1 && optseq[i+2] != 'N'){ // check consistensy with the next nucleotide
+					int R_next_nuc = n2i[optseq[i+2]];
+					if(DEPflg && Dep2[ii2r[R_nuc*10+R_next_nuc]][i] == 0){ continue;}
 				}
+
+				optseq[i] = i2n[R_nuc];
+				break;
 			}
+			//cout << i << ":" << optseq[i] << endl;
 		}
+	}
+	//塩基V,W,X,Yの修正
+	for(int i = 1; i <= nuclen; i++){
 
+		if(optseq[i] == 'V' || optseq[i] == 'W'){
+			optseq[i] = 'U';
+		}
+		else if(optseq[i] == 'X' || optseq[i] == 'Y'){
+			optseq[i] = 'G';
+		}
+	}
 
 
-		// Fill F matrix
-		// Initialize F[1]
-		for (unsigned int L = 0; L < pos2nuc[1].size(); L++) {
-			for (unsigned int R = 0; R < pos2nuc[1].size(); R++) {
-				F[1][L][R] = 0;
-			}
-		}
+	//2次構造情報の表示
+	string optstr;
+	optstr.resize(nuclen+1, '.');
+	optstr[0] = ' ';
+	for(int i = 1; i <= base_pair[0].i; i++){
+		optstr[base_pair[i].i] = '(';
+		optstr[base_pair[i].j] = ')';
+	}
 
-		for (unsigned int L1 = 0; L1 < pos2nuc[1].size(); L1++) {
-			int L1_nuc = pos2nuc[1][L1];
-			if(NCflg == 1 && i2r[L1_nuc] != NucConst[1]){	continue;}
-
-			for (int j = 2; j <= nuclen; j++) {
-
-//				int opt_flg_1 = 1;
-//				for(int I = 0; I < n_inter; I++){
-//					if(ofm[I] <= 1 && oto[I] >= 1){
-//						opt_flg_1 = 0;
-//						break;
-//					}
-//				}
-				//				int opt_flg_j = 1;
-				//				for(int I = 0; I < n_inter; I++){
-				//					if(ofm[I] <= j && oto[I] >= j){
-				//						opt_flg_j = 0;
-				//						break;
-				//					}
-				//				}
-
-				for (unsigned int Rj = 0; Rj < pos2nuc[j].size(); Rj++) {
-					int Rj_nuc = pos2nuc[j][Rj];
-					if(NCflg == 1 && i2r[Rj_nuc] != NucConst[j]){	continue;}
-
-					if(DEPflg && j == 2 && Dep1[ii2r[L1_nuc*10+Rj_nuc]][1] == 0){ continue;}
-					if(DEPflg && j == 3 && Dep2[ii2r[L1_nuc*10+Rj_nuc]][1] == 0){ continue;}
-
-
-					F[j][L1][Rj] = INF;
-
-
-					int type_L1Rj = BP_pair[i2r[L1_nuc]][i2r[Rj_nuc]];
-					if (type_L1Rj) {
-//						if(opt_flg_1 && opt_flg_j){
-							int au_penalty = 0;
-							if (type_L1Rj > 2)
-								au_penalty = P->TerminalAU;
-							if(j <= w_tmp)
-								F[j][L1][Rj] = MIN2(F[j][L1][Rj], C[getIndx(1,j,w_tmp,indx)][L1][Rj] + au_penalty); // recc 1
-								//F[j][L1][Rj] = MIN2(F[j][L1][Rj], C[indx[j] + 1][L1][Rj] + au_penalty); // recc 1
-//						}
-					}
-
-					// create F[j] from F[j-1]
-					for (unsigned int Rj1 = 0; Rj1 < pos2nuc[j - 1].size();
-							Rj1++) {
-						int Rj1_nuc = pos2nuc[j-1][Rj1];
-						if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j-1]){	continue;}
-						if(DEPflg && Dep1[ii2r[Rj1_nuc*10+Rj_nuc]][j-1] == 0){ continue;}
-
-						F[j][L1][Rj] = MIN2(F[j][L1][Rj], F[j - 1][L1][Rj1]); // recc 2
-					}
-
-					// create F[j] from F[k-1] and C[k][j]
-					//for (int k = 2; k <= j - TURN - 1; k++) { // Is this correct?
-					for (int k = MAX2(2, j-w_tmp+1); k <= j - TURN - 1; k++) { // Is this correct?
-
-//						int opt_flg_k = 1;
-//						for(int I = 0; I < n_inter; I++){
-//							if(ofm[I] <= k && oto[I] >= k){
-//								opt_flg_k = 0;
-//								break;
-//							}
-//						}
-
-
-						for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
-								Rk1++) {
-							int Rk1_nuc = pos2nuc[k-1][Rk1];
-							if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
-							if(DEPflg && k == 3 && Dep1[ii2r[L1_nuc*10+Rk1_nuc]][1] == 0){ continue;} // dependency between 1(i) and 2(k-1)
-							if(DEPflg && k == 4 && Dep2[ii2r[L1_nuc*10+Rk1_nuc]][1] == 0){ continue;} // dependency between 1(i) and 3(k-1)
-
-							for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
-									Lk++) {
-								int Lk_nuc = pos2nuc[k][Lk];
-								if(NCflg == 1 && i2r[Lk_nuc] != NucConst[k]){	continue;}
-
-								if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k-1 and k
-
-								int type_LkRj =
-										BP_pair[i2r[Lk_nuc]][i2r[Rj_nuc]];
-
-								int au_penalty = 0;
-								if (type_LkRj > 2)
-									au_penalty = P->TerminalAU;
-								//int kj = indx[j] + k;
-								int kj = getIndx(k,j,w_tmp,indx);
-
-								int energy = F[k - 1][L1][Rk1] + C[kj][Lk][Rj]
-										+ au_penalty; // recc 4
-
-								F[j][L1][Rj] = MIN2(F[j][L1][Rj], energy);
-							}
-
-						}
-					}
-
-					//cout << j << ":" << F[j][L1][Rj] << " " << i2n[L1_nuc] << "-" << i2n[Rj_nuc] << endl;
-
-					//test
-					if (j == nuclen) {
-						cout << i2n[L1_nuc] << "-" << i2n[Rj_nuc] << ":"
-								<< F[j][L1][Rj] << endl;
-					}
-				}
-			}
+	//show original amino acids
+	for(int i = 0; i < aalen; i++){
+		cout << aaseq[i] << "  ";
+	}
+	cout << endl;
+	//check amino acids of desinged DNA
+	int j = 0;
+	for(unsigned int i = 1; i < optseq.size(); i = i+3){
+		char aa = codon_table.c2a(n2i[optseq[i]], n2i[optseq[i+1]], n2i[optseq[i+2]]);
+		cout << aa << "  ";
+		if(aaseq[j] != aa){
+			cerr << j+1 << "-th amino acid differs:" << aaseq[j] << ":" << aa << endl;
+			res.flags |= RESULT_AA_DIFF;
 		}
+		j++;
+	}
+	cout << endl;
+	//最適塩基と2次構造の表示
+	string optseq_disp = optseq;
+	optseq_disp.erase(0, 1);
+	optstr.erase(0, 1);
+	cout << optseq_disp << endl;
+	cout << optstr << endl;
+	cout << "MFE:" << float(MFE)/100 << " kcal/mol" << endl;
+	if(o.codon_cost){
+		const double cost = o.codon_cost->design(optseq_disp);
+		cout << "Codon cost:" << cost << " (lambda " << o.codon_cost->lambda << ")" << endl;
+		cout << "Objective:" << float(MFE)/100 + cost << endl;
+	}
+	res.seq = optseq_disp;
+	res.mfe = MFE;
+	for(int i = 1; i <= base_pair[0].i; i++)
+		res.pairs.push_back(make_pair(base_pair[i].i, base_pair[i].j));
+	if(!o.regions.empty())
+		print_region_report(cout, o.regions, aalen, res.pairs);
+	if(o.refold){
+		// the designed sequence on its own, as a check of the regions
+		res.pairs.clear();
+		const double t_ff = fold_wtime();
+		fixed_fold(optseq, indx, band_lo, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table, &res);
+		t_fixed += fold_wtime() - t_ff;
+		print_region_report(cout, o.regions, aalen, res.pairs);
+	}
 
-		int minL, minR, MFE;
-		MFE = INF;
-		for(unsigned int L = 0; L < pos2nuc[1].size(); L++){
-			int L_nuc = pos2nuc[1][L];
-			if(NCflg == 1 && i2r[L_nuc] != NucConst[1]){	continue;}
-			for(unsigned int R = 0; R < pos2nuc[nuclen].size(); R++){
-				int R_nuc = pos2nuc[nuclen][R];
-				if(NCflg == 1 && i2r[R_nuc] != NucConst[nuclen]){	continue;}
-
-				if(F[nuclen][L][R] < MFE){
-					MFE  = F[nuclen][L][R];
-					minL = L;
-					minR = R;
-				}
 
+	if(part_opt_flg == 1){
+		//部分アミノ酸配列の作成
+		for(int I = 0; I< n_inter; I++){
+			int aa_fm = (ofm[I]-1)/3 + 1; // 1-based
+			int aa_to = oto[I]/3; // 1-based
+			int part_aalen = aa_to - aa_fm + 1;
+
+			char part_aaseq[part_aalen + 1];
+			part_aaseq[part_aalen] = '\0';
+			int j = 0;
+			for(int i = aa_fm; i <= aa_to; i++){
+				part_aaseq[j++] = aaseq[i-1]; // convert to 0-based
 			}
-		}
 
-		if(MFE == INF){
-			printf("Mininum free energy is not defined.\n");
-			exit(1);
-		}
+			cout << aa_fm << ":" << aa_to << endl;
+			cout << part_aalen << endl;
+			cout << part_aaseq << endl;
 
 
-		if(rand_tb_flg){
-			// Fill F2 matrix
-			for (int l = 5; l <= nuclen; l++) {
-				if(l > w_tmp) break;
-			cout << "process F2:" << l << endl;
-
-				for (int i = 1; i <= nuclen - l + 1; i++) {
-					int j = i + l - 1;
-
-					for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
-						int L_nuc = pos2nuc[i][L];
-
-						for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
-							int R_nuc = pos2nuc[j][R];
-							int ij = getIndx(i,j,w_tmp,indx);
-
-							F2[ij][L][R] = 0;
-
-							int type = BP_pair[i2r[L_nuc]][i2r[R_nuc]];
-
-							// from i, j-1 -> i, j
-							for (unsigned int R1 = 0; R1 < pos2nuc[j-1].size(); R1++) {
-								int R1_nuc = pos2nuc[j-1][R1];
-								if(DEPflg && Dep1[ii2r[R1_nuc*10+R_nuc]][j-1] == 0){continue;}
-								int ij1 = getIndx(i,j-1,w_tmp,indx);
-								F2[ij][L][R] = MIN2(F2[ij][L][R], F2[ij1][L][R1]);
-							}
-							// from i-1, j -> i, j
-							for (unsigned int L1 = 0; L1 < pos2nuc[i+1].size(); L1++) {
-								int L1_nuc = pos2nuc[i+1][L1];
-								if(DEPflg && Dep1[ii2r[L_nuc*10+L1_nuc]][i] == 0){continue;}
-								int i1j = getIndx(i+1,j,w_tmp,indx);
-								F2[ij][L][R] = MIN2(F2[ij][L][R], F2[i1j][L1][R]);
-							}
-
-							// from C
-							int au_penalty = 0;
-							if (type > 2)
-								au_penalty = P->TerminalAU;
-							if(j - i + 1 <= w_tmp){
-								F2[ij][L][R] = MIN2(F2[ij][L][R], C[ij][L][R] + au_penalty);
-								//cout << "test:" << F2[ij][L][R] << endl;
-							}
-
-							// Bifucation
-							/* modular decomposition -------------------------------*/
-							for (int k = i + 2 + TURN; k <= j - TURN - 1; k++) { // Is this correct?
-								//cout << k << endl;
-//			    				if((k - 1) - i + 1 > w_tmp ||
-//			    					j - k + 1 > w_tmp)
-//			    						continue;
-
-								for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
-										Rk1++) {
-									int Rk1_nuc = pos2nuc[k-1][Rk1];
-
-									for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
-											Lk++) {
-										int Lk_nuc = pos2nuc[k][Lk];
-										if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
-
-										int energy =  F2[getIndx(i,k-1,w_tmp,indx)][L][Rk1]+F2[getIndx(k,j,w_tmp,indx)][Lk][R];
-										F2[ij][L][R] = MIN2(F2[ij][L][R], energy);
-
-									}
-								}
-							}
-
-//							cout << i << "," << j << "," << L << "," << R << "," << F2[ij][L][R] << endl;
-
-						}
-					}
-				}
+			string part_optseq = rev_fold_step1(part_aaseq, part_aalen, codon_table, exc);
+			rev_fold_step2(&part_optseq, part_aaseq, part_aalen, codon_table, exc);
+			// combine optseq_rev and optseq
+			j = 1;
+			for(int i = ofm[I]; i <= oto[I]; i++){
+				optseq[i] = part_optseq[j++];
 			}
 		}
+		res.pairs.clear();
+		const double t_ff = fold_wtime();
+		fixed_fold(optseq, indx, band_lo, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table, &res);
+		t_fixed += fold_wtime() - t_ff;
+		//fixed_fold(optseq, indx, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table);
+	}
 
-//		string optseq;
-//		optseq.resize(nuclen+1, 'N');
-//		optseq[0] = ' ';
-//		backtrackR(&optseq, &*sector, &*base_pair, C, M, F,
-//					indx, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef);
+	if(o.motifs){
+		for(const pair<int, int> &hit : o.motifs->find(optseq.substr(1)))
+			cerr << "Forbidden motif " << o.motifs->motifs[hit.second] << " could not be avoided at " << hit.first << endl;
+	}
+
+	if(profile_w){
+		print_window_profile(optseq, profile_w, predefHPN_E, BP_pair, P);
+	}
+
+	if(stats_flg){
+		print_stats(cerr, ctx);
+		limits.report(cerr);
+		if(o.motifs)
+			cerr << "stats: motif_pairs_blocked " << motif_blocked << endl;
+#ifdef CDSFOLD_MPI
+		if(mpi_size > 1)
+			mpi_print_stats(cerr, part);
+#endif
+	}
+
+	if(m_disp){
+		print_memory_usage();
+	}
+
+	free_arrays(nuclen, indx, band_hi, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair);
+	if(rand_tb_flg)
+		free_F2(nuclen, indx, band_hi, w_tmp, pos2nuc, &F2);
+	if(o.metrics)
+		o.metrics->add_workspace(-workspace);
+
+	save_result();
+	delete ctx.packC;
+
+	free(P);
+	delete [] indx;
+
+	return true;
+}
 
+// Designs the records of the FASTA file in, as a --serve or --spool job on
+// a scheduler thread, which does not inherit the main thread's OpenMP team
+// size: threads is set first. Records check_record() rejects are skipped;
+// returns their errors, one "desc: error" line each.
+string design_file(const design_options &o, const string &in, int threads, const function<void()> &yield)
+{
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+	design_options jo = o; // W and -f/-t are adjusted per record
+	fasta all_aaseq(in.c_str());
+	cout << "W = " << jo.W << endl;
+	cout << "e = " << jo.exc << endl;
+	string errors;
+	do {
+		const string err = check_record(jo, all_aaseq.getSeq(), all_aaseq.getSeqLen());
+		if(!err.empty()){
+			errors += string(all_aaseq.getDesc()) + ": " + err + "\n";
+			continue;
+		}
+		if(!design_record(jo, all_aaseq.getDesc(), all_aaseq.getSeq(), all_aaseq.getSeqLen(), yield))
+			break;
+	} while (all_aaseq.next());
+	return errors;
+}
 
-		if(rand_tb_flg){
-			backtrack2(&optseq, &*sector, &*base_pair, C, M, F2,
-					indx, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef);
+// --serve: designs the jobs read from stdin, one per line
+//   <interactive|batch> <input.faa> <output>
+// Interactive jobs overtake queued batch jobs and preempt a running one.
+// With a metrics socket, its clients get the service counters.
+int serve(const design_options &so, const string &metrics_socket)
+{
+	design_options o = so;
+	service_metrics metrics;
+	unique_ptr<metrics_server> server;
+	if(!metrics_socket.empty()){
+		o.metrics = &metrics;
+		server.reset(new metrics_server(metrics, metrics_socket));
+	}
+	const int n_threads = fold_num_threads();
+	streambuf *console = cout.rdbuf();
+	Scheduler sched(o.metrics);
+	string line;
+	while(getline(cin, line)){
+		stringstream ss(line);
+		string lane, in, out;
+		if(!(ss >> lane))
+			continue;
+		if(!(ss >> in >> out) || (lane != "interactive" && lane != "batch")){
+			cerr << "serve: expected '<interactive|batch> <input.faa> <output>': " << line << endl;
+			continue;
+		}
+		if(!ifstream(in)){
+			cerr << "serve: cannot read " << in << endl;
+			continue;
 		}
-		else{
-			backtrack(&optseq, &*sector, &*base_pair, C, M, F,
-					indx, minL, minR, P, NucConst, pos2nuc, NCflg, i2r, nuclen, w_tmp, BP_pair, i2n, rtype, ii2r, Dep1, Dep2, DEPflg, predefHPN, predefHPN_E, substr, n2i, NucDef);
+		shared_ptr<ofstream> os(new ofstream(out));
+		if(!*os){
+			cerr << "serve: cannot write " << out << endl;
+			continue;
 		}
+		sched.submit(lane == "interactive" ? Scheduler::INTERACTIVE : Scheduler::BATCH,
+			[=](const function<void()> &yield){
+				stringstream errors(design_file(o, in, n_threads, yield));
+				cout.flush();
+				os->close();
+				for(string e; getline(errors, e); )
+					cerr << "serve: " << in << ": " << e << endl;
+			}, os->rdbuf());
+		sched.reap();
+	}
+	sched.wait();
+	sched.reap();
+	cout.rdbuf(console);
+	sched.report(cerr);
+	return 0;
+}
 
-		//塩基Nの修正
-		for(int i = 1; i <= nuclen; i++){
-			if(optseq[i] == 'N'){
-				for(unsigned int R = 0; R < pos2nuc[i].size(); R++){ // check denendency with the previous and next nucleotide
-					int R_nuc = pos2nuc[i][R];
-					if(NCflg == 1 && i2r[R_nuc] != NucConst[i]){	continue;}
-
-					if(i != 1 && optseq[i-1] != 'N'){ // check consistensy with the previous nucleotide
-						int R_prev_nuc = n2i[optseq[i-1]];
-						if(DEPflg && Dep1[ii2r[R_prev_nuc*10+R_nuc]][i-1] == 0){ continue;}
-					}
-					if(i != nuclen && optseq[i+1] != 'N'){ // check consistensy with the next nucleotide
-						int R_next_nuc = n2i[optseq[i+1]];
-						if(DEPflg && Dep1[ii2r[R_nuc*10+R_next_nuc]][i] == 0){ continue;}
-					}
-					if(i < nuclen - 1 && optseq[i+2] != 'N'){ // check consistensy with the next nucleotide
-						int R_next_nuc = n2i[optseq[i+2]];
-						if(DEPflg && Dep2[ii2r[R_nuc*10+R_next_nuc]][i] == 0){ continue;}
-					}
-
-					optseq[i] = i2n[R_nuc];
-					break;
-				}
-				//cout << i << ":" << optseq[i] << endl;
+volatile sig_atomic_t spool_stop = 0;
+
+// --spool: designs the FASTA files dropped into in_dir as batch jobs, one
+// output file each in out_dir, until SIGINT or SIGTERM. Files are claimed
+// one job ahead of the running one (see Spool.hpp).
+int spool(const design_options &so, const string &in_dir, const string &out_dir, const string &metrics_socket)
+{
+	design_options o = so;
+	service_metrics metrics;
+	unique_ptr<metrics_server> server;
+	if(!metrics_socket.empty()){
+		o.metrics = &metrics;
+		server.reset(new metrics_server(metrics, metrics_socket));
+	}
+	const int n_threads = fold_num_threads();
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = [](int){ spool_stop = 1; };
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	spool_dir dir(in_dir, out_dir);
+	Scheduler sched(o.metrics);
+	while(!spool_stop){
+		const size_t pending = sched.pending();
+		for(const string &name : dir.claim(pending < 2 ? 2 - pending : 0)){
+			shared_ptr<ofstream> out(new ofstream(dir.temporary(name)));
+			if(!*out){
+				cerr << "spool: cannot write " << dir.temporary(name) << endl;
+				continue; // the claim stays in the work directory
 			}
+			const string in = dir.claimed(name);
+			sched.submit(Scheduler::BATCH,
+				[=, &dir](const function<void()> &yield){
+					const string errors = design_file(o, in, n_threads, yield);
+					cout.flush();
+					out->close();
+					stringstream ss(errors);
+					for(string e; getline(ss, e); )
+						cerr << "spool: " << name << ": " << e << endl;
+					const string err = errors.empty() ? dir.finish(name) : dir.fail(name, errors);
+					if(!err.empty())
+						cerr << "spool: " << err << endl;
+				}, out->rdbuf());
 		}
-		//塩基V,W,X,Yの修正
-		for(int i = 1; i <= nuclen; i++){
+		sched.reap();
+		dir.wait();
+	}
+	sched.wait();
+	sched.reap();
+	sched.report(cerr);
+	return 0;
+}
+
+#ifdef CDSFOLD_LIBRARY
+#include "CDSfold_capi.hpp"
+#else
+int main(int argc, char *argv[]) {
+#ifdef CDSFOLD_MPI
+	int mpi_thread_level;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_level);
+	MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+	if(mpi_rank > 0)
+		cout.rdbuf(nullptr); // rank 0 prints the results
+#endif
+	design_options o;
+	int &W = o.W;
+	bool &auto_w = o.auto_w;
+	string &exc = o.exc;
+	exc.reserve(100);                 // Pre-allocate string space
+	bool &m_disp = o.m_disp;
+	bool &rand_tb_flg = o.rand_tb_flg;
+	bool &rev_flg = o.rev_flg;
+	bool &part_opt_flg = o.part_opt_flg;
+	int &opt_fm = o.opt_fm;
+	int &opt_to = o.opt_to;
+	int n_threads = 0;                // --threads (0: OpenMP default)
+	bool &stats_flg = o.stats_flg;
+	bool &verify_flg = o.verify_flg;
+	long &verify_sample = o.verify_sample;
+	vector<span_range> &span = o.span;
+	int &profile_w = o.profile_w;
+	bool &compress_flg = o.compress_flg;
+	bool serve_flg = false;           // --serve jobs from stdin
+	bool pipeline_flg = false;        // --pipeline overlapped records
+	string results_file;              // --results columnar output
+	string export_file;               // --export-matrices chkC/chkM/F dump
+	string cost_file;                 // --cost-map fill time per residue
+	string codon_cost_file;           // --codon-cost table
+	double lambda = 1;                // --lambda weight of the codon costs
+	string motif_file;                // --forbid-motifs
+	string regions_spec;              // --regions
+	string metrics_socket;            // --metrics-socket with --serve
+	string spool_in, spool_out;       // --spool/--out directories
+	// get options
+	{
+		static struct option long_opts[] = {
+			{"seed", required_argument, NULL, 'S'},
+			{"threads", required_argument, NULL, 'T'},
+			{"stats", no_argument, NULL, 's'},
+			{"verify", no_argument, NULL, 'V'},
+			{"verify-sample", required_argument, NULL, 'v'},
+			{"span", required_argument, NULL, 'p'},
+			{"profile-window", required_argument, NULL, 'P'},
+			{"compress", no_argument, NULL, 'z'},
+			{"serve", no_argument, NULL, 'Q'},
+			{"results", required_argument, NULL, 'O'},
+			{"export-matrices", required_argument, NULL, 'X'},
+			{"cost-map", required_argument, NULL, 'H'},
+			{"codon-cost", required_argument, NULL, 'C'},
+			{"lambda", required_argument, NULL, 'L'},
+			{"forbid-motifs", required_argument, NULL, 'B'},
+			{"regions", required_argument, NULL, 'G'},
+			{"refold", no_argument, NULL, 'F'},
+			{"pipeline", no_argument, NULL, 'I'},
+			{"metrics-socket", required_argument, NULL, 'K'},
+			{"mfe-only", no_argument, NULL, 'N'},
+			{"spool", required_argument, NULL, 'U'},
+			{"out", required_argument, NULL, 'o'},
+			{NULL, 0, NULL, 0}
+		};
+		int opt;
+		while((opt=getopt_long(argc,argv,"w:e:f:t:rMR",long_opts,NULL))!=-1){
+			switch(opt){
+			case 'w':
+				if(string(optarg) == "auto")
+					auto_w = true;
+				else
+					W = atoi(optarg);
+				break;
+			case 'e':
+				exc = string(optarg);
+				break;
+			case 'M':
+				m_disp = true;
+				break;
+			case 'R':
+				rand_tb_flg = true;
+				break;
+			case 'r':
+				rev_flg = true;
+				break;
+			case 'f':
+				opt_fm = atoi(optarg);
+				part_opt_flg = true;
+				break;
+			case 't':
+				opt_to = atoi(optarg);
+				part_opt_flg = true;
+				break;
+			case 'S':
+				rand_seed = strtoul(optarg, NULL, 10);
+				if(rand_seed == 0){
+					cerr << "The --seed value must be a positive integer." << endl;
+					exit(1);
+				}
+				break;
+			case 'T':
+				n_threads = atoi(optarg);
+				if(n_threads < 1){
+					cerr << "The --threads value must be 1 or more." << endl;
+					exit(1);
+				}
+				break;
+			case 's':
+				stats_flg = true;
+				break;
+			case 'V':
+				verify_flg = true;
+				break;
+			case 'v':
+				verify_flg = true;
+				verify_sample = atol(optarg);
+				if(verify_sample < 0){
+					cerr << "The --verify-sample value must be 0 (all cells) or more." << endl;
+					exit(1);
+				}
+				break;
+			case 'p':
+				span = parse_span_profile(optarg);
+				break;
+			case 'z':
+				compress_flg = true;
+				break;
+			case 'Q':
+				serve_flg = true;
+				break;
+			case 'O':
+				results_file = optarg;
+				break;
+			case 'X':
+				export_file = optarg;
+				break;
+			case 'H':
+				cost_file = optarg;
+				break;
+			case 'C':
+				codon_cost_file = optarg;
+				break;
+			case 'B':
+				motif_file = optarg;
+				break;
+			case 'G':
+				regions_spec = optarg;
+				break;
+			case 'F':
+				o.refold = true;
+				break;
+			case 'I':
+				pipeline_flg = true;
+				break;
+			case 'K':
+				metrics_socket = optarg;
+				break;
+			case 'N':
+				o.mfe_only = true;
+				break;
+			case 'U':
+				spool_in = optarg;
+				break;
+			case 'o':
+				spool_out = optarg;
+				break;
+			case 'L':
+				lambda = atof(optarg);
+				if(lambda < 0){
+					cerr << "The --lambda value must be 0 or more." << endl;
+					exit(1);
+				}
+				break;
+			case 'P':
+				profile_w = atoi(optarg);
+				if(profile_w < 10){
+					cerr << "The --profile-window value must be 10 or more." << endl;
+					exit(1);
+				}
+				break;
 
-			if(optseq[i] == 'V' || optseq[i] == 'W'){
-				optseq[i] = 'U';
-			}
-			else if(optseq[i] == 'X' || optseq[i] == 'Y'){
-				optseq[i] = 'G';
 			}
 		}
+	}
+	//exit(0);
 
 
-		//2次構造情報の表示
-		string optstr;
-		optstr.resize(nuclen+1, '.');
-		optstr[0] = ' ';
-		for(int i = 1; i <= base_pair[0].i; i++){
-			optstr[base_pair[i].i] = '(';
-			optstr[base_pair[i].j] = ')';
+	// -R option compatibility check (optimized with early return)
+	if(rand_tb_flg && (W != 0 || auto_w || !span.empty() || !exc.empty() || m_disp || rev_flg || part_opt_flg || !codon_cost_file.empty() || !motif_file.empty() || !regions_spec.empty())) {
+		cerr << "The -R option must not be used together with other options." << endl;
+		return 1; // Return error code instead of 0
+	}
+
+#ifdef CDSFOLD_MPI
+	if(mpi_size > 1 && (rand_tb_flg || compress_flg || verify_flg || serve_flg || pipeline_flg || !export_file.empty() || !cost_file.empty() || o.mfe_only || !spool_in.empty())){
+		if(mpi_rank == 0)
+			cerr << "-R, --compress, --verify, --serve, --spool, --pipeline, --export-matrices, --cost-map and --mfe-only are not supported with more than one MPI rank." << endl;
+		MPI_Finalize();
+		return 1;
+	}
+#endif
+
+	// CPUs and memory granted by the cgroup/affinity mask, not the host's
+	ResourceLimits &limits = o.limits;
+	limits.detect();
+
+#ifdef _OPENMP
+	if(n_threads > 0){
+		omp_set_num_threads(n_threads);
+	}
+	else if(getenv("OMP_NUM_THREADS") == NULL){
+		omp_set_num_threads(limits.threads());
+	}
+#else
+	if(n_threads > 1){
+		cerr << "Built without OpenMP: --threads is ignored." << endl;
+	}
+#endif
+
+	ResultWriter results;
+#ifdef CDSFOLD_MPI
+	if(mpi_rank > 0)
+		results_file.clear();
+#endif
+	if(!results_file.empty()){
+		if(!results.open(results_file)){
+			cerr << "Cannot write the results file " << results_file << endl;
+			exit(1);
 		}
+		o.results = &results;
+	}
+	// a results file that could not be completed fails the run
+	auto close_results = [&](int status){
+		if(o.results && !results.close()){
+			cerr << "Cannot write the results file " << results_file << endl;
+			return 1;
+		}
+		return status;
+	};
 
-		//show original amino acids
-		for(int i = 0; i < aalen; i++){
-			cout << aaseq[i] << "  ";
+	codon_costs costs;
+	if(!codon_cost_file.empty()){
+		if(rev_flg || verify_flg){
+			cerr << "--codon-cost cannot be combined with -r or --verify." << endl;
+			exit(1);
 		}
-		cout << endl;
-		//check amino acids of desinged DNA
-		int j = 0;
-		for(unsigned int i = 1; i < optseq.size(); i = i+3){
-			char aa = codon_table.c2a(n2i[optseq[i]], n2i[optseq[i+1]], n2i[optseq[i+2]]);
-			cout << aa << "  ";
-			if(aaseq[j] != aa){
-				cerr << j+1 << "-th amino acid differs:" << aaseq[j] << ":" << aa << endl;
-			}
-			j++;
+		string err = costs.load(codon_cost_file);
+		if(!err.empty()){
+			cerr << err << endl;
+			exit(1);
 		}
-		cout << endl;
-		//最適塩基と2次構造の表示
-		string optseq_disp = optseq;
-		optseq_disp.erase(0, 1);
-		optstr.erase(0, 1);
-		cout << optseq_disp << endl;
-		cout << optstr << endl;
-		cout << "MFE:" << float(MFE)/100 << " kcal/mol" << endl;
-
-
-		if(part_opt_flg == 1){
-			//部分アミノ酸配列の作成
-			for(int I = 0; I< n_inter; I++){
-				int aa_fm = (ofm[I]-1)/3 + 1; // 1-based
-				int aa_to = oto[I]/3; // 1-based
-				int part_aalen = aa_to - aa_fm + 1;
-
-				char part_aaseq[part_aalen];
-				part_aaseq[part_aalen] = '\0';
-				int j = 0;
-				for(int i = aa_fm; i <= aa_to; i++){
-					part_aaseq[j++] = aaseq[i-1]; // convert to 0-based
-				}
+		costs.lambda = lambda;
+		o.codon_cost = &costs;
+	}
 
-				cout << aa_fm << ":" << aa_to << endl;
-				cout << part_aalen << endl;
-				cout << part_aaseq << endl;
+	if(!regions_spec.empty()){
+		if(rev_flg || part_opt_flg || verify_flg){
+			cerr << "--regions cannot be combined with -r, -f/-t or --verify." << endl;
+			exit(1);
+		}
+		string err = parse_regions(regions_spec, o.regions);
+		if(!err.empty()){
+			cerr << err << endl;
+			exit(1);
+		}
+	}
+	if(o.refold && o.regions.empty()){
+		cerr << "--refold needs --regions." << endl;
+		exit(1);
+	}
 
+	// the memory budget picks one window, the profile sets its own band
+	if(auto_w && !span.empty()){
+		cerr << "-w auto cannot be combined with --span." << endl;
+		exit(1);
+	}
 
-				string part_optseq = rev_fold_step1(part_aaseq, part_aalen, codon_table, exc);
-				rev_fold_step2(&part_optseq, part_aaseq, part_aalen, codon_table, exc);
-				// combine optseq_rev and optseq
-				j = 1;
-				for(int i = ofm[I]; i <= oto[I]; i++){
-					optseq[i] = part_optseq[j++];
-				}
-			}
-			fixed_fold(optseq, indx, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table);
-			//fixed_fold(optseq, indx, w_tmp, predefHPN_E, BP_pair, P, aaseq, codon_table);
+	// the codon and region terms only come off in the traceback
+	if(o.mfe_only && (rand_tb_flg || rev_flg || part_opt_flg || verify_flg || compress_flg || profile_w || o.codon_cost || !o.regions.empty())){
+		cerr << "--mfe-only cannot be combined with -R, -r, -f/-t, --verify, --compress, --profile-window, --codon-cost or --regions." << endl;
+		exit(1);
+	}
+
+	motif_automaton motifs;
+	if(!motif_file.empty()){
+		if(rev_flg){
+			cerr << "--forbid-motifs cannot be combined with -r." << endl;
+			exit(1);
+		}
+		string err = motifs.load(motif_file);
+		if(!err.empty()){
+			cerr << err << endl;
+			exit(1);
 		}
+		if(!motifs.empty())
+			o.motifs = &motifs;
+	}
 
-		if(m_disp){
-			// get process ID
-
-			pid_t pid = getpid();
-			stringstream ss;
-			ss << "/proc/" << pid << "/status";
-			int m = getMemoryUsage(ss.str());
-			if(m == -1){
-				cerr << "Cannot get memory usage information from " << ss.str() << endl;
-			}
-			else{
-				cout << "Memory(VmRSS): "  << float(m)/1024 << " Mb" << endl;
-			}
+	if(!export_file.empty()){
+		if(rev_flg && !part_opt_flg){
+			cerr << "--export-matrices needs the DP fill, which -r without -f/-t does not run." << endl;
+			exit(1);
+		}
+		o.export_fp = fopen(export_file.c_str(), "wb");
+		if(!o.export_fp){
+			cerr << "Cannot write the matrix file " << export_file << endl;
+			exit(1);
 		}
+	}
 
-		free_arrays(nuclen, indx, w_tmp, pos2nuc, &C, &M, &F, &DMl, &DMl1, &DMl2, &chkC, &chkM, &base_pair);
-		if(rand_tb_flg)
-			free_F2(nuclen, indx, w_tmp, pos2nuc, &F2);
+	if(!cost_file.empty()){
+		if(rev_flg && !part_opt_flg){
+			cerr << "--cost-map needs the DP fill, which -r without -f/-t does not run." << endl;
+			exit(1);
+		}
+		o.cost_fp = fopen(cost_file.c_str(), "w");
+		if(!o.cost_fp){
+			cerr << "Cannot write the cost map " << cost_file << endl;
+			exit(1);
+		}
+		cost_map::write_header(o.cost_fp);
+	}
 
-		free(P);
+	if(pipeline_flg && (rand_tb_flg || (rev_flg && !part_opt_flg) || serve_flg)){
+		cerr << "--pipeline cannot be combined with -R, -r without -f/-t or --serve." << endl;
+		exit(1);
+	}
+
+	if(spool_in.empty() != spool_out.empty()){
+		cerr << "--spool and --out must be used together." << endl;
+		exit(1);
+	}
+	if(!spool_in.empty() && (serve_flg || pipeline_flg)){
+		cerr << "--spool cannot be combined with --serve or --pipeline." << endl;
+		exit(1);
+	}
 
+	if(!metrics_socket.empty() && !serve_flg && spool_in.empty()){
+		cerr << "--metrics-socket needs --serve or --spool." << endl;
+		exit(1);
+	}
+
+	if(serve_flg)
+		return close_results(serve(o, metrics_socket));
+	if(!spool_in.empty())
+		return close_results(spool(o, spool_in, spool_out, metrics_socket));
+
+	fasta all_aaseq(argv[optind]); // get all sequences
+
+	cout << "W = " << W << endl;
+	cout << "e = " << exc << endl;
+	if(pipeline_flg){
+#ifdef _OPENMP
+		const int n_threads = omp_get_max_threads();
+#endif
+		// prepare of the next record, fill of this one, finish of the previous one
+		record_pipeline pipe(3);
+		do {
+			const char *desc = all_aaseq.getDesc();
+			char *seq = all_aaseq.getSeq();
+			const int len = all_aaseq.getSeqLen();
+			pipe.submit([&, desc, seq, len](record_pipeline::ticket &t){
+#ifdef _OPENMP
+				omp_set_num_threads(n_threads);
+#endif
+				design_options ro = o; // W and -f/-t are adjusted per record
+				design_record(ro, desc, seq, len, nullptr, &t);
+			});
+		} while (all_aaseq.next());
+		pipe.wait();
+		if(stats_flg)
+			pipe.report(cerr);
+	}
+	else
+	do {
+		if(!design_record(o, all_aaseq.getDesc(), all_aaseq.getSeq(), all_aaseq.getSeqLen(), nullptr))
+			break; //returnすると、実行時間が表示されなくなるためbreakすること。
 	} while (all_aaseq.next());
 
 	clock_t end = clock();
@@ -1159,6 +1378,16 @@ int main(int argc, char *argv[]) {
 
 	//	printf("Memory usage: %ld Mb\n", r.ru_maxrss/1024);
 
-	return 0;
+	if(o.export_fp)
+		fclose(o.export_fp);
+	if(o.cost_fp)
+		fclose(o.cost_fp);
+	const int status = close_results(0);
+
+#ifdef CDSFOLD_MPI
+	MPI_Finalize();
+#endif
+	return status;
 
 }
+#endif
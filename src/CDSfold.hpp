@@ -2,6 +2,7 @@
 #include <algorithm>  // For std::fill_n and other optimizations
 #include <fstream>
 #include <array>      // Modern C++ arrays
+#include <functional>
 //#include <iostream>
 //#include <stdlib.h>
 //#include <codon.hpp>
@@ -26,6 +27,19 @@ typedef struct bond {
 
 inline int TermAU(int const &type, paramT * const &P);
 
+// Band of the stored pairs, set by set_ij_indx() next to indx: (i,j) is
+// stored when band_lo[j] <= i, and band_hi[i] is the last j stored for i.
+// band_lo is nondecreasing, so every interval nested in a stored pair is
+// stored too.
+
+// One entry of a --span profile: positions fm..to (nucleotides) may pair
+// at most w bases apart, 0 means no limit.
+struct span_range {
+	int fm;
+	int to;
+	int w;
+};
+
 // Optimized matrix size calculation using mathematical formula
 [[gnu::hot]] [[gnu::const]]
 constexpr int getMatrixSize_impl(const int len, const int w) noexcept {
@@ -35,19 +49,63 @@ constexpr int getMatrixSize_impl(const int len, const int w) noexcept {
 		(len * (len + 1)) / 2;         // When w >= len, use triangular number
 }
 
+// Band layout. By default the band is stored column by column and
+// set_ij_indx() folds the offset of column j into indx[j]. With
+// CDSFOLD_DIAG_MAJOR it is stored diagonal by diagonal (d = j - i, then i):
+// the diagonal being filled and the shorter ones the loops read are each
+// contiguous, and indx only holds n (indx[0]) and the widest column w
+// (indx[1]). Diagonal d starts after d*n - d*(d-1)/2 slots.
+
+// Number of cells in the band set by set_ij_indx()
+inline int getBandSize(const int len, const int* indx) noexcept {
+#ifdef CDSFOLD_DIAG_MAJOR
+	const int w = indx[1];
+	return w * len - w * (w - 1) / 2;
+#else
+	return indx[len] + len;
+#endif
+}
+
 // Wrapper function that can print (not constexpr due to cout)
-inline int getMatrixSize(const int len, const int w) noexcept {
-	const int size = getMatrixSize_impl(len, w);
+inline int getMatrixSize(const int len, const int* indx) noexcept {
+	const int size = getBandSize(len, indx);
 	cout << "The size of matrix is " << size << endl;
 	return size;
 }
 
-// Optimized inline function with better performance characteristics
+// w is only kept for the existing call sites; the band is in indx.
 [[gnu::hot]] [[gnu::flatten]]
 constexpr inline int getIndx(const int i, const int j, const int w, const int* __restrict__ indx) noexcept {
-	// Compiler can optimize this better with restrict and constexpr
-	const int unused_elements = j - w;
-	return indx[j] + i - (unused_elements > 0 ? unused_elements : 0);
+	(void)w;
+#ifdef CDSFOLD_DIAG_MAJOR
+	const int d = j - i;
+	return d * indx[0] - d * (d - 1) / 2 + i;
+#else
+	return indx[j] + i;
+#endif
+}
+
+// (i,j) of band cell ij, the inverse of getIndx().
+inline void band_cell(const int *indx, const int n, const int ij, int &i, int &j){
+#ifdef CDSFOLD_DIAG_MAJOR
+	int lo = 0, hi = indx[1] - 1;
+	while(lo < hi){ // last d with getIndx(1, 1 + d) <= ij
+		int mid = (lo + hi + 1) / 2;
+		if(getIndx(1, 1 + mid, 0, indx) <= ij) lo = mid;
+		else hi = mid - 1;
+	}
+	i = ij - getIndx(1, 1 + lo, 0, indx) + 1;
+	j = i + lo;
+#else
+	int lo = 1, hi = n;
+	while(lo < hi){ // first j with indx[j] + j >= ij
+		int mid = (lo + hi) / 2;
+		if(indx[mid] + mid >= ij) hi = mid;
+		else lo = mid + 1;
+	}
+	j = lo;
+	i = ij - indx[j];
+#endif
 }
 
 // Optimized memory clearing with better cache performance
@@ -63,9 +121,13 @@ inline void clear_sec_bp(stack* __restrict__ s, bond* __restrict__ b, const int
 }
 
 
-void allocate_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int ****c, int ****m, int ****f, int ****dml, int ****dml1, int ****dml2, int **chkc, int **chkm, bond **b)
+// With lazy_c, C blocks of length 5 or more are left to alloc_C_diagonal().
+// keep(i, j), when set, selects the blocks of cell (i,j) to allocate
+// (1: C, 2: M); MPI ranks hold only their rows and the cells they receive.
+void allocate_arrays(int len, int *indx, const vector<int> &band_hi, int w, vector <vector<int> > &pos2nuc, int ****c, int ****m, int ****f, int ****dml, int ****dml1, int ****dml2, int **chkc, int **chkm, bond **b, bool lazy_c = false,
+		const function<int(int, int)> &keep = nullptr)
 {
-	int size = getMatrixSize(len, w);
+	int size = getMatrixSize(len, indx);
 //	int n_elm = 0;
 	int total_bytes = 0;
 	//int test_bytes = 0;
@@ -77,7 +139,7 @@ void allocate_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc,
 //	*f2   = new int**[size+1];
 	// Optimized nested loops with better cache locality and prefetching hints
 	for(int i = 1; i <= len; ++i){  // Prefer prefix increment
-		const int max_j = MIN2(len, i + w - 1);
+		const int max_j = band_hi[i];
 		const auto& pos2nuc_i = pos2nuc[i];  // Cache reference to avoid repeated lookup
 		const size_t pos_i_size = pos2nuc_i.size();
 
@@ -87,15 +149,20 @@ void allocate_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc,
 			const size_t pos_j_size = pos2nuc_j.size();
 
 			// Allocate memory with better alignment hints
-			(*c)[ij] = new int*[pos_i_size];
-			(*m)[ij] = new int*[pos_i_size];
+			const int kept = keep ? keep(i, j) : 3;
+			const bool alloc_c = (!lazy_c || j - i + 1 <= 4) && (kept & 1);
+			const bool alloc_m = kept & 2;
+			(*c)[ij] = alloc_c ? new int*[pos_i_size] : nullptr;
+			(*m)[ij] = alloc_m ? new int*[pos_i_size] : nullptr;
 
 			total_bytes += sizeof(int*) * (pos_i_size + 4) * 2;
 
 			// Optimize inner loop with cached sizes
 			for(size_t L = 0; L < pos_i_size; ++L){
-				(*c)[ij][L] = new int[pos_j_size];
-				(*m)[ij][L] = new int[pos_j_size];
+				if(alloc_c)
+					(*c)[ij][L] = new int[pos_j_size];
+				if(alloc_m)
+					(*m)[ij][L] = new int[pos_j_size];
 				total_bytes += sizeof(int) * (pos_j_size + 4) * 2;
 			}
 		}
@@ -144,8 +211,8 @@ void allocate_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc,
 	*chkc   = new int[size+1];
 	*chkm   = new int[size+1];
 
-	fill(*chkc, *chkc+size, INF);
-	fill(*chkm, *chkm+size, INF);
+	fill(*chkc, *chkc+size+1, INF);
+	fill(*chkm, *chkm+size+1, INF);
 
 	*b      = new bond[len/2];
 
@@ -154,12 +221,12 @@ void allocate_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc,
 
 }
 
-void allocate_F2(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int ****f2)
+void allocate_F2(int len, int *indx, const vector<int> &band_hi, int w, vector <vector<int> > &pos2nuc, int ****f2)
 {
-	int size = getMatrixSize(len, w);
+	int size = getMatrixSize(len, indx);
 	*f2   = new int**[size+1];
 	for(int i = 1; i <= len; i++){
-		for(int j = i; j <= MIN2(len, i+w-1); j++){
+		for(int j = i; j <= band_hi[i]; j++){
 			int ij = getIndx(i,j,w,indx);
 			(*f2)[ij]   = new int*[pos2nuc[i].size()];
 			for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
@@ -170,15 +237,66 @@ void allocate_F2(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int
 }
 
 
-void free_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int ****c, int ****m, int ****f, int ****dml, int ****dml1, int ****dml2, int **chkc, int **chkm, bond **b)
+// heap footprint of new T[n] with glibc malloc (16-byte chunks, 32 minimum)
+constexpr long long heap_bytes(const long long n) noexcept {
+	return MAX2(32, (int)((n + 8 + 15) / 16 * 16));
+}
+
+// Resident bytes of C, M and chkC/chkM that allocate_arrays() needs for a
+// uniform window w (M only plus the packed C blocks with --compress).
+long long estimate_matrix_bytes(int len, int w, const vector <vector<int> > &pos2nuc, bool compress)
 {
+	long long cell[5][5] = {};
+	for(int L = 1; L <= 4; L++){
+		for(int R = 1; R <= 4; R++){
+			long long dense = heap_bytes(8 * L) + L * heap_bytes(4 * R);
+			cell[L][R] = (compress ? dense + 8 + 1 + L * R : 2 * dense) + 2 * 8 + 2 * 4;
+		}
+	}
+	// cnt[k][i]: positions <= i with k candidate nucleotides
+	vector<vector<int> > cnt(5, vector<int>(len + 1, 0));
 	for(int i = 1; i <= len; i++){
-		for(int j = i; j <= MIN2(len, i+w-1); j++){
+		for(int k = 1; k <= 4; k++)
+			cnt[k][i] = cnt[k][i - 1];
+		cnt[pos2nuc[i].size()][i]++;
+	}
+	long long total = 0;
+	for(int j = 1; j <= len; j++){
+		int lo = MAX2(1, j - w + 1);
+		int nR = pos2nuc[j].size();
+		for(int k = 1; k <= 4; k++)
+			total += (long long)(cnt[k][j] - cnt[k][lo - 1]) * cell[k][nR];
+	}
+	return total;
+}
+
+// Largest window whose matrices fit into `budget` bytes (at least 10).
+int auto_window(int len, long long budget, const vector <vector<int> > &pos2nuc, bool compress)
+{
+	if(budget <= 0 || estimate_matrix_bytes(len, len, pos2nuc, compress) <= budget)
+		return len;
+	int lo = 10, hi = len;
+	while(lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if(estimate_matrix_bytes(len, mid, pos2nuc, compress) <= budget)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+void free_arrays(int len, int *indx, const vector<int> &band_hi, int w, vector <vector<int> > &pos2nuc, int ****c, int ****m, int ****f, int ****dml, int ****dml1, int ****dml2, int **chkc, int **chkm, bond **b)
+{
+	for(int i = 1; i <= len; i++){
+		for(int j = i; j <= band_hi[i]; j++){
 			//int ij = indx[j]+i;
 			int ij = getIndx(i,j,w,indx);
 			for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
-				delete [] (*c)[ij][L];
-				delete [] (*m)[ij][L];
+				if((*c)[ij]) // released by --compress, or not held by this MPI rank
+					delete [] (*c)[ij][L];
+				if((*m)[ij])
+					delete [] (*m)[ij][L];
 			}
 			delete [] (*c)[ij];
 			delete [] (*m)[ij];
@@ -214,10 +332,10 @@ void free_arrays(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int
 
 }
 
-void free_F2(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int ****f2)
+void free_F2(int len, int *indx, const vector<int> &band_hi, int w, vector <vector<int> > &pos2nuc, int ****f2)
 {
 	for(int i = 1; i <= len; i++){
-		for(int j = i; j <= MIN2(len, i+w-1); j++){
+		for(int j = i; j <= band_hi[i]; j++){
 			//int ij = indx[j]+i;
 			int ij = getIndx(i,j,w,indx);
 			for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
@@ -231,32 +349,129 @@ void free_F2(int len, int *indx, int w, vector <vector<int> > &pos2nuc, int ****
 }
 
 
-void set_ij_indx(int *a, int length)
+// Column offsets of the band in band_lo: (i,j) is cell a[j] + i.
+void set_column_indx(int *a, const vector<int> &band_lo, int length)
 {
+	a[0] = 0;
+	int cum = 0;
 	for (int n = 1; n <= length; n++){
-		a[n] = (n*(n-1))/2;
+		a[n] = cum - band_lo[n] + 1;
+		cum += n - band_lo[n] + 1;
 	}
 }
 
+// Lays out the band in band_lo; see getIndx().
+void set_band_indx(int *a, const vector<int> &band_lo, vector<int> &band_hi, int length)
+{
+	band_hi.assign(length + 1, 0);
+	int w = 0;
+	for (int n = 1; n <= length; n++){
+		w = MAX2(w, n - band_lo[n] + 1);
+		for (int i = band_lo[n]; i <= n; i++){
+			band_hi[i] = n;
+		}
+	}
+#ifdef CDSFOLD_DIAG_MAJOR
+	fill(a, a + length + 1, 0);
+	a[0] = length;
+	a[1] = w;
+#else
+	(void)w;
+	set_column_indx(a, band_lo, length);
+#endif
+}
 
-void set_ij_indx(int *a, int length, int w)
+void set_ij_indx(int *a, vector<int> &band_lo, vector<int> &band_hi, int length)
+{
+	band_lo.assign(length + 1, 1);
+	set_band_indx(a, band_lo, band_hi, length);
+}
+
+
+void set_ij_indx(int *a, vector<int> &band_lo, vector<int> &band_hi, int length, int w)
 {
 	if(w <= 0){
 		cerr << "Invalid w:" << w << endl;
 		exit(1);
 	}
 	w = MIN2(length, w);
-	int cum = 0;
+	band_lo.assign(length + 1, 1);
+	for (int n = 1; n <= length; n++){
+		band_lo[n] = MAX2(1, n - w + 1);
+	}
+	set_band_indx(a, band_lo, band_hi, length);
+}
+
+// Position-dependent window: column j may pair back as far as the span of j
+// allows (w outside the profile). The band never moves back to the left, so a
+// wide range after a narrow one only widens as far as the narrow one allows.
+void set_ij_indx(int *a, vector<int> &band_lo, vector<int> &band_hi, int length, int w, const vector<span_range> &span)
+{
+	w = MIN2(length, w);
+	band_lo.assign(length + 1, 1);
 	for (int n = 1; n <= length; n++){
-		a[n] = cum;
-		//cout << n << ":" << a[n] << endl;
-		if(n < w){
-			cum += n;
+		int wn = w;
+		for (const span_range &r : span){
+			if(r.fm <= n && n <= r.to){
+				wn = (r.w == 0) ? length : r.w;
+			}
 		}
-		else{
-			cum += w;
+		band_lo[n] = MAX2(band_lo[n - 1], n - wn + 1);
+	}
+	set_band_indx(a, band_lo, band_hi, length);
+}
+
+// Widest column of the band (the longest pair span that is stored).
+int band_width(const vector<int> &band_lo, int length)
+{
+	int w = 0;
+	for (int n = 1; n <= length; n++){
+		w = MAX2(w, n - band_lo[n] + 1);
+	}
+	return w;
+}
+
+// Parses a --span profile like "1-150:0,151-:60" (nucleotide positions,
+// later ranges override earlier ones, span 0 means no limit) into v.
+// Returns the error message, empty when the profile is valid.
+string parse_span_profile(const string &s, vector<span_range> &v)
+{
+	v.clear();
+	stringstream ss(s);
+	string item;
+	while(getline(ss, item, ',')){
+		span_range r;
+		size_t colon = item.find(':');
+		size_t dash = item.find('-');
+		if(colon == string::npos || dash == string::npos || dash > colon || dash == 0){
+			return "Invalid --span range: " + item + " (use from-to:span, e.g. 1-150:0,151-:60)";
+		}
+		r.fm = atoi(item.substr(0, dash).c_str());
+		r.to = (dash + 1 == colon) ? INT_MAX : atoi(item.substr(dash + 1, colon - dash - 1).c_str());
+		r.w = atoi(item.substr(colon + 1).c_str());
+		if(r.fm < 1 || r.to < r.fm){
+			return "Invalid --span range: " + item;
 		}
+		if(r.w != 0 && r.w < 10){
+			return "The --span value must be 0 or more than 10 (you used " + to_string(r.w) + ")";
+		}
+		v.push_back(r);
+	}
+	if(v.empty()){
+		return "The --span profile is empty.";
+	}
+	return "";
+}
+
+vector<span_range> parse_span_profile(const string &s)
+{
+	vector<span_range> v;
+	string err = parse_span_profile(s, v);
+	if(!err.empty()){
+		cerr << err << endl;
+		exit(1);
 	}
+	return v;
 }
 
 void set_arrays(int **a, int length)
@@ -461,9 +676,12 @@ vector<int> createNucConstraint(const char* s, int &len, map<char, int> &n2i){
 	return v;
 }
 
+// Seed used by InitRand() (--seed). 0 means seed from the clock.
+unsigned int rand_seed = 0;
+
 inline void InitRand()
 {
-    srand((unsigned int)time(NULL));
+    srand(rand_seed ? rand_seed : (unsigned int)time(NULL));
 }
 
 void shuffleStr(vector<string> (*ary),int size)
@@ -502,12 +720,13 @@ vector <pair<int, int> > shufflePair(vector<pair<int, int> > ary, int size)
 
 
 
-void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c, int ***const &m, int*** const &f,
-			int *const indx, const int &initL, const int &initR, paramT *const&P, const vector<int> &NucConst,
+void backtrack(string *optseq, stack *sector, bond *base_pair, const cell_view &c, const cell_view &m, int*** const &f,
+			int *const indx, const vector<int> &band_lo, const int &initL, const int &initR, paramT *const&P, const vector<int> &NucConst,
 			const vector<vector <int> > &pos2nuc, const int &NCflg, int *const &i2r, int const &length, int const &w,
 			int const (&BP_pair)[5][5], char * const &i2n, int * const &rtype, int *const &ii2r,
 			vector<vector<int> > &Dep1, vector<vector<int> > &Dep2, int &DEPflg,
-			vector<vector<vector<vector<pair<int, string> > > > > &predefH, map<string, int> &predefE, vector<vector<vector<string> > > &substr, map<char, int> &n2i, const char* nucdef){
+			vector<vector<vector<vector<pair<int, string> > > > > &predefH, map<string, int> &predefE, vector<vector<vector<string> > > &substr, map<char, int> &n2i, const char* nucdef,
+			const vector<array<int, 9> > &nuc_cost, const vector<array<int, 9> > &loop_cost){
 
 	int s = 0;
 	int b = 0;
@@ -563,6 +782,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 
 		    //	    	fi  = (ml == 1)? m[indx[j-1]+i][Li][Rj1] + P->MLbase: f[j-1][Li][Rj1];
 		    fi  = (ml == 1)? m[getIndx(i,j-1,w,indx)][Li][Rj1] + P->MLbase: f[j-1][Li][Rj1];
+		    fi += nuc_row(loop_cost, j)[Rj_nuc];
 
 	        if (fij == fi) {  /* 3' end is unpaired */
 	          sector[++s].i = i;
@@ -583,7 +803,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 	    	}
 
 	    	//f[j]とC[1][j]が一致している時の処理。Vieenaでは、次for文に統合されている。
-	    	if(type_LiRj && j <= w){
+	    	if(type_LiRj && band_lo[j] == 1){
 	    		// note i == 1
 	    		//int en_c = TermAU(type_LiRj, P) +  c[indx[j]+i][Li][Rj];
 	    		int en_c = TermAU(type_LiRj, P) +  c[getIndx(i,j,w,indx)][Li][Rj];
@@ -597,7 +817,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 	    	}
 
 	    	//for(k=j-TURN-1,traced=0; k>=1; k--){
-	    	for(k=j-TURN-1,traced=0; k>=MAX2(2,j-w+1); k--){
+	    	for(k=j-TURN-1,traced=0; k>=MAX2(2,band_lo[j]); k--){
 
 	    		for(unsigned int Rk1 = 0; Rk1 < pos2nuc[k-1].size(); Rk1++){
 	    	    	int Rk1_nuc = pos2nuc[k-1][Rk1];
@@ -659,7 +879,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
     		    if(DEPflg && Dep1[ii2r[Li_nuc*10+Li1_nuc]][i] == 0){ continue;} // dependency between k-1 and k
 
     		    //	  	if (m[indx[j]+i+1][Li1][Rj]+P->MLbase == fij) { /* 5' end is unpaired */
-    		    if (m[getIndx(i+1,j,w,indx)][Li1][Rj]+P->MLbase == fij) { /* 5' end is unpaired */
+    		    if (m[getIndx(i+1,j,w,indx)][Li1][Rj]+P->MLbase + nuc_row(loop_cost, i)[Li_nuc] == fij) { /* 5' end is unpaired */
 	    			sector[++s].i = i+1;
 	    			sector[s].j   = j;
 	    			sector[s].Li  = Li1;
@@ -718,7 +938,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 	    repeat1: // いちいちスタックに積まずに、ここで部分的なトレースバックをしてしまう。
 	    //continue;
 	    /*----- begin of "repeat:" -----*/
-	    if(j - i + 1 > w){
+	    if(i < band_lo[j]){
 	    	cerr << "backtrack failed at " << i << "," << j << " : the length must at most << w << endl";
 	    }
 	    //	    ij = indx[j]+i; // ここでは元々のi,jから変換していることに注意。jは更新されないこともある[1]
@@ -726,7 +946,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 	    Li_nuc = pos2nuc[i][Li]; // Liは更新されている。
 	    Rj_nuc = pos2nuc[j][Rj]; //Rj_nucは更新されていない場合もある[1]。
 	    type_LiRj = BP_pair[i2r[Li_nuc]][i2r[Rj_nuc]];
-	    cij = c[ij][Li][Rj];
+	    cij = c[ij][Li][Rj] - pair_cost(nuc_cost, i, Li_nuc, j, Rj_nuc); // without the codon costs of i, j
 		(*optseq)[i] = i2n[Li_nuc]; //塩基対部分を記録
 		(*optseq)[j] = i2n[Rj_nuc];
 
@@ -764,9 +984,14 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 				if(DEPflg && Li_nuc > 4 && Dep1[ii2r[Li_nuc*10+hL2_nuc]][i] == 0){continue;} // Dependency is already checked.
 				if(DEPflg && Rj_nuc > 4 && Dep1[ii2r[hR2_nuc*10+Rj_nuc]][j-1] == 0){continue;}// ただし、Li_nuc、Rj_nucがVWXYのときだけは、一つ内側との依存関係をチェックする必要がある。
 
+				int hpn_cost = 0; // codon costs of the loop
+				if(!loop_cost.empty())
+					for(int k = 1; k < l - 1; k++)
+						hpn_cost += loop_cost[i + k][n2i[hpn[k]]];
+
 				// predefinedなヘアピンとの比較
 				if(predefE.count(hpn) > 0){
-					if(c[ij][Li][Rj] == predefE[hpn]){
+					if(cij == predefE[hpn] + hpn_cost){
 						cout << "Predefined Hairpin at " << i << "," << j << endl;
 						for(unsigned int k = 0; k < hpn.size(); k++){
 							(*optseq)[i+k] = hpn[k]; //塩基を記録
@@ -783,7 +1008,7 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 												i2r[hL2_nuc], i2r[hR2_nuc],
 												"NNNNNNNNN", P);
 
-					if(c[ij][Li][Rj] == energy){
+					if(cij == energy + hpn_cost){
 						for(unsigned int k = 0; k < hpn.size(); k++){
 							(*optseq)[i+k] = hpn[k]; //塩基を記録
 						}
@@ -806,7 +1031,8 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 					if(DEPflg && Dep1[ii2r[Rj1_nuc*10+Rj_nuc]][j-1] == 0){ continue;} // dependency between j-1 and j
 
 					//if (cij == HairpinE(j-i-1, type_LiRj, i2r[Li1_nuc], i2r[Rj1_nuc], "NNNNNNNNN")){
-					if (cij == E_hairpin(j-i-1, type_LiRj, i2r[Li1_nuc], i2r[Rj1_nuc], "NNNNNNNNN", P)){
+					if (cij == E_hairpin(j-i-1, type_LiRj, i2r[Li1_nuc], i2r[Rj1_nuc], "NNNNNNNNN", P)
+							+ nuc_row(loop_cost, i+1)[Li1_nuc] + nuc_row(loop_cost, j-1)[Rj1_nuc]){
 						(*optseq)[i+1] = i2n[Li1_nuc]; //塩基対の内側のミスマッチ塩基を記録
 						(*optseq)[j-1] = i2n[Rj1_nuc];
 						goto OUTLOOP;
@@ -881,6 +1107,11 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 
 								    	//	int energy_new = energy+c[indx[q]+p][Lp][Rq];
 								    	int energy_new = energy+c[getIndx(p,q,w,indx)][Lp][Rq];
+								    	// codon costs of the unpaired mismatches
+								    	if(p > i+1) energy_new += nuc_row(loop_cost, i+1)[Li1_nuc];
+								    	if(p > i+2) energy_new += nuc_row(loop_cost, p-1)[Lp1_nuc];
+								    	if(q < j-1) energy_new += nuc_row(loop_cost, j-1)[Rj1_nuc];
+								    	if(q < j-2) energy_new += nuc_row(loop_cost, q+1)[Rq1_nuc];
 								    	traced = (cij == energy_new);
 								    	if (traced) {
 								    		base_pair[++b].i = p;
@@ -983,8 +1214,8 @@ void backtrack(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 
 }
 
-void backtrack2(string *optseq, stack *sector, bond *base_pair, int ***const &c, int ***const &m, int*** const &f2,
-			int *const indx, const int &initL, const int &initR, paramT *const&P, const vector<int> &NucConst,
+void backtrack2(string *optseq, stack *sector, bond *base_pair, const cell_view &c, const cell_view &m, int*** const &f2,
+			int *const indx, const vector<int> &band_lo, const int &initL, const int &initR, paramT *const&P, const vector<int> &NucConst,
 			const vector<vector <int> > &pos2nuc, const int &NCflg, int *const &i2r, int const &length, int const &w,
 			int const (&BP_pair)[5][5], char * const &i2n, int * const &rtype, int *const &ii2r,
 			vector<vector<int> > &Dep1, vector<vector<int> > &Dep2, int &DEPflg,
@@ -1127,7 +1358,7 @@ void backtrack2(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 
 	    		F3:
 	    		// trace i,j from C(i,j)
-	    		if(type_LiRj && j - i + 1 <= w){
+	    		if(type_LiRj && i >= band_lo[j]){
 	    			int en_c = TermAU(type_LiRj, P) +  c[getIndx(i,j,w,indx)][Li][Rj];
 	    			int en_f = f2[ij][Li][Rj];
 	    			cout << en_c << "," << en_f << endl;
@@ -1275,7 +1506,7 @@ void backtrack2(string *optseq, stack *sector, bond *base_pair, int ***const &c,
 	    repeat1: // いちいちスタックに積まずに、ここで部分的なトレースバックをしてしまう。
 	    //continue;
 	    /*----- begin of "repeat:" -----*/
-	    if(j - i + 1 > w){
+	    if(i < band_lo[j]){
 	    	cerr << "backtrack failed at " << i << "," << j << " : the length must at most << w << endl";
 	    }
 	    //	    ij = indx[j]+i; // ここでは元々のi,jから変換していることに注意。jは更新されないこともある[1]
@@ -1743,7 +1974,7 @@ void fixed_init_matrix(const int &nuclen, const int &size, int *C, int *M, int *
 }
 
 void fixed_backtrack(string optseq, bond *base_pair, int *c, int *m, int *f,
-		int *indx, paramT *P, int nuclen, int w, const int (&BP_pair)[5][5], map<string, int> predefE){
+		int *indx, const vector<int> &band_lo, paramT *P, int nuclen, int w, const int (&BP_pair)[5][5], map<string, int> predefE){
 	int rtype[7] = { 0, 2, 1, 4, 3, 6, 5 };
 	int s = 0;
 	int b = 0;
@@ -1798,7 +2029,7 @@ void fixed_backtrack(string optseq, bond *base_pair, int *c, int *m, int *f,
 	    	}
 
 	    	//f[j]とC[1][j]が一致している時の処理。Vieenaでは、次for文に統合されている。
-	    	if(type && j <= w){
+	    	if(type && band_lo[j] == 1){
 	    		int en_c = TermAU(type, P) +  c[getIndx(i,j,w,indx)];
                 int en_f = f[j];
               	if(en_c ==  en_f){
@@ -1808,7 +2039,7 @@ void fixed_backtrack(string optseq, bond *base_pair, int *c, int *m, int *f,
               	}
 	    	}
 
-	    	for(k=j-TURN-1,traced=0; k>=MAX2(2,j-w+1); k--){
+	    	for(k=j-TURN-1,traced=0; k>=MAX2(2,band_lo[j]); k--){
 
 	    		int type_kj = BP_pair[ioptseq[k]][ioptseq[j]];
 	    		if(type_kj){
@@ -1880,7 +2111,7 @@ void fixed_backtrack(string optseq, bond *base_pair, int *c, int *m, int *f,
 	    repeat1: // いちいちスタックに積まずに、ここで部分的なトレースバックをしてしまう。
 	    //continue;
 	    /*----- begin of "repeat:" -----*/
-	    if(j - i + 1 > w){
+	    if(i < band_lo[j]){
 	    	cerr << "backtrack failed at " << i << "," << j << " : the length must at most << w << endl";
 	    }
 	    ij = getIndx(i,j,w,indx); // ここでは元々のi,jから変換していることに注意。jは更新されないこともある[1]
@@ -1978,27 +2209,14 @@ void fixed_backtrack(string optseq, bond *base_pair, int *c, int *m, int *f,
 
 }
 
-void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predefE,
-		const int (&BP_pair)[5][5], paramT *P, char *aaseq, codon codon_table){
+// Fills C and M of a fixed sequence within the band set by set_ij_indx().
+void fixed_fill_CM(const string &optseq, const int *ioptseq, int *indx, const vector<int> &band_lo, const int &w, const int &size,
+		map<string, int> &predefE, const int (&BP_pair)[5][5], paramT *P, int *C, int *M){
 	int nuclen = optseq.size() - 1;
-	int aalen = (optseq.size() - 1)/3;
-	int size = getMatrixSize(nuclen, w);
-	int C[size];
-	int M[size];
 	int F[nuclen+1];
 	int DMl[nuclen+1];
 	int DMl1[nuclen+1];
 	int DMl2[nuclen+1];
-	bond base_pair[nuclen/2];
-
-	map<char, int> n2i = make_n2i();
-	int ioptseq[nuclen+1];
-	ioptseq[0] = 0;
-	for(int i = 1; i <= nuclen; i++){
-		ioptseq[i] = n2i[optseq[i]];
-//		cout << optseq[i] << endl;
-	}
-//	exit(0);
 
 	fixed_init_matrix(nuclen, size, C, M, F, DMl, DMl1, DMl2);
 	int rtype[7] = { 0, 2, 1, 4, 3, 6, 5 };
@@ -2012,6 +2230,7 @@ void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predef
 		//	  for(int l = 5; l <= 5; l++){
 		for (int i = 1; i <= nuclen - l + 1; i++) {
 			int j = i + l - 1;
+			if(i < band_lo[j]) continue;
 			int ij = getIndx(i,j,w,indx);
 			C[ij] = INF;
 			M[ij] = INF;
@@ -2126,6 +2345,30 @@ void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predef
 		}
 	}
 
+}
+
+// res, when given, receives the design, its pairs and MFE (--results).
+void fixed_fold(string optseq, int *indx, const vector<int> &band_lo, const int &w, map<string, int> &predefE,
+		const int (&BP_pair)[5][5], paramT *P, char *aaseq, codon codon_table, design_result *res = NULL){
+	int nuclen = optseq.size() - 1;
+	int aalen = (optseq.size() - 1)/3;
+	int size = getMatrixSize(nuclen, indx);
+	int C[size + 1];
+	int M[size + 1];
+	int F[nuclen+1];
+	bond base_pair[nuclen/2];
+
+	map<char, int> n2i = make_n2i();
+	int ioptseq[nuclen+1];
+	ioptseq[0] = 0;
+	for(int i = 1; i <= nuclen; i++){
+		ioptseq[i] = n2i[optseq[i]];
+//		cout << optseq[i] << endl;
+	}
+//	exit(0);
+
+	fixed_fill_CM(optseq, ioptseq, indx, band_lo, w, size + 1, predefE, BP_pair, P, C, M);
+
 	// Fill F matrix
 	// Initialize F[1]
 	F[1] = 0;
@@ -2136,14 +2379,14 @@ void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predef
 			int au_penalty = 0;
 			if (type > 2)
 				au_penalty = P->TerminalAU;
-			if(j <= w)
+			if(band_lo[j] == 1)
 				F[j] = MIN2(F[j], C[getIndx(1,j,w,indx)] + au_penalty); // recc 1
 		}
 
 		// create F[j] from F[j-1]
 		F[j] = MIN2(F[j], F[j - 1]); // recc 2
 
-		for (int k = MAX2(2, j-w+1); k <= j - TURN - 1; k++) { // Is this correct?
+		for (int k = MAX2(2, band_lo[j]); k <= j - TURN - 1; k++) { // Is this correct?
 			int type_k =
 					BP_pair[ioptseq[k]][ioptseq[j]];
 
@@ -2164,7 +2407,7 @@ void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predef
 //		cout << "FMAT: " << i << " " << F[i] << "  " <<  w << endl;
 //	}
 	fixed_backtrack(optseq, base_pair, C, M, F,
-			indx, P, nuclen, w, BP_pair, predefE);
+			indx, band_lo, P, nuclen, w, BP_pair, predefE);
 //}
 
 //	cout << "end" << endl;
@@ -2190,6 +2433,8 @@ void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predef
 		cout << aa << "  ";
 		if(aaseq[j] != aa){
 			cerr << j+1 << "-th amino acid differs:" << aaseq[j] << ":" << aa << endl;
+			if(res)
+				res->flags |= RESULT_AA_DIFF;
 		}
 		j++;
 	}
@@ -2200,7 +2445,66 @@ void fixed_fold(string optseq, int *indx, const int &w, map<string, int> &predef
 	cout << optseq << endl;
 	cout << optstr << endl;
 	cout << "MFE:" << float(MFE)/100 << " kcal/mol" << endl;
+	if(res){
+		res->seq = optseq;
+		res->mfe = MFE;
+		for(int i = 1; i <= base_pair[0].i; i++)
+			res->pairs.push_back(make_pair(base_pair[i].i, base_pair[i].j));
+	}
 
 }
 
 
+
+// Local MFE of every window optseq[s..s+W-1] (--profile-window). C/M are
+// filled once with span <= W; only the exterior loop is redone per window,
+// so the whole profile is O(n*W^2). Returns mfe[s] for s = 1..n-W+1.
+vector<int> fixed_window_profile(const string &optseq, int W, map<string, int> &predefE,
+		const int (&BP_pair)[5][5], paramT *P){
+	int nuclen = optseq.size() - 1;
+	W = MIN2(W, nuclen);
+
+	// the profile has its own band
+	vector<int> windx(nuclen + 1), wlo, whi;
+	set_ij_indx(windx.data(), wlo, whi, nuclen, W);
+	int size = getBandSize(nuclen, windx.data());
+	vector<int> C(size + 1), M(size + 1);
+
+	map<char, int> n2i = make_n2i();
+	vector<int> ioptseq(nuclen + 1, 0);
+	for(int i = 1; i <= nuclen; i++){
+		ioptseq[i] = n2i[optseq[i]];
+	}
+	fixed_fill_CM(optseq, ioptseq.data(), windx.data(), wlo, W, size + 1, predefE, BP_pair, P, C.data(), M.data());
+
+	vector<int> mfe(nuclen - W + 2, INF);
+	vector<int> F(W + 1);
+	for(int s = 1; s + W - 1 <= nuclen; s++){
+		// F[t]: MFE of optseq[s..s+t-1]
+		F[0] = 0;
+		for(int j = s; j < s + W; j++){
+			int t = j - s + 1;
+			F[t] = F[t - 1];
+			for(int k = s; k <= j - TURN - 1; k++){
+				int type = BP_pair[ioptseq[k]][ioptseq[j]];
+				if(!type) continue;
+				int au_penalty = (type > 2) ? P->TerminalAU : 0;
+				F[t] = MIN2(F[t], F[k - s] + C[getIndx(k,j,W,windx.data())] + au_penalty);
+			}
+		}
+		mfe[s] = F[W];
+	}
+
+	return mfe;
+}
+
+void print_window_profile(const string &optseq, int W, map<string, int> &predefE,
+		const int (&BP_pair)[5][5], paramT *P){
+	int nuclen = optseq.size() - 1;
+	vector<int> mfe = fixed_window_profile(optseq, W, predefE, BP_pair, P);
+	W = MIN2(W, nuclen);
+	cout << "Local MFE profile (window " << W << ", step 1):" << endl;
+	for(int s = 1; s + W - 1 <= nuclen; s++){
+		cout << s << "\t" << s + W - 1 << "\t" << float(mfe[s])/100 << endl;
+	}
+}
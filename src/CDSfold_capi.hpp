@@ -0,0 +1,263 @@
+/*
+ * CDSfold_capi.hpp - the C interface of cdsfold.h, built into
+ * libcdsfold.so with -DCDSFOLD_LIBRARY (make lib)
+ *
+ * A batch runs design_record() on each sequence. With at least as many
+ * sequences as threads, the sequences are spread over the threads and
+ * each is filled by one; otherwise they are designed in turn with all
+ * threads in the fill. The engine threads' cout goes nowhere; their cerr
+ * (warnings such as a window that does not fit in memory) is the host's.
+ */
+
+#ifndef CDSFOLD_CAPI_H_
+#define CDSFOLD_CAPI_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cdsfold.h"
+
+using namespace std;
+
+struct cdsfold_engine {
+	design_options o;
+	int threads = 1;
+	double lambda = 1;
+	codon_costs costs;
+	motif_automaton motifs;
+	string error;
+};
+
+// Layout of a result buffer: the header, then the sequence and the
+// structure, each length + 1 bytes.
+struct capi_result {
+	int32_t status;
+	int32_t length;
+	int32_t mfe;
+	int32_t reserved;
+};
+
+// Routes cout through a thread_streambuf once, so that the engine
+// threads can drop their output while the host's threads keep theirs.
+inline void capi_route_cout(){
+	static once_flag once;
+	call_once(once, []{
+		static thread_streambuf dispatch(cout.rdbuf());
+		cout.rdbuf(&dispatch);
+		thread_streambuf::active.store(&dispatch);
+	});
+}
+
+// CDSFOLD_OK, or why aaseq cannot be designed. cdsfold_engine_set()
+// validates W and there is no -f/-t, so check_record() can only object to
+// the length or the letters.
+inline int capi_check(const design_options &o, const char *aaseq){
+	const int aalen = strlen(aaseq);
+	if(check_record(o, aaseq, aalen).empty())
+		return CDSFOLD_OK;
+	return aalen <= 2 ? CDSFOLD_E_LENGTH : CDSFOLD_E_SEQUENCE;
+}
+
+inline void capi_design(cdsfold_engine *e, const char *aaseq, capi_result *r){
+	static thread_local null_streambuf discard;
+	r->status = capi_check(e->o, aaseq);
+	if(r->status != CDSFOLD_OK)
+		return;
+	const int aalen = strlen(aaseq);
+	vector<char> seq(aaseq, aaseq + aalen + 1);
+	design_result res;
+	design_options o = e->o; // W is adjusted per record
+	o.out = &res;
+	streambuf *prev = thread_streambuf::target;
+	thread_streambuf::target = &discard;
+	design_record(o, "", seq.data(), aalen, nullptr);
+	thread_streambuf::target = prev;
+	if(res.mfe == INF){
+		r->status = CDSFOLD_E_NO_MFE;
+		return;
+	}
+
+	char *text = (char *)(r + 1);
+	char *str = text + r->length + 1;
+	memset(str, '.', r->length);
+	str[r->length] = '\0';
+	memcpy(text, res.seq.c_str(), r->length + 1);
+	for(const pair<int, int> &bp : res.pairs){
+		str[bp.first - 1] = '(';
+		str[bp.second - 1] = ')';
+	}
+	r->mfe = res.mfe;
+}
+
+extern "C" {
+
+int cdsfold_abi_version(void){
+	return CDSFOLD_ABI_VERSION;
+}
+
+cdsfold_engine *cdsfold_engine_new(void){
+	cdsfold_engine *e = new cdsfold_engine;
+	e->o.limits.detect();
+	e->threads = e->o.limits.threads();
+	return e;
+}
+
+void cdsfold_engine_free(cdsfold_engine *e){
+	delete e;
+}
+
+const char *cdsfold_engine_error(const cdsfold_engine *e){
+	return e->error.c_str();
+}
+
+int cdsfold_engine_set(cdsfold_engine *e, const char *key, const char *value){
+	// an invalid value leaves the option as it was
+	const string k = key, v = value ? value : "";
+	e->error.clear();
+	if(k == "w"){
+		const int W = (v == "auto") ? 0 : atoi(v.c_str());
+		if(W != 0 && W < 10){
+			e->error = "W must be more than 10 (you used " + v + ")";
+		}
+		else if(v == "auto" && !e->o.span.empty()){
+			e->error = "w auto cannot be combined with span.";
+		}
+		else{
+			e->o.auto_w = (v == "auto");
+			e->o.W = W;
+		}
+	}
+	else if(k == "e"){
+		e->o.exc = v;
+	}
+	else if(k == "span"){
+		vector<span_range> span;
+		if(!v.empty() && e->o.auto_w)
+			e->error = "span cannot be combined with w auto.";
+		else if(!v.empty())
+			e->error = parse_span_profile(v, span);
+		if(e->error.empty())
+			e->o.span = span;
+	}
+	else if(k == "compress"){
+		e->o.compress_flg = atoi(v.c_str()) != 0;
+	}
+	else if(k == "threads"){
+		const int n = atoi(v.c_str());
+		if(n < 1)
+			e->error = "The threads value must be 1 or more.";
+		else
+			e->threads = n;
+	}
+	else if(k == "codon-cost"){
+		codon_costs costs;
+		if(!v.empty())
+			e->error = costs.load(v);
+		if(e->error.empty()){
+			costs.lambda = e->lambda;
+			e->costs = costs;
+			e->o.codon_cost = v.empty() ? nullptr : &e->costs;
+		}
+	}
+	else if(k == "lambda"){
+		const double lambda = atof(v.c_str());
+		if(lambda < 0)
+			e->error = "The lambda value must be 0 or more.";
+		else
+			e->lambda = e->costs.lambda = lambda;
+	}
+	else if(k == "forbid-motifs"){
+		motif_automaton motifs;
+		if(!v.empty())
+			e->error = motifs.load(v);
+		if(e->error.empty()){
+			e->motifs = motifs;
+			e->o.motifs = motifs.empty() ? nullptr : &e->motifs;
+		}
+	}
+	else if(k == "regions"){
+		vector<design_region> regions;
+		if(!v.empty())
+			e->error = parse_regions(v, regions);
+		if(e->error.empty())
+			e->o.regions = regions;
+	}
+	else{
+		e->error = "unknown option " + k;
+	}
+	return e->error.empty() ? 0 : -1;
+}
+
+size_t cdsfold_result_bytes(int aalen){
+	return sizeof(capi_result) + 2 * (3 * (size_t)aalen + 1);
+}
+
+int cdsfold_design_batch(cdsfold_engine *e, const char *const *seqs, int n, void *const *results){
+	capi_route_cout();
+	for(int k = 0; k < n; k++){
+		capi_result *r = (capi_result *)results[k];
+		r->length = 3 * strlen(seqs[k]);
+		r->mfe = 0;
+		r->reserved = 0;
+		char *text = (char *)(r + 1);
+		text[0] = text[r->length + 1] = '\0';
+	}
+	atomic<int> ok(0);
+	const bool per_record = n >= e->threads; // one thread per sequence
+#ifdef _OPENMP
+	const int host_threads = omp_get_max_threads();
+#endif
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(e->threads) if(per_record)
+	for(int k = 0; k < n; k++){
+		capi_result *r = (capi_result *)results[k];
+#ifdef _OPENMP
+		omp_set_num_threads(per_record ? 1 : e->threads);
+#endif
+		capi_design(e, seqs[k], r);
+		if(r->status == CDSFOLD_OK)
+			ok++;
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(host_threads);
+#endif
+	return ok;
+}
+
+int cdsfold_result_status(const void *r){
+	return ((const capi_result *)r)->status;
+}
+
+int cdsfold_result_length(const void *r){
+	return ((const capi_result *)r)->length;
+}
+
+int cdsfold_result_mfe(const void *r){
+	return ((const capi_result *)r)->mfe;
+}
+
+const char *cdsfold_result_sequence(const void *r){
+	return (const char *)((const capi_result *)r + 1);
+}
+
+const char *cdsfold_result_structure(const void *r){
+	const capi_result *h = (const capi_result *)r;
+	return (const char *)(h + 1) + h->length + 1;
+}
+
+const char *cdsfold_strerror(int status){
+	switch(status){
+	case CDSFOLD_OK: return "ok";
+	case CDSFOLD_E_SEQUENCE: return "not an amino acid sequence, or every codon of an amino acid is excluded";
+	case CDSFOLD_E_LENGTH: return "the amino acid sequence is too short";
+	case CDSFOLD_E_NO_MFE: return "no structure satisfies the constraints";
+	}
+	return "unknown status";
+}
+
+} // extern "C"
+
+#endif /* CDSFOLD_CAPI_H_ */
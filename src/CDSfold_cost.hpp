@@ -0,0 +1,97 @@
+/*
+ * CDSfold_cost.hpp - where the C/M fill spends its time (--cost-map)
+ *
+ * Each (i,j) cell of the fill adds its wall time and its interior-loop
+ * evaluations (the combinations left after the Dep1/Dep2 checks) to the
+ * counters of the calling thread: half to the residue of i and half to the
+ * residue of j, and all of it to the (residue of i, span j-i) bucket. The
+ * per-thread counters are summed when the record is written.
+ */
+
+#ifndef CDSFOLD_COST_H_
+#define CDSFOLD_COST_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class cost_map {
+public:
+	int aalen;
+	int bucket;      // residues per i bucket
+	int span_bucket; // nucleotides per span bucket
+
+	cost_map(int nuclen, int w, int threads)
+		: aalen(nuclen / 3), bucket(max(1, (aalen + 63) / 64)), span_bucket(3 * bucket),
+		  n_pos((aalen + bucket - 1) / bucket), n_span(w / span_bucket + 1),
+		  slot(max(1, threads)) {
+		for(tally &s : slot){
+			s.res.assign(aalen + 1, counts());
+			s.grid.assign(n_pos * n_span, counts());
+		}
+	}
+
+	// Called by thread t for cell (i,j), 1-based nucleotides.
+	void add(int t, int i, int j, double sec, long evals){
+		tally &s = slot[min(t, (int)slot.size() - 1)];
+		const int ri = (i - 1) / 3 + 1, rj = (j - 1) / 3 + 1;
+		s.res[ri].sec += sec / 2;
+		s.res[ri].evals += evals / 2.0;
+		s.res[rj].sec += sec / 2;
+		s.res[rj].evals += evals / 2.0;
+		counts &g = s.grid[((ri - 1) / bucket) * n_span + min((j - i) / span_bucket, n_span - 1)];
+		g.sec += sec;
+		g.evals += evals;
+	}
+
+	// TSV rows of one record: "residue" rows per residue and "band" rows
+	// per non-empty (first residue, first span) bucket.
+	void write(FILE *fp, const string &id, const char *aaseq) const {
+		tally sum;
+		sum.res.assign(aalen + 1, counts());
+		sum.grid.assign(n_pos * n_span, counts());
+		for(const tally &s : slot){
+			for(size_t k = 0; k < s.res.size(); k++)
+				sum.res[k] += s.res[k];
+			for(size_t k = 0; k < s.grid.size(); k++)
+				sum.grid[k] += s.grid[k];
+		}
+		for(int r = 1; r <= aalen; r++)
+			fprintf(fp, "%s\tresidue\t%d\t%c\t-\t%.9f\t%.0f\n", id.c_str(), r, aaseq[r - 1], sum.res[r].sec, sum.res[r].evals);
+		for(int p = 0; p < n_pos; p++){
+			for(int d = 0; d < n_span; d++){
+				const counts &g = sum.grid[p * n_span + d];
+				if(g.sec == 0 && g.evals == 0)
+					continue;
+				fprintf(fp, "%s\tband\t%d\t-\t%d\t%.9f\t%.0f\n", id.c_str(), p * bucket + 1, d * span_bucket, g.sec, g.evals);
+			}
+		}
+	}
+
+	static void write_header(FILE *fp){
+		fprintf(fp, "record\tkind\tresidue\taa\tspan\tseconds\tevaluations\n");
+	}
+
+private:
+	struct counts {
+		double sec = 0;
+		double evals = 0;
+		counts &operator+=(const counts &o){
+			sec += o.sec;
+			evals += o.evals;
+			return *this;
+		}
+	};
+	// one per thread, each in its own allocations
+	struct tally {
+		vector<counts> res;
+		vector<counts> grid;
+	};
+
+	int n_pos, n_span;
+	vector<tally> slot;
+};
+
+#endif /* CDSFOLD_COST_H_ */
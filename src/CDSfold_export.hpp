@@ -0,0 +1,135 @@
+/*
+ * CDSfold_export.hpp - binary dump of chkC, chkM and the F profile
+ * (--export-matrices)
+ *
+ * One section per record, sections back to back. Each section starts
+ * with a 128-byte header; offsets are from the start of the section and
+ * every array is 8-byte aligned int32 (little-endian):
+ *
+ *   char     magic[8]      "CDSFMAT1"
+ *   uint32   version       1
+ *   uint32   header_size   128
+ *   uint32   nuclen        n
+ *   uint32   w             widest band column (n when unwindowed)
+ *   uint32   band_size     cells in chkC/chkM
+ *   int32    inf           value of cells without a valid structure
+ *   uint64   id_off        FASTA header line (id_len bytes, no '>')
+ *   uint64   indx_off      int32[n+1]: cell (i,j) is at indx[j] + i
+ *   uint64   band_lo_off   int32[n+1]: smallest i kept for j (1-based)
+ *   uint64   chkC_off      int32[band_size]: min C over codon choices
+ *   uint64   chkM_off      int32[band_size]: min M over codon choices
+ *   uint64   F_off         int32[n+1]: min F[j] over codon choices, F[0] = 0
+ *   uint64   section_size  bytes up to the next section
+ *   uint32   id_len
+ *
+ * Cells (i,j) exist for band_lo[j] <= i <= j. chkC and chkM are the
+ * in-memory band arrays, written as they are (a diagonal-major build,
+ * CDSFOLD_DIAG_MAJOR, converts them to columns first). Energies are in
+ * dcal/mol.
+ */
+
+#ifndef CDSFOLD_EXPORT_H_
+#define CDSFOLD_EXPORT_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct matrix_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t nuclen;
+	uint32_t w;
+	uint32_t band_size;
+	int32_t inf;
+	uint64_t id_off;
+	uint64_t indx_off;
+	uint64_t band_lo_off;
+	uint64_t chkC_off;
+	uint64_t chkM_off;
+	uint64_t F_off;
+	uint64_t section_size;
+	uint32_t id_len;
+	char pad[36];
+};
+
+inline uint64_t export_align(uint64_t n){
+	return (n + 7) / 8 * 8;
+}
+
+// Appends the section of one record; chkC/chkM must be filled (fill_CM).
+inline void export_matrices(FILE *fp, const fold_context &ctx, const string &id){
+	const int n = ctx.nuclen;
+#ifdef CDSFOLD_DIAG_MAJOR
+	vector<int32_t> indx(n + 1);
+	set_column_indx(indx.data(), ctx.band_lo, n);
+	const uint32_t band = indx[n] + n + 1;
+	vector<int32_t> chkC(band, INF), chkM(band, INF);
+	for(int j = 1; j <= n; j++){
+		for(int i = ctx.band_lo[j]; i <= j; i++){
+			const int ij = getIndx(i, j, ctx.w, ctx.indx);
+			chkC[indx[j] + i] = ctx.chkC[ij];
+			chkM[indx[j] + i] = ctx.chkM[ij];
+		}
+	}
+	const int32_t *col_indx = indx.data(), *col_chkC = chkC.data(), *col_chkM = chkM.data();
+#else
+	const uint32_t band = getBandSize(n, ctx.indx) + 1;
+	const int32_t *col_indx = ctx.indx, *col_chkC = ctx.chkC, *col_chkM = ctx.chkM;
+#endif
+
+	vector<int32_t> lo(n + 1, 1), Fmin(n + 1, 0);
+	for(int j = 1; j <= n; j++){
+		lo[j] = ctx.band_lo[j];
+		int m = INF;
+		for(unsigned int L = 0; L < ctx.pos2nuc[1].size(); L++)
+			for(unsigned int R = 0; R < ctx.pos2nuc[j].size(); R++)
+				m = MIN2(m, ctx.F[j][L][R]);
+		Fmin[j] = m;
+	}
+
+	matrix_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "CDSFMAT1", 8);
+	h.version = 1;
+	h.header_size = sizeof(h);
+	h.nuclen = n;
+	h.w = ctx.w;
+	h.band_size = band;
+	h.inf = INF;
+	h.id_len = id.size();
+	h.id_off = sizeof(h);
+	h.indx_off = export_align(h.id_off + id.size());
+	h.band_lo_off = export_align(h.indx_off + 4 * (n + 1));
+	h.chkC_off = export_align(h.band_lo_off + 4 * (n + 1));
+	h.chkM_off = export_align(h.chkC_off + 4ULL * band);
+	h.F_off = export_align(h.chkM_off + 4ULL * band);
+	h.section_size = export_align(h.F_off + 4 * (n + 1));
+
+	uint64_t at = 0;
+	auto pad = [&](uint64_t off){
+		static const char zero[8] = {};
+		fwrite(zero, 1, off - at, fp);
+		at = off;
+	};
+	auto put = [&](uint64_t off, const void *p, size_t bytes){
+		pad(off);
+		fwrite(p, 1, bytes, fp);
+		at += bytes;
+	};
+	put(0, &h, sizeof(h));
+	put(h.id_off, id.data(), id.size());
+	put(h.indx_off, col_indx, 4 * (n + 1));
+	put(h.band_lo_off, lo.data(), 4 * (n + 1));
+	put(h.chkC_off, col_chkC, 4ULL * band);
+	put(h.chkM_off, col_chkM, 4ULL * band);
+	put(h.F_off, Fmin.data(), 4 * (n + 1));
+	pad(h.section_size);
+}
+
+#endif /* CDSFOLD_EXPORT_H_ */
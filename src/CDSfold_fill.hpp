@@ -0,0 +1,1163 @@
+/*
+ * CDSfold_fill.hpp - codon-aware DP fill (C/M, F and F2)
+ *
+ * The recursions used to live inline in main(). They are kept here as
+ * free functions over a fold_context so that the same code is shared by
+ * the CDSfold executable and the kernel benchmarks.
+ */
+
+#ifndef CDSFOLD_FILL_H_
+#define CDSFOLD_FILL_H_
+
+#include <climits>
+#include <cstdint>
+#include <functional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Keep C-style arrays for compatibility with existing function signatures
+int BP_pair[5][5] =
+/* _  A  C  G  U  */
+{ { 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 5 }, { 0, 0, 0, 1, 0 }, { 0, 0, 2, 0, 3 }, {
+		0, 6, 0, 4, 0 } };
+int rtype[7] = { 0, 2, 1, 4, 3, 6, 5 };
+
+inline double fold_wtime(){
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline int fold_num_threads(){
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// Phase timings and per-thread busy time of the parallel fill loops (--stats).
+struct fold_stats {
+	int threads;
+	double t_alloc, t_fill_CM, t_fill_F, t_fill_F2, t_backtrack;
+	vector<double> busy;    // one padded slot per thread
+	long ml_candidates;     // entries of the multiloop candidate lists
+	long ml_lists;          // (j, nucleotide) lists
+	long ml_list_max;
+
+	void reset(){
+		threads = fold_num_threads();
+		t_alloc = t_fill_CM = t_fill_F = t_fill_F2 = t_backtrack = 0;
+		busy.assign(threads * 8, 0.0);
+		ml_candidates = ml_lists = ml_list_max = 0;
+	}
+	void add_busy(double t){
+#ifdef _OPENMP
+		busy[omp_get_thread_num() * 8] += t;
+#else
+		busy[0] += t;
+#endif
+	}
+	// max/mean busy time over the threads (1.0 = perfectly balanced)
+	double imbalance() const {
+		double sum = 0, mx = 0;
+		for(int t = 0; t < threads; t++){
+			sum += busy[t * 8];
+			mx = max(mx, busy[t * 8]);
+		}
+		return sum > 0 ? mx / (sum / threads) : 1.0;
+	}
+};
+
+// A split point of the multiloop decomposition: cell (k,j) with nucleotide
+// Lk at k, whose M value e is made by a stem at k (plus unpaired bases on
+// the right) and is lower than M of (k+1,j) plus a base or than any split of
+// (k,j). Splits M(i,k-1) + M(k,j) at other k are never lower than a split at
+// a candidate, so M and DMl only need the candidates.
+struct ml_candidate {
+	int k;
+	int Lk;
+	int e;
+};
+
+// Nucleotide codes of one position (pos2nuc), flat and fixed-width, so the
+// interior-loop nest reads them without going through two vectors.
+struct nuc_choices {
+	uint8_t n;
+	uint8_t nuc[4];
+};
+
+// Everything the fill needs for one amino acid sequence.
+struct fold_context {
+	int nuclen;
+	int w;                  // effective window (nuclen when W == 0)
+	int *indx;
+
+	vector<vector<int> > pos2nuc;
+	vector<nuc_choices> nucs;      // pos2nuc, flat (set_nuc_choices)
+	vector<vector<int> > Dep1;
+	vector<vector<int> > Dep2;
+	vector<vector<vector<string> > > substr;
+	map<string, int> predefHPN_E;
+	vector<int> NucConst;
+	const char *NucDef;
+	int NCflg;
+	int DEPflg;
+	int TEST;
+
+	// partial optimization (-f/-t): cells touching these intervals are not paired
+	bool part_opt_flg;
+	int n_inter;
+	int ofm[100];
+	int oto[100];
+
+	bool rand_tb_flg;
+
+	map<char, int> n2i;
+	char i2n[20];
+	int i2r[20];
+	int ii2r[100];
+	paramT *P;
+
+	int ***C, ***M, ***F, ***F2;
+	int ***DMl, ***DMl1, ***DMl2;
+	int *chkC, *chkM;
+	bond *base_pair;
+	packed_cells *packC = nullptr;  // --compress: packed C diagonals
+	function<void()> yield;         // --serve: preemption point between diagonals
+	vector<int> band_lo, band_hi;   // band of indx, see set_ij_indx()
+	vector<array<int, 9> > nuc_cost; // --codon-cost, --regions: terms of paired nucleotides
+	vector<array<int, 9> > loop_cost; // --codon-cost: terms of the nucleotides loops fix
+	cost_map *cost = nullptr;       // --cost-map: time per residue and band bucket
+	int row_lo = 1, row_hi = INT_MAX; // rows i filled: MPI rank, --mfe-only strip
+	// fill_CM: candidates per [j][R], in decreasing k; empty = full split loop
+	vector<vector<vector<ml_candidate> > > ml_cand;
+
+	fold_stats stats;
+};
+
+inline void set_nuc_choices(fold_context &ctx){
+	ctx.nucs.assign(ctx.pos2nuc.size(), nuc_choices{0, {0, 0, 0, 0}});
+	for (size_t x = 0; x < ctx.pos2nuc.size(); x++) {
+		ctx.nucs[x].n = ctx.pos2nuc[x].size();
+		for (size_t a = 0; a < ctx.pos2nuc[x].size() && a < 4; a++)
+			ctx.nucs[x].nuc[a] = ctx.pos2nuc[x][a];
+	}
+}
+
+inline void init_context_tables(fold_context &ctx){
+	ctx.stats.reset();
+	ctx.n2i = make_n2i();
+	make_i2n(ctx.i2n);
+	make_i2r(ctx.i2r);
+	make_ii2r(ctx.ii2r);
+}
+
+void fill_short_cells(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const vector<vector<int> > &Dep2 = ctx.Dep2;
+	const vector<int> &NucConst = ctx.NucConst;
+	const int NCflg = ctx.NCflg;
+	const int DEPflg = ctx.DEPflg;
+	const bool rand_tb_flg = ctx.rand_tb_flg;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	int ***C = ctx.C, ***M = ctx.M, ***F2 = ctx.F2;
+	int *chkC = ctx.chkC, *chkM = ctx.chkM;
+
+	for (int l = 2; l <= 4; l++) {
+		for (int i = 1; i <= nuclen - l + 1; i++) {
+//				test = 1;
+			int j = i + l - 1;
+			//int ij = indx[j] + i;
+			int ij = getIndx(i, j, w_tmp, indx);
+
+			chkC[ij] = INF;
+			chkM[ij] = INF;
+
+			for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
+				int L_nuc = pos2nuc[i][L];
+				if(NCflg == 1 && i2r[L_nuc] != NucConst[i]){	continue;}
+				for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
+					int R_nuc = pos2nuc[j][R];
+					if(NCflg == 1 && i2r[R_nuc] != NucConst[j]){	continue;}
+					//L-R pair must be filtered
+//						if(j-1==1){
+//							cout << i << ":" << j << " " << L_nuc << "-" << R_nuc << " " << Dep1[ii2r[L_nuc*10+R_nuc]][i] <<endl;
+//						}
+					if(DEPflg && j-i == 1 && i <= nuclen - 1 && Dep1[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;} // nuclen - 1はいらないのでは？
+					if(DEPflg && j-i == 2 && i <= nuclen - 2 && Dep2[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;}
+
+					C[ij][L][R] = INF;
+					M[ij][L][R] = INF;
+					if(rand_tb_flg)
+						F2[ij][L][R] = 0;
+
+				}
+			}
+		}
+	}
+}
+
+// Fill C and M for all cells of length l. Cells of length < l must be done,
+// and DMl1/DMl2 must hold the multiloop decompositions of length l-1/l-2.
+void fill_diagonal(fold_context &ctx, const int l){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const vector<vector<int> > &Dep2 = ctx.Dep2;
+	const vector<vector<vector<string> > > &substr = ctx.substr;
+	// read by every thread: const lookups only, no map::operator[]
+	const map<string, int> &predefHPN_E = ctx.predefHPN_E;
+	const map<char, int> &n2i = ctx.n2i;
+	const vector<int> &NucConst = ctx.NucConst;
+	const char *NucDef = ctx.NucDef;
+	const int NCflg = ctx.NCflg;
+	const int DEPflg = ctx.DEPflg;
+	const int TEST = ctx.TEST;
+	const bool part_opt_flg = ctx.part_opt_flg;
+	const int n_inter = ctx.n_inter;
+	const int *ofm = ctx.ofm;
+	const int *oto = ctx.oto;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	paramT *P = ctx.P;
+	int ***C = ctx.C, ***M = ctx.M;
+	int ***DMl = ctx.DMl, ***DMl2 = ctx.DMl2;
+	int *chkC = ctx.chkC, *chkM = ctx.chkM;
+	const char dummy_str[10] = "XXXXXXXXX";
+	const bool sparse = !ctx.ml_cand.empty();
+	const nuc_choices *nc = ctx.nucs.data();
+	const vector<int> &band_lo = ctx.band_lo;
+	const vector<array<int, 9> > &loop_cost = ctx.loop_cost;
+	static const array<int, 9> no_cost = {};
+	cost_map *const cost = ctx.cost;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+		const double t_busy = fold_wtime();
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic) nowait
+#endif
+		for (int i = ctx.row_lo; i <= MIN2(nuclen - l + 1, ctx.row_hi); i++) {
+			int j = i + l - 1;
+			if(i < band_lo[j]) continue;
+			const double t_cell = cost ? fold_wtime() : 0;
+			long evals = 0; // interior-loop energies evaluated
+			const nuc_choices &ni1 = nc[i + 1], &nj1 = nc[j - 1];
+
+			int opt_flg_ij = 1;
+			if(part_opt_flg){
+				for(int I = 0; I < n_inter; I++){
+					if((ofm[I] <= i && oto[I] >= i) ||
+							(ofm[I] <= j && oto[I] >= j)){
+						opt_flg_ij = 0;
+						break;
+					}
+				}
+			}
+
+
+			for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
+				int L_nuc = pos2nuc[i][L];
+//					cout << NCflg << endl;
+				if(NCflg == 1 && i2r[L_nuc] != NucConst[i]){	continue;}
+//					cout << "ok" << endl;
+
+				for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
+
+					int R_nuc = pos2nuc[j][R];
+
+					if(NCflg == 1 && i2r[R_nuc] != NucConst[j]){	continue;}
+
+					//int ij = indx[j] + i;
+					int ij = getIndx(i,j,w_tmp,indx);
+
+					C[ij][L][R] = INF;
+					M[ij][L][R] = INF;
+					int stem_M = INF, other_M = INF; // candidate test
+					//						cout << i << " " << j << ":" << M[ij][L][R] << endl;
+
+					int type = BP_pair[i2r[L_nuc]][i2r[R_nuc]];
+
+
+					if (type && opt_flg_ij) {
+						// hairpin
+						if((l == 5 || l ==6 || l == 8) && TEST){
+							for(unsigned int s = 0; s < substr[i][l].size(); s++){
+								const string &hpn = substr[i][l][s];
+								int hL_nuc  = n2i.at(hpn[0]);
+								int hL2_nuc = n2i.at(hpn[1]);
+								int hR2_nuc = n2i.at(hpn[l-2]);
+								int hR_nuc  = n2i.at(hpn[l-1]);
+								if(hL_nuc != i2r[L_nuc]) continue;
+								if(hR_nuc != i2r[R_nuc]) continue;
+
+								if(NCflg == 1){
+									string s1 = string(NucDef).substr(i, l);
+									if(hpn != s1) continue;
+								}
+
+//									cout << hpn << endl;
+//
+								if(DEPflg && L_nuc > 4 && Dep1[ii2r[L_nuc*10+hL2_nuc]][i] == 0){continue;}   // Dependencyをチェックした上でsubstringを求めているので, hpnの内部についてはチェックする必要はない。
+								if(DEPflg && R_nuc > 4 && Dep1[ii2r[hR2_nuc*10+R_nuc]][j-1] == 0){continue;} // ただし、L_nuc、R_nucがVWXYのときだけは、一つ内側との依存関係をチェックする必要がある。
+																										      // その逆に、一つ内側がVWXYのときはチェックの必要はない。既にチェックされているので。
+								int hpn_cost = 0; // codon costs of the loop
+								if(!loop_cost.empty())
+									for(int k = 1; k < l - 1; k++)
+										hpn_cost += loop_cost[i + k][n2i.at(hpn[k])];
+								const map<string, int>::const_iterator pre = predefHPN_E.find(hpn);
+								if(pre != predefHPN_E.end()){
+									C[ij][L][R] = MIN2(pre->second + hpn_cost, C[ij][L][R]);
+
+								}
+								else{
+//										int energy = HairpinE(j - i - 1, type,
+//												i2r[hL2_nuc], i2r[hR2_nuc],
+//												dummy_str);
+									int energy = E_hairpin(j - i - 1, type,
+											i2r[hL2_nuc], i2r[hR2_nuc],
+											dummy_str, P);
+									C[ij][L][R] = MIN2(energy + hpn_cost, C[ij][L][R]);
+								}
+							}
+							//exit(0);
+						}
+						else{
+							const int *cL2 = nuc_row(loop_cost, i + 1), *cR2 = nuc_row(loop_cost, j - 1);
+							for (unsigned int L2 = 0;
+									L2 < pos2nuc[i + 1].size(); L2++) {
+								int L2_nuc = pos2nuc[i + 1][L2];
+								if(NCflg == 1 && i2r[L2_nuc] != NucConst[i+1]){	continue;}
+								//if(chkDep2){continue:}
+								for (unsigned int R2 = 0;
+										R2 < pos2nuc[j - 1].size(); R2++) {
+									int R2_nuc = pos2nuc[j - 1][R2];
+									if(NCflg == 1 && i2r[R2_nuc] != NucConst[j-1]){	continue;}
+
+									if(DEPflg && Dep1[ii2r[L_nuc*10+L2_nuc]][i] == 0){continue;}
+									if(DEPflg && Dep1[ii2r[R2_nuc*10+R_nuc]][j-1] == 0){continue;}
+
+									int energy;
+									//cout << j-i-1 << ":" << type << ":" << i2r[L2_nuc] << ":" << i2r[R2_nuc] << ":" << dummy_str << endl;
+									//										energy = HairpinE(j - i - 1, type,
+									//												i2r[L2_nuc], i2r[R2_nuc],
+									//												dummy_str);
+									energy = E_hairpin(j - i - 1, type,
+											i2r[L2_nuc], i2r[R2_nuc],
+											dummy_str, P) + cL2[L2_nuc] + cR2[R2_nuc];
+									//cout << "HairpinE(" << j-i-1 << "," << type << "," << i2r[L2_nuc] << "," << i2r[R2_nuc] << ")" << " at " << i << "," << j << ":" << energy << endl;
+									//cout << i << " " << j  << " " << energy << ":" << i2n[L_nuc] << "-" << i2n[R_nuc] << "<-" << i2n[L2_nuc] << "-" << i2n[R2_nuc] << endl;
+									C[ij][L][R] = MIN2(energy, C[ij][L][R]);
+
+									// check predefined hairpin energy
+									//if((l == 5 || l == 6 || l == 8) && preHPN_flg == 1){
+									//  if(predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].second != ""){
+									//		if(NCflg == 1){
+									//			string s1 = string(NucDef).substr(i, l);
+									//			if(predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].second == s1){
+									//				//C[ij][L][R] = MIN2(C[ij][L][R], predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].first);
+									//				C[ij][L][R] = predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].first; // Note that predefined hairpin is forced when it is found
+									//			}
+									//			}
+									//		else{
+									//			//一つ内側の塩基とのDependencyをチェックする。
+									//			string s1 = predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].second;
+									//			int preL2_nuc = n2i[s1[1]];
+									//			int preR2_nuc = n2i[s1[s1.size()-2]];
+//										//			cout << s1 << endl;
+									//			if(DEPflg && Dep1[ii2r[L_nuc*10+preL2_nuc]][i] == 0){continue;}
+									//			if(DEPflg && Dep1[ii2r[preR2_nuc*10+R_nuc]][j-1] == 0){continue;}
+									//			C[ij][L][R] = predefHPN[i][l][i2r[L_nuc]][i2r[R_nuc]].first; // Note that predefined hairpin is forced when it is found
+									//		}
+//										//	exit(0);
+									//	}
+									//}
+								}
+
+							}
+						}
+
+						// interior loop
+						for (int p = i + 1;
+								p <= MIN2(j-2-TURN, i+MAXLOOP+1); p++) { // loop for position q, p
+							int minq = j - i + p - MAXLOOP - 2;
+							if (minq < p + 1 + TURN)
+								minq = p + 1 + TURN;
+							const nuc_choices &np = nc[p], &np1 = nc[p - 1];
+							// codon costs of the unpaired i+1 and p-1
+							const int *cL2 = p > i + 1? nuc_row(loop_cost, i + 1) : no_cost.data();
+							const int *cLp2 = p > i + 2? nuc_row(loop_cost, p - 1) : no_cost.data();
+							for (int q = minq; q < j; q++) {
+
+								int pq = getIndx(p,q,w_tmp, indx);
+								const nuc_choices &nq = nc[q], &nq1 = nc[q + 1];
+								const int *cR2 = q < j - 1? nuc_row(loop_cost, j - 1) : no_cost.data();
+								const int *cRq2 = q < j - 2? nuc_row(loop_cost, q + 1) : no_cost.data();
+
+								for (int Lp = 0; Lp < np.n; Lp++) {
+									int Lp_nuc = np.nuc[Lp];
+									if(NCflg == 1 && i2r[Lp_nuc] != NucConst[p]){	continue;}
+
+									if(DEPflg && p == i + 1 && Dep1[ii2r[L_nuc*10+Lp_nuc]][i] == 0){ continue;}
+									if(DEPflg && p == i + 2 && Dep2[ii2r[L_nuc*10+Lp_nuc]][i] == 0){ continue;}
+
+									for (int Rq = 0; Rq < nq.n; Rq++) { // nucleotide for p, q
+										int Rq_nuc = nq.nuc[Rq];
+										if(NCflg == 1 && i2r[Rq_nuc] != NucConst[q]){	continue;}
+
+										if(DEPflg && q == j - 1 && Dep1[ii2r[Rq_nuc*10+R_nuc]][q] == 0){ continue;}
+										if(DEPflg && q == j - 2 && Dep2[ii2r[Rq_nuc*10+R_nuc]][q] == 0){ continue;}
+
+										int type_2 = BP_pair[i2r[Lp_nuc]][i2r[Rq_nuc]];
+										if (type_2 == 0)
+											continue;
+										type_2 = rtype[type_2];
+										const int C_pq = C[pq][Lp][Rq];
+
+										// for each intloops
+										for (int L2 = 0; L2 < ni1.n; L2++) { // nucleotide for i+1,j-1
+											int L2_nuc = ni1.nuc[L2];
+											if(NCflg == 1 && i2r[L2_nuc] != NucConst[i+1]){	continue;}
+											if(DEPflg && Dep1[ii2r[L_nuc*10+L2_nuc]][i] == 0){ continue;}
+
+											for (int R2 = 0; R2 < nj1.n; R2++) {
+												int R2_nuc = nj1.nuc[R2];
+												if(NCflg == 1 && i2r[R2_nuc] != NucConst[j-1]){	continue;}
+												if(DEPflg && Dep1[ii2r[R2_nuc*10+R_nuc]][j-1] == 0){ continue;}
+
+												for (int Lp2 = 0; Lp2 < np1.n; Lp2++) { // nucleotide for p-1,q+1
+													int Lp2_nuc = np1.nuc[Lp2];
+													if(NCflg == 1 && i2r[Lp2_nuc] != NucConst[p-1]){ continue;}
+
+													if(DEPflg && Dep1[ii2r[Lp2_nuc*10+Lp_nuc]][p-1] == 0){ continue;}
+													if(p == i + 2 && L2_nuc != Lp2_nuc){ continue; } // check when a single nucleotide between i and p, this sentence confirm the dependency between Li_nuc and Lp2_nuc
+													if(DEPflg && i + 3 == p && Dep1[ii2r[L2_nuc*10+Lp2_nuc]][i+1] == 0){ continue;} // check dependency between i+1, p-1 (i,X,X,p)
+													const int C_pq_cost = C_pq + cL2[L2_nuc] + cR2[R2_nuc] + cLp2[Lp2_nuc];
+
+													for (int Rq2 = 0; Rq2 < nq1.n; Rq2++) {
+														int Rq2_nuc = nq1.nuc[Rq2];
+														if(q == j - 2 && R2_nuc != Rq2_nuc){ continue; } // check when a single nucleotide between q and j,this sentence confirm the dependency between Rj_nuc and Rq2_nuc
+
+														if(NCflg == 1 && i2r[Rq2_nuc] != NucConst[q+1]){	continue;}
+
+														if(DEPflg && Dep1[ii2r[Rq_nuc*10+Rq2_nuc]][q] == 0){ continue;}
+														if(DEPflg && q + 3 == j && Dep1[ii2r[Rq2_nuc*10+R2_nuc]][q+1] == 0){ continue;} // check dependency between q+1, j-1 (q,X,X,j)
+
+														int int_energy = E_intloop(p - i - 1, j - q - 1, type, type_2,
+																i2r[L2_nuc], i2r[R2_nuc], i2r[Lp2_nuc], i2r[Rq2_nuc], P);
+																//LoopEnergy(p- i- 1,j- q- 1,type,type_2,i2r[L2_nuc],i2r[R2_nuc],i2r[Lp2_nuc],i2r[Rq2_nuc]);
+
+														int energy = int_energy + C_pq_cost + cRq2[Rq2_nuc];
+														C[ij][L][R] = MIN2(energy, C[ij][L][R]);
+														evals++;
+													}
+												}
+											}
+										}
+									}
+								}
+							} /* end q-loop */
+						} /* end p-loop */
+
+						// multi-loop
+						for (unsigned int Li1 = 0;
+								Li1 < pos2nuc[i + 1].size(); Li1++) {
+							int Li1_nuc = pos2nuc[i+1][Li1];
+							if(NCflg == 1 && i2r[Li1_nuc] != NucConst[i+1]){	continue;}
+
+							if(DEPflg && Dep1[ii2r[L_nuc*10+Li1_nuc]][i] == 0){ continue;}
+
+							for (unsigned int Rj1 = 0;
+									Rj1 < pos2nuc[j - 1].size(); Rj1++) {
+								int Rj1_nuc = pos2nuc[j-1][Rj1];
+								if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j-1]){	continue;}
+
+								if(DEPflg && Dep1[ii2r[Rj1_nuc*10+R_nuc]][j-1] == 0){ continue;}
+								//if(DEPflg && j-i == 2 && i <= nuclen - 2 && Dep2[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;}
+								if(DEPflg && (j-1)-(i+1) == 2 && Dep2[ii2r[Li1_nuc*10+Rj1_nuc]][i+1] == 0){continue;} // 2014/10/8 i-jが近いときは、MLclosingする必要はないのでは。少なくとも3つのステムが含まれなければならない。それには、５＋５＋２（ヘアピン2個分＋2塩基）の長さが必要。
+
+								int energy = DMl2[i+1][Li1][Rj1]; // 長さが2個短いときの、複合マルチループ。i'=i+1を選ぶと、j'=(i+1)+(l-2)-1=i+l-2=j-1(because:j=i+l-1)
+								int tt = rtype[type];
+
+								energy += P->MLintern[tt];
+								if(tt > 2)
+									energy += P->TerminalAU;
+
+								energy += P->MLclosing;
+								//cout << "TEST:" << i << " " << j << " " << energy << endl;
+								C[ij][L][R] =
+										MIN2(energy,
+												C[ij][L][R]);
+
+//									if(C[ij][L][R] == -1130 && ij == 10091){
+//										exit(0);
+//									}
+
+
+							}
+						}
+
+						// codon costs of i and j (--codon-cost)
+						if(C[ij][L][R] < INF)
+							C[ij][L][R] += pair_cost(ctx.nuc_cost, i, L_nuc, j, R_nuc);
+
+
+//							cout << "ok" << endl;
+					}
+
+					else C[ij][L][R] = INF;
+
+
+					// fill M
+					// create M[ij] from C[ij]
+					if(type){
+				        int energy_M = C[ij][L][R];
+				        if(type > 2)
+				          energy_M += P->TerminalAU;
+
+				        energy_M += P->MLintern[type];
+				        M[ij][L][R] = energy_M;
+				        stem_M = energy_M;
+					}
+
+					// create M[ij] from M[i+1][j]
+					const int cost_i = nuc_row(loop_cost, i)[L_nuc];
+					for (unsigned int Li1 = 0;
+							Li1 < pos2nuc[i + 1].size(); Li1++) {
+						int Li1_nuc = pos2nuc[i + 1][Li1];
+						if(NCflg == 1 && i2r[Li1_nuc] != NucConst[i + 1]){	continue;}
+						if(DEPflg && Dep1[ii2r[L_nuc*10+Li1_nuc]][i] == 0){ continue;}
+
+						//int energy_M = M[indx[j]+i+1][Li1][R]+P->MLbase;
+						int energy_M = M[getIndx(i+1, j, w_tmp, indx)][Li1][R]+P->MLbase + cost_i;
+				        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+				        other_M = MIN2(energy_M, other_M);
+					}
+
+					// create M[ij] from M[i][j-1]
+					const int cost_j = nuc_row(loop_cost, j)[R_nuc];
+					for (unsigned int Rj1 = 0;
+							Rj1 < pos2nuc[j - 1].size(); Rj1++) {
+						int Rj1_nuc = pos2nuc[j - 1][Rj1];
+						if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j - 1]){	continue;}
+						if(DEPflg && Dep1[ii2r[Rj1_nuc*10+R_nuc]][j-1] == 0){ continue;}
+
+						//int energy_M = M[indx[j-1]+i][L][Rj1]+P->MLbase;
+						int energy_M = M[getIndx(i,j-1, w_tmp,indx)][L][Rj1]+P->MLbase + cost_j;
+				        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+				        stem_M = MIN2(energy_M, stem_M);
+					}
+
+
+					/* modular decomposition -------------------------------*/
+					if(sparse){
+						for(const ml_candidate &c : ctx.ml_cand[j][R]){
+							const int k = c.k;
+							if(k < i + 2 + TURN) break;
+							const int Lk_nuc = nc[k].nuc[c.Lk];
+							const int ik1 = getIndx(i,k-1,w_tmp,indx);
+							const nuc_choices &nk1 = nc[k - 1];
+							for (int Rk1 = 0; Rk1 < nk1.n; Rk1++) {
+								int Rk1_nuc = nk1.nuc[Rk1];
+								if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
+								if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
+
+								int energy_M = M[ik1][L][Rk1] + c.e;
+								DMl[i][L][R] = MIN2(energy_M, DMl[i][L][R]);
+								M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+								other_M = MIN2(energy_M, other_M);
+							}
+						}
+						if(stem_M < other_M)
+							ctx.ml_cand[j][R].push_back(ml_candidate{i, (int)L, stem_M}); // only (i,j) of this diagonal ends at j
+					}
+					else
+					for (int k = i + 2 + TURN; k <= j - TURN - 1; k++) { // Is this correct?
+						//cout << k << endl;
+						for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
+								Rk1++) {
+							int Rk1_nuc = pos2nuc[k-1][Rk1];
+							if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
+							//if(DEPflg && k == i + 2 && Dep1[ii2r[L_nuc*10+Rk1_nuc]][k-1] == 0){ continue;} // dependency between i and k - 1(=i+1)
+							//if(DEPflg && k == i + 3 && Dep2[ii2r[L_nuc*10+Rk1_nuc]][k-1] == 0){ continue;} // dependency between i and k - 1(=i+2)
+
+							for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
+									Lk++) {
+								int Lk_nuc = pos2nuc[k][Lk];
+								if(NCflg == 1 && i2r[Lk_nuc] != NucConst[k]){	continue;}
+								if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
+								//if(DEPflg && (k-1) - i + 1 == 2 && Dep2[ii2r[Rk1_nuc*10+L_nuc]][k-1] == 0){ continue;} // dependency between i and k - 1
+
+								//cout << i << " " << k-1 << ":" << M[indx[k-1]+i][L][Rk1] << "," << k << " " << j << ":" << M[indx[j]+k][Lk][R] << endl;
+								//int energy_M =  M[indx[k-1]+i][L][Rk1]+M[indx[j]+k][Lk][R];
+								int energy_M =  M[getIndx(i,k-1,w_tmp,indx)][L][Rk1]+M[getIndx(k,j,w_tmp,indx)][Lk][R];
+								DMl[i][L][R] = MIN2(energy_M, DMl[i][L][R]);
+						        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+
+							}
+						}
+					}
+
+
+//						if(i == 3 && j == 7)
+					//cout << i << " " << j << ":" << C[ij][L][R] << " " << L << "-" << R << endl;
+					//vwxyがあるので、ここを複数回訪れることがある。
+					//なので、MIN2を取っておく。
+					//if(i2r[L_nuc] == NucConst[i] && i2r[R_nuc] == NucConst[j]){
+						chkC[ij] = MIN2(chkC[ij], C[ij][L][R]);
+						chkM[ij] = MIN2(chkM[ij], M[ij][L][R]);
+					//} このループは多分意味がない。
+				}
+			}
+			if(cost){
+#ifdef _OPENMP
+				cost->add(omp_get_thread_num(), i, j, fold_wtime() - t_cell, evals);
+#else
+				cost->add(0, i, j, fold_wtime() - t_cell, evals);
+#endif
+			}
+		}
+		ctx.stats.add_busy(fold_wtime() - t_busy);
+	}
+}
+
+// rotate DMl arrays
+void rotate_DMl(fold_context &ctx){
+	int ***FF;
+	FF = ctx.DMl2; ctx.DMl2 = ctx.DMl1; ctx.DMl1 = ctx.DMl; ctx.DMl = FF;
+	for(int j = 1; j <= ctx.nuclen; j++){
+		for(unsigned int L = 0; L < 4; L++){
+			fill(ctx.DMl[j][L], ctx.DMl[j][L]+4,INF);
+		}
+	}
+}
+
+// Allocates the C blocks of diagonal l (--compress), set to INF. Blocks
+// released by pack_diagonal() are reused, so only the diagonals still in
+// interior-loop reach are resident.
+void alloc_C_diagonal(fold_context &ctx, const int l){
+	int ***C = ctx.C;
+	for (int i = 1; i <= ctx.nuclen - l + 1; i++) {
+		int j = i + l - 1;
+		if(i < ctx.band_lo[j]) continue;
+		int ij = getIndx(i, j, ctx.w, ctx.indx);
+		int nL = ctx.pos2nuc[i].size(), nR = ctx.pos2nuc[j].size();
+		C[ij] = new int*[nL];
+		for (int L = 0; L < nL; L++) {
+			C[ij][L] = new int[nR];
+			fill(C[ij][L], C[ij][L] + nR, INF);
+		}
+	}
+}
+
+// Packs diagonal d of C into ctx.packC and releases its dense blocks.
+// Diagonal l reads C back to length l - MAXLOOP - 2 only.
+void pack_diagonal(fold_context &ctx, const int d){
+	int ***C = ctx.C;
+	for (int i = 1; i <= ctx.nuclen - d + 1; i++) {
+		int j = i + d - 1;
+		if(i < ctx.band_lo[j]) continue;
+		int ij = getIndx(i, j, ctx.w, ctx.indx);
+		int nL = ctx.pos2nuc[i].size();
+		ctx.packC->pack(ij, C[ij], nL, ctx.pos2nuc[j].size());
+		for (int L = 0; L < nL; L++)
+			delete [] C[ij][L];
+		delete [] C[ij];
+		C[ij] = nullptr;
+	}
+}
+
+// Cells of one diagonal are independent and are filled in parallel.
+void fill_CM(fold_context &ctx){
+	const double t_start = fold_wtime();
+	fill_short_cells(ctx);
+	set_nuc_choices(ctx);
+	ctx.ml_cand.assign(ctx.nuclen + 1, vector<vector<ml_candidate> >());
+	for (int j = 1; j <= ctx.nuclen; j++)
+		ctx.ml_cand[j].resize(ctx.pos2nuc[j].size());
+
+	for (int l = 5; l <= ctx.nuclen; l++) {
+		if(l > ctx.w) break;
+		cout << "process:" << l << endl;
+
+		if(ctx.packC)
+			alloc_C_diagonal(ctx, l);
+		fill_diagonal(ctx, l);
+		rotate_DMl(ctx);
+		if(ctx.packC && l - MAXLOOP - 2 >= 2)
+			pack_diagonal(ctx, l - MAXLOOP - 2);
+		if(ctx.yield)
+			ctx.yield();
+	}
+	for (const vector<vector<ml_candidate> > &cj : ctx.ml_cand) {
+		for (const vector<ml_candidate> &c : cj) {
+			ctx.stats.ml_candidates += c.size();
+			ctx.stats.ml_list_max = max(ctx.stats.ml_list_max, (long)c.size());
+			ctx.stats.ml_lists++;
+		}
+	}
+	vector<vector<vector<ml_candidate> > >().swap(ctx.ml_cand);
+	ctx.stats.t_fill_CM = fold_wtime() - t_start;
+}
+
+// F[j] from recc 1, 2 and the splits k_lo..k_hi of recc 4. With part set,
+// only the splits are computed, as minima into part[L1][Rj] (MPI ranks).
+void fill_F_column(fold_context &ctx, const cell_view &C, const int j, const int k_lo, const int k_hi, int (*part)[4] = nullptr){
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<int> &band_lo = ctx.band_lo;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const vector<vector<int> > &Dep2 = ctx.Dep2;
+	const vector<int> &NucConst = ctx.NucConst;
+	const int NCflg = ctx.NCflg;
+	const int DEPflg = ctx.DEPflg;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	paramT *P = ctx.P;
+	int ***F = ctx.F;
+
+	for (unsigned int L1 = 0; L1 < pos2nuc[1].size(); L1++) {
+		int L1_nuc = pos2nuc[1][L1];
+		if(NCflg == 1 && i2r[L1_nuc] != NucConst[1]){	continue;}
+
+//				int opt_flg_1 = 1;
+//				for(int I = 0; I < n_inter; I++){
+//					if(ofm[I] <= 1 && oto[I] >= 1){
+//						opt_flg_1 = 0;
+//						break;
+//					}
+//				}
+			//				int opt_flg_j = 1;
+			//				for(int I = 0; I < n_inter; I++){
+			//					if(ofm[I] <= j && oto[I] >= j){
+			//						opt_flg_j = 0;
+			//						break;
+			//					}
+			//				}
+
+		for (unsigned int Rj = 0; Rj < pos2nuc[j].size(); Rj++) {
+			int Rj_nuc = pos2nuc[j][Rj];
+			if(NCflg == 1 && i2r[Rj_nuc] != NucConst[j]){	continue;}
+
+			if(DEPflg && j == 2 && Dep1[ii2r[L1_nuc*10+Rj_nuc]][1] == 0){ continue;}
+			if(DEPflg && j == 3 && Dep2[ii2r[L1_nuc*10+Rj_nuc]][1] == 0){ continue;}
+
+			int &Fj = part ? part[L1][Rj] : F[j][L1][Rj];
+
+			if(!part){
+				Fj = INF;
+
+				int type_L1Rj = BP_pair[i2r[L1_nuc]][i2r[Rj_nuc]];
+				if (type_L1Rj) {
+//						if(opt_flg_1 && opt_flg_j){
+						int au_penalty = 0;
+						if (type_L1Rj > 2)
+							au_penalty = P->TerminalAU;
+						if(band_lo[j] == 1)
+							Fj = MIN2(Fj, C[getIndx(1,j,w_tmp,indx)][L1][Rj] + au_penalty); // recc 1
+							//F[j][L1][Rj] = MIN2(F[j][L1][Rj], C[indx[j] + 1][L1][Rj] + au_penalty); // recc 1
+//						}
+				}
+
+				// create F[j] from F[j-1]
+				const int cost_j = nuc_row(ctx.loop_cost, j)[Rj_nuc];
+				for (unsigned int Rj1 = 0; Rj1 < pos2nuc[j - 1].size();
+						Rj1++) {
+					int Rj1_nuc = pos2nuc[j-1][Rj1];
+					if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j-1]){	continue;}
+					if(DEPflg && Dep1[ii2r[Rj1_nuc*10+Rj_nuc]][j-1] == 0){ continue;}
+
+					Fj = MIN2(Fj, F[j - 1][L1][Rj1] + cost_j); // recc 2
+				}
+			}
+
+			// create F[j] from F[k-1] and C[k][j]
+			//for (int k = 2; k <= j - TURN - 1; k++) { // Is this correct?
+			for (int k = k_lo; k <= k_hi; k++) { // Is this correct?
+
+//						int opt_flg_k = 1;
+//						for(int I = 0; I < n_inter; I++){
+//							if(ofm[I] <= k && oto[I] >= k){
+//								opt_flg_k = 0;
+//								break;
+//							}
+//						}
+
+
+				for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
+						Rk1++) {
+					int Rk1_nuc = pos2nuc[k-1][Rk1];
+					if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
+					if(DEPflg && k == 3 && Dep1[ii2r[L1_nuc*10+Rk1_nuc]][1] == 0){ continue;} // dependency between 1(i) and 2(k-1)
+					if(DEPflg && k == 4 && Dep2[ii2r[L1_nuc*10+Rk1_nuc]][1] == 0){ continue;} // dependency between 1(i) and 3(k-1)
+
+					for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
+							Lk++) {
+						int Lk_nuc = pos2nuc[k][Lk];
+						if(NCflg == 1 && i2r[Lk_nuc] != NucConst[k]){	continue;}
+
+						if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k-1 and k
+
+						int type_LkRj =
+								BP_pair[i2r[Lk_nuc]][i2r[Rj_nuc]];
+
+						int au_penalty = 0;
+						if (type_LkRj > 2)
+							au_penalty = P->TerminalAU;
+						//int kj = indx[j] + k;
+						int kj = getIndx(k,j,w_tmp,indx);
+
+						int energy = F[k - 1][L1][Rk1] + C[kj][Lk][Rj]
+								+ au_penalty; // recc 4
+
+						Fj = MIN2(Fj, energy);
+					}
+
+				}
+			}
+
+			//cout << j << ":" << F[j][L1][Rj] << " " << i2n[L1_nuc] << "-" << i2n[Rj_nuc] << endl;
+		}
+	}
+}
+
+// F of the whole sequence for each first/last nucleotide
+void print_F_end(const fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const int *i2r = ctx.i2r;
+	for (unsigned int L1 = 0; L1 < pos2nuc[1].size(); L1++) {
+		int L1_nuc = pos2nuc[1][L1];
+		if(ctx.NCflg == 1 && i2r[L1_nuc] != ctx.NucConst[1]){	continue;}
+		for (unsigned int Rj = 0; Rj < pos2nuc[nuclen].size(); Rj++) {
+			int Rj_nuc = pos2nuc[nuclen][Rj];
+			if(ctx.NCflg == 1 && i2r[Rj_nuc] != ctx.NucConst[nuclen]){	continue;}
+			cout << ctx.i2n[L1_nuc] << "-" << ctx.i2n[Rj_nuc] << ":"
+					<< ctx.F[nuclen][L1][Rj] << endl;
+		}
+	}
+}
+
+void fill_F(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	cell_view C(ctx.C, ctx.packC);
+	int ***F = ctx.F;
+	const double t_start = fold_wtime();
+
+	// Fill F matrix
+	// Initialize F[1]; the traceback keeps the nucleotide of R
+	for (unsigned int L = 0; L < pos2nuc[1].size(); L++) {
+		for (unsigned int R = 0; R < pos2nuc[1].size(); R++) {
+			F[1][L][R] = nuc_row(ctx.loop_cost, 1)[pos2nuc[1][R]];
+		}
+	}
+
+	for (int j = 2; j <= nuclen; j++) {
+		fill_F_column(ctx, C, j, MAX2(2, ctx.band_lo[j]), j - TURN - 1);
+	}
+	print_F_end(ctx);
+	ctx.stats.t_fill_F = fold_wtime() - t_start;
+}
+
+// Returns the MFE over the first/last nucleotide choices (INF if undefined).
+int find_mfe(const fold_context &ctx, int &minL, int &minR){
+	const int nuclen = ctx.nuclen;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<int> &NucConst = ctx.NucConst;
+	const int NCflg = ctx.NCflg;
+	const int *i2r = ctx.i2r;
+	int ***F = ctx.F;
+
+	int MFE = INF;
+	for(unsigned int L = 0; L < pos2nuc[1].size(); L++){
+		int L_nuc = pos2nuc[1][L];
+		if(NCflg == 1 && i2r[L_nuc] != NucConst[1]){	continue;}
+		for(unsigned int R = 0; R < pos2nuc[nuclen].size(); R++){
+			int R_nuc = pos2nuc[nuclen][R];
+			if(NCflg == 1 && i2r[R_nuc] != NucConst[nuclen]){	continue;}
+
+			if(F[nuclen][L][R] < MFE){
+				MFE  = F[nuclen][L][R];
+				minL = L;
+				minR = R;
+			}
+
+		}
+	}
+	return MFE;
+}
+
+// Allocates C and M of the cells of length 5 or more in columns a..b,
+// set to INF (--mfe-only).
+void alloc_strip(fold_context &ctx, const int a, const int b){
+	for (int j = a; j <= b; j++) {
+		int nR = ctx.pos2nuc[j].size();
+		for (int i = ctx.band_lo[j]; i <= j - 4; i++) {
+			int ij = getIndx(i, j, ctx.w, ctx.indx);
+			int nL = ctx.pos2nuc[i].size();
+			ctx.C[ij] = new int*[nL];
+			ctx.M[ij] = new int*[nL];
+			for (int L = 0; L < nL; L++) {
+				ctx.C[ij][L] = new int[nR];
+				ctx.M[ij][L] = new int[nR];
+				fill(ctx.C[ij][L], ctx.C[ij][L] + nR, INF);
+				fill(ctx.M[ij][L], ctx.M[ij][L] + nR, INF);
+			}
+		}
+	}
+}
+
+// Releases the blocks of column j of X (C or M).
+void release_column(fold_context &ctx, int ***X, const int j){
+	for (int i = ctx.band_lo[j]; i <= j; i++) {
+		int ij = getIndx(i, j, ctx.w, ctx.indx);
+		if(!X[ij]) continue;
+		for (size_t L = 0; L < ctx.pos2nuc[i].size(); L++)
+			delete [] X[ij][L];
+		delete [] X[ij];
+		X[ij] = nullptr;
+	}
+}
+
+// --mfe-only: C/M and F in strips of columns instead of whole diagonals.
+// All cells of a strip ending at j are done before the next strip starts,
+// so F[j] is final at once and C is only held back to the interior-loop
+// reach (MAXLOOP + 2 columns); M is held back to the band (all of it
+// without a window, as the splits reach across). Only cells of length 4
+// or less may be allocated beforehand (allocate_arrays() with keep). No
+// traceback can run afterwards.
+void fill_mfe_only(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const double t_start = fold_wtime();
+	double t_F = 0;
+	fill_short_cells(ctx);
+	set_nuc_choices(ctx);
+	ctx.ml_cand.assign(nuclen + 1, vector<vector<ml_candidate> >());
+	for (int j = 1; j <= nuclen; j++)
+		ctx.ml_cand[j].resize(ctx.pos2nuc[j].size());
+	for (unsigned int L = 0; L < ctx.pos2nuc[1].size(); L++)
+		for (unsigned int R = 0; R < ctx.pos2nuc[1].size(); R++)
+			ctx.F[1][L][R] = nuc_row(ctx.loop_cost, 1)[ctx.pos2nuc[1][R]];
+
+	// wide enough for the threads and the per-diagonal overhead, narrow
+	// against the C of the strip
+	const int S = MIN2(256, MAX2(MAX2(32, nuclen / 16), 4 * ctx.stats.threads));
+	// DMl of the last cell of a strip per diagonal: DMl2 of the first cell
+	// of the next strip, whose rows the next strip does not fill
+	typedef array<array<int, 4>, 4> dml_cell;
+	dml_cell none;
+	for (array<int, 4> &r : none) r.fill(INF);
+	vector<dml_cell> edge(ctx.w + 1, none), prev_edge(ctx.w + 1, none);
+	cell_view C(ctx.C, nullptr);
+	int c_freed = 0, m_freed = 0; // columns released so far
+
+	for (int a = 1; a <= nuclen; a += S) {
+		const int b = MIN2(a + S - 1, nuclen);
+		alloc_strip(ctx, a, b);
+		edge.swap(prev_edge);
+		for (int i = MAX2(1, a - 5); i <= b; i++) {
+			for (int L = 0; L < 4; L++) {
+				fill(ctx.DMl[i][L], ctx.DMl[i][L] + 4, INF);
+				fill(ctx.DMl1[i][L], ctx.DMl1[i][L] + 4, INF);
+				fill(ctx.DMl2[i][L], ctx.DMl2[i][L] + 4, INF);
+			}
+		}
+		for (int l = 5; l <= MIN2(ctx.w, b); l++) {
+			ctx.row_lo = MAX2(1, a - l + 1);
+			ctx.row_hi = b - l + 1;
+			const int e = a - l + 2; // (e, a-1) of length l-2
+			if(a > 1 && e >= 1){
+				for (int L = 0; L < 4; L++)
+					for (int R = 0; R < 4; R++)
+						ctx.DMl2[e][L][R] = prev_edge[l - 2][L][R];
+			}
+			fill_diagonal(ctx, l);
+			for (int L = 0; L < 4; L++)
+				for (int R = 0; R < 4; R++)
+					edge[l][L][R] = ctx.DMl[ctx.row_hi][L][R];
+
+			int ***FF = ctx.DMl2; ctx.DMl2 = ctx.DMl1; ctx.DMl1 = ctx.DMl; ctx.DMl = FF;
+			for (int i = MAX2(1, a - l); i <= ctx.row_hi - 1; i++)
+				for (int L = 0; L < 4; L++)
+					fill(ctx.DMl[i][L], ctx.DMl[i][L] + 4, INF);
+			if(ctx.yield)
+				ctx.yield();
+		}
+		for (int l = 5; l <= ctx.w; l++)
+			if(b - l + 1 < 1) edge[l] = none;
+
+		const double t_phase = fold_wtime();
+		for (int j = MAX2(2, a); j <= b; j++)
+			fill_F_column(ctx, C, j, MAX2(2, ctx.band_lo[j]), j - TURN - 1);
+		t_F += fold_wtime() - t_phase;
+
+		for (int j = a; j <= b; j++) {
+			for (vector<ml_candidate> &c : ctx.ml_cand[j]) {
+				ctx.stats.ml_candidates += c.size();
+				ctx.stats.ml_list_max = max(ctx.stats.ml_list_max, (long)c.size());
+				ctx.stats.ml_lists++;
+				vector<ml_candidate>().swap(c);
+			}
+		}
+		// the next strip reads C back to column b+1 - MAXLOOP - 1, and M
+		// from column band_lo[b+1] and column b on
+		const int c_keep = b - MAXLOOP;
+		const int m_keep = (b < nuclen) ? MIN2(ctx.band_lo[b + 1], b) : b + 1;
+		for (; c_freed + 1 < c_keep; c_freed++)
+			release_column(ctx, ctx.C, c_freed + 1);
+		for (; m_freed + 1 < m_keep; m_freed++)
+			release_column(ctx, ctx.M, m_freed + 1);
+	}
+	ctx.row_lo = 1;
+	ctx.row_hi = INT_MAX;
+	vector<vector<vector<ml_candidate> > >().swap(ctx.ml_cand);
+	ctx.stats.t_fill_F = t_F;
+	ctx.stats.t_fill_CM = fold_wtime() - t_start - t_F;
+}
+
+// Fill F2 matrix (used by the random traceback, -R)
+void fill_F2(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const int DEPflg = ctx.DEPflg;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	paramT *P = ctx.P;
+	cell_view C(ctx.C, ctx.packC);
+	int ***F2 = ctx.F2;
+	const vector<int> &band_lo = ctx.band_lo;
+	const double t_start = fold_wtime();
+
+	for (int l = 5; l <= nuclen; l++) {
+		if(l > w_tmp) break;
+	cout << "process F2:" << l << endl;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+			const double t_busy = fold_wtime();
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic) nowait
+#endif
+			for (int i = 1; i <= nuclen - l + 1; i++) {
+				int j = i + l - 1;
+				if(i < band_lo[j]) continue;
+
+				for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
+					int L_nuc = pos2nuc[i][L];
+
+					for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
+						int R_nuc = pos2nuc[j][R];
+						int ij = getIndx(i,j,w_tmp,indx);
+
+						F2[ij][L][R] = 0;
+
+						int type = BP_pair[i2r[L_nuc]][i2r[R_nuc]];
+
+						// from i, j-1 -> i, j
+						for (unsigned int R1 = 0; R1 < pos2nuc[j-1].size(); R1++) {
+							int R1_nuc = pos2nuc[j-1][R1];
+							if(DEPflg && Dep1[ii2r[R1_nuc*10+R_nuc]][j-1] == 0){continue;}
+							int ij1 = getIndx(i,j-1,w_tmp,indx);
+							F2[ij][L][R] = MIN2(F2[ij][L][R], F2[ij1][L][R1]);
+						}
+						// from i-1, j -> i, j
+						for (unsigned int L1 = 0; L1 < pos2nuc[i+1].size(); L1++) {
+							int L1_nuc = pos2nuc[i+1][L1];
+							if(DEPflg && Dep1[ii2r[L_nuc*10+L1_nuc]][i] == 0){continue;}
+							int i1j = getIndx(i+1,j,w_tmp,indx);
+							F2[ij][L][R] = MIN2(F2[ij][L][R], F2[i1j][L1][R]);
+						}
+
+						// from C
+						int au_penalty = 0;
+						if (type > 2)
+							au_penalty = P->TerminalAU;
+						if(j - i + 1 <= w_tmp){
+							F2[ij][L][R] = MIN2(F2[ij][L][R], C[ij][L][R] + au_penalty);
+							//cout << "test:" << F2[ij][L][R] << endl;
+						}
+
+						// Bifucation
+						/* modular decomposition -------------------------------*/
+						for (int k = i + 2 + TURN; k <= j - TURN - 1; k++) { // Is this correct?
+							//cout << k << endl;
+//			    				if((k - 1) - i + 1 > w_tmp ||
+//			    					j - k + 1 > w_tmp)
+//			    						continue;
+
+							for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
+									Rk1++) {
+								int Rk1_nuc = pos2nuc[k-1][Rk1];
+
+								for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
+										Lk++) {
+									int Lk_nuc = pos2nuc[k][Lk];
+									if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
+
+									int energy =  F2[getIndx(i,k-1,w_tmp,indx)][L][Rk1]+F2[getIndx(k,j,w_tmp,indx)][Lk][R];
+									F2[ij][L][R] = MIN2(F2[ij][L][R], energy);
+
+								}
+							}
+						}
+
+//							cout << i << "," << j << "," << L << "," << R << "," << F2[ij][L][R] << endl;
+
+					}
+				}
+			}
+			ctx.stats.add_busy(fold_wtime() - t_busy);
+		}
+		if(ctx.yield)
+			ctx.yield();
+	}
+	ctx.stats.t_fill_F2 = fold_wtime() - t_start;
+}
+
+void print_stats(ostream &os, const fold_context &ctx){
+	const fold_stats &st = ctx.stats;
+	os << "stats: threads " << st.threads << endl;
+	os << "stats: nuclen " << ctx.nuclen << endl;
+	os << "stats: w " << ctx.w << endl;
+	os << "stats: band_cells " << getBandSize(ctx.nuclen, ctx.indx) << endl;
+	os << "stats: time_alloc " << st.t_alloc << endl;
+	os << "stats: time_fill_CM " << st.t_fill_CM << endl;
+	os << "stats: time_fill_F " << st.t_fill_F << endl;
+	os << "stats: time_fill_F2 " << st.t_fill_F2 << endl;
+	os << "stats: time_backtrack " << st.t_backtrack << endl;
+	os << "stats: imbalance " << st.imbalance() << endl;
+	if(st.ml_lists){
+		os << "stats: ml_candidates " << st.ml_candidates << endl;
+		os << "stats: ml_candidates_mean " << double(st.ml_candidates) / st.ml_lists << endl;
+		os << "stats: ml_candidates_max " << st.ml_list_max << endl;
+	}
+	if(ctx.packC){
+		os << "stats: packed_cells " << ctx.packC->cells << endl;
+		os << "stats: packed_bytes " << ctx.packC->bytes() << endl;
+		os << "stats: packed_cache_hits " << ctx.packC->cache_hits() << endl;
+		os << "stats: packed_cache_misses " << ctx.packC->cache_misses() << endl;
+	}
+}
+
+#endif /* CDSFOLD_FILL_H_ */
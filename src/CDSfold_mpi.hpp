@@ -0,0 +1,272 @@
+/*
+ * CDSfold_mpi.hpp - band-partitioned fill of one protein over MPI ranks
+ * (make mpi, run with mpirun -np N)
+ *
+ * Rank r owns the rows [row_lo, row_hi] of the (i,j) band and fills their
+ * C/M cells diagonal by diagonal. A cell (i,j) reads C only from rows up to
+ * i+MAXLOOP+1 (interior loops), and M and DMl from rows i+1..j-4
+ * (multiloop k-split). So data only flows to lower ranks. After each
+ * diagonal a rank sends the new cells to every lower rank that needs them,
+ * plus DMl of its first row to the rank just below it.
+ * F is computed column by column: every rank reduces the splits k of its
+ * own rows, and rank 0 adds the rest and broadcasts F[j]. Rank 0 then runs
+ * the traceback and fetches missing C/M blocks from their owners on demand.
+ */
+
+#ifndef CDSFOLD_MPI_H_
+#define CDSFOLD_MPI_H_
+
+#include <mpi.h>
+#include <vector>
+
+using namespace std;
+
+int mpi_rank = 0;
+int mpi_size = 1;
+
+enum { MPI_TAG_DIAG = 1, MPI_TAG_REQ = 2, MPI_TAG_CELL = 3 };
+
+struct mpi_stats {
+	long long sent_bytes;
+	long fetched;
+	double t_exchange;
+};
+
+// Row ranges of the ranks: equal row counts, so that every diagonal is
+// split evenly while it still reaches all ranks.
+struct mpi_band {
+	int n;
+	vector<int> lo, hi;
+	const vector<int> &band_lo;  // fold_context::band_lo
+	mpi_stats stats;
+
+	mpi_band(int nuclen, const vector<int> &band) : n(nuclen), lo(mpi_size), hi(mpi_size), band_lo(band) {
+		for(int r = 0; r < mpi_size; r++){
+			lo[r] = 1 + (long long)n * r / mpi_size;
+			hi[r] = (long long)n * (r + 1) / mpi_size;
+		}
+		stats.sent_bytes = 0;
+		stats.fetched = 0;
+		stats.t_exchange = 0;
+	}
+
+	int owner(int i) const {
+		int r = (long long)(i - 1) * mpi_size / n;
+		while(r > 0 && i < lo[r]) r--;
+		while(r < mpi_size - 1 && i > hi[r]) r++;
+		return r;
+	}
+
+	// Does rank s (below the owner of row i) read C / M of cell (i,j)?
+	bool needs_C(int s, int i, int j) const {
+		return lo[s] < i && hi[s] >= MAX2(i - MAXLOOP - 1, band_lo[j]);
+	}
+	bool needs_M(int s, int i, int j) const {
+		return lo[s] < i && hi[s] >= band_lo[j];
+	}
+
+	// allocate_arrays() selection for this rank
+	int keep(int i, int j) const {
+		if(j - i + 1 <= 4 || (i >= lo[mpi_rank] && i <= hi[mpi_rank]))
+			return 3;
+		if(i < lo[mpi_rank])
+			return 0;
+		return (needs_C(mpi_rank, i, j) ? 1 : 0) | (needs_M(mpi_rank, i, j) ? 2 : 0);
+	}
+};
+
+// Cells of diagonal l that rank t sends to rank s, in a fixed order; both
+// sides walk the same list. Calls f(ij, i, j, C?, M?).
+template<class Fn> void mpi_diag_cells(const fold_context &ctx, const mpi_band &part, int t, int s, int l, Fn f){
+	for(int i = part.lo[t]; i <= MIN2(part.hi[t], ctx.nuclen - l + 1); i++){
+		int j = i + l - 1;
+		if(i < ctx.band_lo[j]) continue;
+		bool c = part.needs_C(s, i, j), m = part.needs_M(s, i, j);
+		if(c || m)
+			f(getIndx(i, j, ctx.w, ctx.indx), i, j, c, m);
+	}
+}
+
+void mpi_exchange(fold_context &ctx, mpi_band &part, int l){
+	const double t_start = MPI_Wtime();
+	const int me = mpi_rank;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	vector<vector<int> > out(mpi_size), in(mpi_size);
+	vector<MPI_Request> req;
+
+	// receive from higher ranks
+	for(int t = me + 1; t < mpi_size; t++){
+		size_t len = (t == me + 1) ? 16 : 0;
+		mpi_diag_cells(ctx, part, t, me, l, [&](int, int i, int j, bool c, bool m){
+			len += (c + m) * pos2nuc[i].size() * pos2nuc[j].size();
+		});
+		if(len == 0) continue;
+		in[t].resize(len);
+		req.push_back(MPI_REQUEST_NULL);
+		MPI_Irecv(in[t].data(), len, MPI_INT, t, MPI_TAG_DIAG, MPI_COMM_WORLD, &req.back());
+	}
+	// send to lower ranks
+	for(int s = 0; s < me; s++){
+		vector<int> &buf = out[s];
+		if(s == me - 1){
+			for(int L = 0; L < 4; L++)
+				buf.insert(buf.end(), ctx.DMl[part.lo[me]][L], ctx.DMl[part.lo[me]][L] + 4);
+		}
+		mpi_diag_cells(ctx, part, me, s, l, [&](int ij, int i, int j, bool c, bool m){
+			for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
+				if(c) buf.insert(buf.end(), ctx.C[ij][L], ctx.C[ij][L] + pos2nuc[j].size());
+				if(m) buf.insert(buf.end(), ctx.M[ij][L], ctx.M[ij][L] + pos2nuc[j].size());
+			}
+		});
+		if(buf.empty()) continue;
+		req.push_back(MPI_REQUEST_NULL);
+		MPI_Isend(buf.data(), buf.size(), MPI_INT, s, MPI_TAG_DIAG, MPI_COMM_WORLD, &req.back());
+		part.stats.sent_bytes += buf.size() * sizeof(int);
+	}
+	MPI_Waitall(req.size(), req.data(), MPI_STATUSES_IGNORE);
+
+	for(int t = me + 1; t < mpi_size; t++){
+		if(in[t].empty()) continue;
+		const int *p = in[t].data();
+		if(t == me + 1){
+			for(int L = 0; L < 4; L++, p += 4)
+				copy(p, p + 4, ctx.DMl[part.lo[t]][L]);
+		}
+		mpi_diag_cells(ctx, part, t, me, l, [&](int ij, int i, int j, bool c, bool m){
+			const int nR = pos2nuc[j].size();
+			for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
+				if(c){ copy(p, p + nR, ctx.C[ij][L]); p += nR; }
+				if(m){ copy(p, p + nR, ctx.M[ij][L]); p += nR; }
+			}
+		});
+	}
+	part.stats.t_exchange += MPI_Wtime() - t_start;
+}
+
+void mpi_fill_CM(fold_context &ctx, mpi_band &part){
+	const double t_start = fold_wtime();
+	ctx.row_lo = part.lo[mpi_rank];
+	ctx.row_hi = part.hi[mpi_rank];
+	fill_short_cells(ctx);
+	set_nuc_choices(ctx);
+
+	for (int l = 5; l <= ctx.nuclen; l++) {
+		if(l > ctx.w) break;
+		cout << "process:" << l << endl;
+
+		fill_diagonal(ctx, l);
+		mpi_exchange(ctx, part, l);
+		rotate_DMl(ctx);
+	}
+	ctx.stats.t_fill_CM = fold_wtime() - t_start;
+}
+
+// F on every rank; the splits k of each rank's rows are reduced on rank 0.
+void mpi_fill_F(fold_context &ctx, mpi_band &part){
+	const int nuclen = ctx.nuclen;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const int n1 = pos2nuc[1].size();
+	cell_view C(ctx.C);
+	int ***F = ctx.F;
+	const double t_start = fold_wtime();
+
+	for (int L = 0; L < n1; L++) {
+		for (int R = 0; R < n1; R++) {
+			F[1][L][R] = nuc_row(ctx.loop_cost, 1)[pos2nuc[1][R]];
+		}
+	}
+
+	for (int j = 2; j <= nuclen; j++) {
+		const int nj = pos2nuc[j].size();
+		const int k_lo = MAX2(MAX2(2, ctx.band_lo[j]), part.lo[mpi_rank]);
+		const int k_hi = MIN2(j - TURN - 1, part.hi[mpi_rank]);
+		int part_F[4][4], min_F[4][4];
+		for(int L = 0; L < 4; L++)
+			for(int R = 0; R < 4; R++)
+				part_F[L][R] = INF;
+
+		if(mpi_rank == 0)
+			fill_F_column(ctx, C, j, k_lo, k_hi);
+		else
+			fill_F_column(ctx, C, j, k_lo, k_hi, part_F);
+		MPI_Reduce(part_F, min_F, 16, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+
+		int col[16];
+		if(mpi_rank == 0){
+			for(int L = 0; L < n1; L++){
+				for(int R = 0; R < nj; R++){
+					F[j][L][R] = MIN2(F[j][L][R], min_F[L][R]);
+					col[L * 4 + R] = F[j][L][R];
+				}
+			}
+		}
+		MPI_Bcast(col, 16, MPI_INT, 0, MPI_COMM_WORLD);
+		for(int L = 0; L < n1; L++)
+			for(int R = 0; R < nj; R++)
+				F[j][L][R] = col[L * 4 + R];
+	}
+	print_F_end(ctx);
+	ctx.stats.t_fill_F = fold_wtime() - t_start;
+}
+
+// Rank 0: block of cell ij of C (which = 0) or M (1) from its owner, kept
+// in the local matrix so that free_arrays() releases it.
+int **mpi_fetch(fold_context &ctx, mpi_band &part, int which, int ij){
+	int i, j;
+	band_cell(ctx.indx, ctx.nuclen, ij, i, j);
+	const int nL = ctx.pos2nuc[i].size(), nR = ctx.pos2nuc[j].size();
+	int req[2] = { which, ij };
+	vector<int> buf(nL * nR);
+	MPI_Send(req, 2, MPI_INT, part.owner(i), MPI_TAG_REQ, MPI_COMM_WORLD);
+	MPI_Recv(buf.data(), nL * nR, MPI_INT, part.owner(i), MPI_TAG_CELL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+	int **b = new int*[nL];
+	for(int L = 0; L < nL; L++)
+		b[L] = new int[nR];
+	for(int L = 0; L < nL; L++)
+		copy(buf.begin() + L * nR, buf.begin() + (L + 1) * nR, b[L]);
+	(which ? ctx.M : ctx.C)[ij] = b;
+	part.stats.fetched++;
+	return b;
+}
+
+// Ranks > 0: answer mpi_fetch() until rank 0 sends the stop request.
+void mpi_serve_cells(fold_context &ctx){
+	vector<int> buf;
+	while(true){
+		int req[2];
+		MPI_Recv(req, 2, MPI_INT, 0, MPI_TAG_REQ, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		if(req[0] < 0)
+			break;
+		const int ij = req[1];
+		int i, j;
+		band_cell(ctx.indx, ctx.nuclen, ij, i, j);
+		const int nR = ctx.pos2nuc[j].size();
+		int **b = (req[0] ? ctx.M : ctx.C)[ij];
+		buf.clear();
+		for(unsigned int L = 0; L < ctx.pos2nuc[i].size(); L++)
+			buf.insert(buf.end(), b[L], b[L] + nR);
+		MPI_Send(buf.data(), buf.size(), MPI_INT, 0, MPI_TAG_CELL, MPI_COMM_WORLD);
+	}
+}
+
+void mpi_stop_service(){
+	int stop[2] = { -1, 0 };
+	for(int r = 1; r < mpi_size; r++)
+		MPI_Send(stop, 2, MPI_INT, r, MPI_TAG_REQ, MPI_COMM_WORLD);
+}
+
+void mpi_print_stats(ostream &os, const mpi_band &part){
+	long long bytes = 0;
+	double t_max = 0;
+	MPI_Reduce(&part.stats.sent_bytes, &bytes, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&part.stats.t_exchange, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	if(mpi_rank == 0){
+		os << "stats: mpi_ranks " << mpi_size << endl;
+		os << "stats: mpi_exchange_bytes " << bytes << endl;
+		os << "stats: mpi_exchange_time " << t_max << endl;
+		os << "stats: mpi_fetched_cells " << part.stats.fetched << endl;
+	}
+}
+
+#endif /* CDSFOLD_MPI_H_ */
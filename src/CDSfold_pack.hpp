@@ -0,0 +1,174 @@
+/*
+ * CDSfold_pack.hpp - packed storage of completed C diagonals (--compress)
+ *
+ * Once a diagonal of C is out of reach of the interior loops (MAXLOOP + 2
+ * diagonals back) it is only read again by F, F2 and the traceback. Its
+ * L x R blocks are then stored as zigzag varints of C - chkC (INF as 0)
+ * and decoded on demand into a small per-thread cache.
+ */
+
+#ifndef CDSFOLD_PACK_H_
+#define CDSFOLD_PACK_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using namespace std;
+
+class packed_cells {
+	static const size_t CHUNK = 1 << 20;
+	static const size_t MAX_CELL = 1 + 16 * 10; // header + 16 varints
+
+	vector<unique_ptr<uint8_t[]> > chunks;
+	size_t used;
+	vector<uint64_t> pos;  // chunk << 20 | offset, per cell
+	const int *base;       // chkC
+	unsigned id;
+	mutable vector<long> tally; // cache hits, misses; one padded slot per thread
+
+	struct cache {
+		static const int SLOTS = 8;
+		unsigned owner[SLOTS];
+		int tag[SLOTS];
+		int val[SLOTS][16];
+		int *row[SLOTS][4];
+		int next;
+	};
+
+	long &count(int miss) const {
+#ifdef _OPENMP
+		const size_t t = omp_get_thread_num();
+#else
+		const size_t t = 0;
+#endif
+		return tally[min(t, tally.size() / 8 - 1) * 8 + miss];
+	}
+
+	static unsigned next_id(){
+		static atomic<unsigned> n(0);
+		return ++n;
+	}
+
+	void put(uint64_t u){
+		uint8_t *p = chunks.back().get() + used;
+		while(u >= 0x80){
+			*p++ = (uint8_t)(u | 0x80);
+			u >>= 7;
+			used++;
+		}
+		*p = (uint8_t)u;
+		used++;
+	}
+
+public:
+	long cells;
+
+	packed_cells(int size, const int *chk)
+		: used(CHUNK), pos(size + 1, 0), base(chk), id(next_id()), cells(0) {
+#ifdef _OPENMP
+		tally.assign(8 * omp_get_max_threads(), 0);
+#else
+		tally.assign(8, 0);
+#endif
+	}
+
+	// Decodes served from the per-thread cache and decoded afresh
+	long cache_hits() const {
+		long n = 0;
+		for(size_t t = 0; t < tally.size(); t += 8) n += tally[t];
+		return n;
+	}
+	long cache_misses() const {
+		long n = 0;
+		for(size_t t = 0; t < tally.size(); t += 8) n += tally[t + 1];
+		return n;
+	}
+
+	size_t bytes() const {
+		return chunks.size() * CHUNK + pos.size() * sizeof(uint64_t);
+	}
+
+	// Packs an nL x nR block; the caller frees the dense block afterwards.
+	void pack(int ij, int *const *block, int nL, int nR){
+		if(used + MAX_CELL > CHUNK){
+			chunks.emplace_back(new uint8_t[CHUNK]);
+			used = 0;
+		}
+		pos[ij] = ((uint64_t)(chunks.size() - 1) << 20) | used;
+		put((uint64_t)(nL << 4 | nR));
+		for(int L = 0; L < nL; L++){
+			for(int R = 0; R < nR; R++){
+				int v = block[L][R];
+				int64_t d = (int64_t)v - base[ij];
+				put(v == INF ? 0 : (((uint64_t)d << 1) ^ (uint64_t)(d >> 63)) + 1);
+			}
+		}
+		cells++;
+	}
+
+	// Decodes a packed block. The pointer stays valid for the next
+	// cache::SLOTS - 1 decodes of the calling thread.
+	int **decode(int ij) const {
+		static thread_local cache c = {};
+		for(int s = 0; s < cache::SLOTS; s++){
+			if(c.owner[s] == id && c.tag[s] == ij){
+				count(0)++;
+				return c.row[s];
+			}
+		}
+		count(1)++;
+		int s = c.next;
+		c.next = (c.next + 1) % cache::SLOTS;
+		c.owner[s] = id;
+		c.tag[s] = ij;
+
+		const uint8_t *p = chunks[pos[ij] >> 20].get() + (pos[ij] & (CHUNK - 1));
+		int nL = *p >> 4, nR = *p & 15;
+		p++;
+		for(int k = 0; k < nL * nR; k++){
+			uint64_t u = 0;
+			int shift = 0;
+			while(*p & 0x80){
+				u |= (uint64_t)(*p++ & 0x7f) << shift;
+				shift += 7;
+			}
+			u |= (uint64_t)(*p++) << shift;
+			if(u == 0){
+				c.val[s][k] = INF;
+			}
+			else{
+				u--;
+				c.val[s][k] = (int)((int64_t)base[ij] + (int64_t)((u >> 1) ^ (~(u & 1) + 1)));
+			}
+		}
+		for(int L = 0; L < nL; L++)
+			c.row[s][L] = c.val[s] + L * nR;
+		return c.row[s];
+	}
+};
+
+// Read access to C (or M) that falls back to the packed store for cells
+// whose dense block was released, or to the rank that owns the cell (MPI).
+struct cell_view {
+	int ***dense;
+	const packed_cells *packed;
+	const function<int **(int)> *remote;
+
+	cell_view(int ***d, const packed_cells *p = nullptr, const function<int **(int)> *r = nullptr)
+		: dense(d), packed(p), remote(r) {}
+
+	int **operator[](int ij) const {
+		int **b = dense[ij];
+		if(b)
+			return b;
+		return packed ? packed->decode(ij) : (*remote)(ij);
+	}
+};
+
+#endif /* CDSFOLD_PACK_H_ */
@@ -0,0 +1,563 @@
+/*
+ * CDSfold_ref.hpp - reference kernel for --verify
+ *
+ * A serial copy of the C/M, F and F2 recursions as they were before any
+ * kernel optimisation; --verify (CDSfold_verify.hpp) runs it next to the
+ * kernels in CDSfold_fill.hpp. Change it only where the recurrences
+ * themselves change (a new energy term, a bug in both kernels) or where
+ * fold_context does (renamed or moved fields), in the plain serial form.
+ * No optimisations, and no comparison rules: those go in the verifier.
+ */
+
+#ifndef CDSFOLD_REF_H_
+#define CDSFOLD_REF_H_
+
+void ref_fill_short_cells(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const vector<vector<int> > &Dep2 = ctx.Dep2;
+	const vector<int> &NucConst = ctx.NucConst;
+	const int NCflg = ctx.NCflg;
+	const int DEPflg = ctx.DEPflg;
+	const bool rand_tb_flg = ctx.rand_tb_flg;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	int ***C = ctx.C, ***M = ctx.M, ***F2 = ctx.F2;
+	int *chkC = ctx.chkC, *chkM = ctx.chkM;
+
+	for (int l = 2; l <= 4; l++) {
+		for (int i = 1; i <= nuclen - l + 1; i++) {
+			int j = i + l - 1;
+			int ij = getIndx(i, j, w_tmp, indx);
+
+			chkC[ij] = INF;
+			chkM[ij] = INF;
+
+			for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
+				int L_nuc = pos2nuc[i][L];
+				if(NCflg == 1 && i2r[L_nuc] != NucConst[i]){	continue;}
+				for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
+					int R_nuc = pos2nuc[j][R];
+					if(NCflg == 1 && i2r[R_nuc] != NucConst[j]){	continue;}
+					if(DEPflg && j-i == 1 && i <= nuclen - 1 && Dep1[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;} // nuclen - 1はいらないのでは？
+					if(DEPflg && j-i == 2 && i <= nuclen - 2 && Dep2[ii2r[L_nuc*10+R_nuc]][i] == 0){continue;}
+
+					C[ij][L][R] = INF;
+					M[ij][L][R] = INF;
+					if(rand_tb_flg)
+						F2[ij][L][R] = 0;
+
+				}
+			}
+		}
+	}
+}
+
+void ref_fill_diagonal(fold_context &ctx, const int l){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<int> &band_lo = ctx.band_lo;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const vector<vector<int> > &Dep2 = ctx.Dep2;
+	const vector<vector<vector<string> > > &substr = ctx.substr;
+	map<string, int> &predefHPN_E = ctx.predefHPN_E;
+	map<char, int> &n2i = ctx.n2i;
+	const vector<int> &NucConst = ctx.NucConst;
+	const char *NucDef = ctx.NucDef;
+	const int NCflg = ctx.NCflg;
+	const int DEPflg = ctx.DEPflg;
+	const int TEST = ctx.TEST;
+	const bool part_opt_flg = ctx.part_opt_flg;
+	const int n_inter = ctx.n_inter;
+	const int *ofm = ctx.ofm;
+	const int *oto = ctx.oto;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	paramT *P = ctx.P;
+	int ***C = ctx.C, ***M = ctx.M;
+	int ***DMl = ctx.DMl, ***DMl2 = ctx.DMl2;
+	int *chkC = ctx.chkC, *chkM = ctx.chkM;
+	const char dummy_str[10] = "XXXXXXXXX";
+
+	for (int i = 1; i <= nuclen - l + 1; i++) {
+		int j = i + l - 1;
+		if(i < band_lo[j]) continue;
+
+		int opt_flg_ij = 1;
+		if(part_opt_flg){
+			for(int I = 0; I < n_inter; I++){
+				if((ofm[I] <= i && oto[I] >= i) ||
+						(ofm[I] <= j && oto[I] >= j)){
+					opt_flg_ij = 0;
+					break;
+				}
+			}
+		}
+
+		for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
+			int L_nuc = pos2nuc[i][L];
+			if(NCflg == 1 && i2r[L_nuc] != NucConst[i]){	continue;}
+
+			for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
+
+				int R_nuc = pos2nuc[j][R];
+
+				if(NCflg == 1 && i2r[R_nuc] != NucConst[j]){	continue;}
+
+				int ij = getIndx(i,j,w_tmp,indx);
+
+				C[ij][L][R] = INF;
+				M[ij][L][R] = INF;
+
+				int type = BP_pair[i2r[L_nuc]][i2r[R_nuc]];
+
+				if (type && opt_flg_ij) {
+					if((l == 5 || l ==6 || l == 8) && TEST){
+						for(unsigned int s = 0; s < substr[i][l].size(); s++){
+							string hpn = substr[i][l][s];
+							int hL_nuc  = n2i[hpn[0]];
+							int hL2_nuc = n2i[hpn[1]];
+							int hR2_nuc = n2i[hpn[l-2]];
+							int hR_nuc  = n2i[hpn[l-1]];
+							if(hL_nuc != i2r[L_nuc]) continue;
+							if(hR_nuc != i2r[R_nuc]) continue;
+
+							if(NCflg == 1){
+								string s1 = string(NucDef).substr(i, l);
+								if(hpn != s1) continue;
+							}
+
+							if(DEPflg && L_nuc > 4 && Dep1[ii2r[L_nuc*10+hL2_nuc]][i] == 0){continue;}   // Dependencyをチェックした上でsubstringを求めているので, hpnの内部についてはチェックする必要はない。
+							if(DEPflg && R_nuc > 4 && Dep1[ii2r[hR2_nuc*10+R_nuc]][j-1] == 0){continue;} // ただし、L_nuc、R_nucがVWXYのときだけは、一つ内側との依存関係をチェックする必要がある。
+							if(predefHPN_E.count(hpn) > 0){
+								C[ij][L][R] = MIN2(predefHPN_E[hpn], C[ij][L][R]);
+
+							}
+							else{
+								int energy = E_hairpin(j - i - 1, type,
+										i2r[hL2_nuc], i2r[hR2_nuc],
+										dummy_str, P);
+								C[ij][L][R] = MIN2(energy, C[ij][L][R]);
+							}
+						}
+					}
+					else{
+						for (unsigned int L2 = 0;
+								L2 < pos2nuc[i + 1].size(); L2++) {
+							int L2_nuc = pos2nuc[i + 1][L2];
+							if(NCflg == 1 && i2r[L2_nuc] != NucConst[i+1]){	continue;}
+							for (unsigned int R2 = 0;
+									R2 < pos2nuc[j - 1].size(); R2++) {
+								int R2_nuc = pos2nuc[j - 1][R2];
+								if(NCflg == 1 && i2r[R2_nuc] != NucConst[j-1]){	continue;}
+
+								if(DEPflg && Dep1[ii2r[L_nuc*10+L2_nuc]][i] == 0){continue;}
+								if(DEPflg && Dep1[ii2r[R2_nuc*10+R_nuc]][j-1] == 0){continue;}
+
+								int energy;
+								energy = E_hairpin(j - i - 1, type,
+										i2r[L2_nuc], i2r[R2_nuc],
+										dummy_str, P);
+								C[ij][L][R] = MIN2(energy, C[ij][L][R]);
+
+							}
+
+						}
+					}
+
+					for (int p = i + 1;
+							p <= MIN2(j-2-TURN, i+MAXLOOP+1); p++) { // loop for position q, p
+						int minq = j - i + p - MAXLOOP - 2;
+						if (minq < p + 1 + TURN)
+							minq = p + 1 + TURN;
+						for (int q = minq; q < j; q++) {
+
+							int pq = getIndx(p,q,w_tmp, indx);
+
+							for (unsigned int Lp = 0;
+									Lp < pos2nuc[p].size(); Lp++) {
+								int Lp_nuc = pos2nuc[p][Lp];
+								if(NCflg == 1 && i2r[Lp_nuc] != NucConst[p]){	continue;}
+
+								if(DEPflg && p == i + 1 && Dep1[ii2r[L_nuc*10+Lp_nuc]][i] == 0){ continue;}
+								if(DEPflg && p == i + 2 && Dep2[ii2r[L_nuc*10+Lp_nuc]][i] == 0){ continue;}
+
+								for (unsigned int Rq = 0;
+										Rq < pos2nuc[q].size(); Rq++) { // nucleotide for p, q
+									int Rq_nuc = pos2nuc[q][Rq];
+									if(NCflg == 1 && i2r[Rq_nuc] != NucConst[q]){	continue;}
+
+									if(DEPflg && q == j - 1 && Dep1[ii2r[Rq_nuc*10+R_nuc]][q] == 0){ continue;}
+									if(DEPflg && q == j - 2 && Dep2[ii2r[Rq_nuc*10+R_nuc]][q] == 0){ continue;}
+
+									int type_2 =
+											BP_pair[i2r[Lp_nuc]][i2r[Rq_nuc]];
+
+									if (type_2 == 0)
+										continue;
+									type_2 = rtype[type_2];
+
+									for (unsigned int L2 = 0;
+											L2 < pos2nuc[i + 1].size();
+											L2++) { // nucleotide for i+1,j-1
+										int L2_nuc = pos2nuc[i + 1][L2];
+										if(NCflg == 1 && i2r[L2_nuc] != NucConst[i+1]){	continue;}
+
+										if(DEPflg && Dep1[ii2r[L_nuc*10+L2_nuc]][i] == 0){ continue;}
+
+										for (unsigned int R2 = 0;
+												R2
+														< pos2nuc[j - 1].size();
+												R2++) {
+											int R2_nuc =
+													pos2nuc[j - 1][R2];
+											if(NCflg == 1 && i2r[R2_nuc] != NucConst[j-1]){	continue;}
+
+											if(DEPflg && Dep1[ii2r[R2_nuc*10+R_nuc]][j-1] == 0){ continue;}
+
+											for (unsigned int Lp2 = 0;
+													Lp2
+															< pos2nuc[p
+																	- 1].size();
+													Lp2++) { // nucleotide for p-1,q+1
+												int Lp2_nuc = pos2nuc[p
+														- 1][Lp2];
+												if(NCflg == 1 && i2r[Lp2_nuc] != NucConst[p-1]){ continue;}
+
+												if(DEPflg && Dep1[ii2r[Lp2_nuc*10+Lp_nuc]][p-1] == 0){ continue;}
+												if(p == i + 2 && L2_nuc != Lp2_nuc){ continue; } // check when a single nucleotide between i and p, this sentence confirm the dependency between Li_nuc and Lp2_nuc
+												if(DEPflg && i + 3 == p && Dep1[ii2r[L2_nuc*10+Lp2_nuc]][i+1] == 0){ continue;} // check dependency between i+1, p-1 (i,X,X,p)
+
+												for (unsigned int Rq2 =
+														0;
+														Rq2
+																< pos2nuc[q
+																		+ 1].size();
+														Rq2++) {
+													int Rq2_nuc =
+															pos2nuc[q
+																	+ 1][Rq2];
+													if(q == j - 2 && R2_nuc != Rq2_nuc){ continue; } // check when a single nucleotide between q and j,this sentence confirm the dependency between Rj_nuc and Rq2_nuc
+
+													if(NCflg == 1 && i2r[Rq2_nuc] != NucConst[q+1]){	continue;}
+
+													if(DEPflg && Dep1[ii2r[Rq_nuc*10+Rq2_nuc]][q] == 0){ continue;}
+													if(DEPflg && q + 3 == j && Dep1[ii2r[Rq2_nuc*10+R2_nuc]][q+1] == 0){ continue;} // check dependency between q+1, j-1 (q,X,X,j)
+
+													int int_energy =
+															E_intloop(
+																	p
+																	- i
+																	- 1,
+																	j
+																	- q
+																	- 1,
+																	type,
+																	type_2,
+																	i2r[L2_nuc],
+																	i2r[R2_nuc],
+																	i2r[Lp2_nuc],
+																	i2r[Rq2_nuc],
+																	P);
+
+													int energy =
+															int_energy
+															+ C[pq][Lp][Rq];
+													C[ij][L][R] =
+															MIN2(energy,
+																	C[ij][L][R]);
+
+												}
+
+											}
+										}
+									}
+								}
+							}
+						} /* end q-loop */
+					} /* end p-loop */
+
+					for (unsigned int Li1 = 0;
+							Li1 < pos2nuc[i + 1].size(); Li1++) {
+						int Li1_nuc = pos2nuc[i+1][Li1];
+						if(NCflg == 1 && i2r[Li1_nuc] != NucConst[i+1]){	continue;}
+
+						if(DEPflg && Dep1[ii2r[L_nuc*10+Li1_nuc]][i] == 0){ continue;}
+
+						for (unsigned int Rj1 = 0;
+								Rj1 < pos2nuc[j - 1].size(); Rj1++) {
+							int Rj1_nuc = pos2nuc[j-1][Rj1];
+							if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j-1]){	continue;}
+
+							if(DEPflg && Dep1[ii2r[Rj1_nuc*10+R_nuc]][j-1] == 0){ continue;}
+							if(DEPflg && (j-1)-(i+1) == 2 && Dep2[ii2r[Li1_nuc*10+Rj1_nuc]][i+1] == 0){continue;} // 2014/10/8 i-jが近いときは、MLclosingする必要はないのでは。少なくとも3つのステムが含まれなければならない。それには、５＋５＋２（ヘアピン2個分＋2塩基）の長さが必要。
+
+							int energy = DMl2[i+1][Li1][Rj1]; // 長さが2個短いときの、複合マルチループ。i'=i+1を選ぶと、j'=(i+1)+(l-2)-1=i+l-2=j-1(because:j=i+l-1)
+							int tt = rtype[type];
+
+							energy += P->MLintern[tt];
+							if(tt > 2)
+								energy += P->TerminalAU;
+
+							energy += P->MLclosing;
+							C[ij][L][R] =
+									MIN2(energy,
+											C[ij][L][R]);
+
+						}
+					}
+
+				}
+
+				else C[ij][L][R] = INF;
+
+				if(type){
+			        int energy_M = C[ij][L][R];
+			        if(type > 2)
+			          energy_M += P->TerminalAU;
+
+			        energy_M += P->MLintern[type];
+			        M[ij][L][R] = energy_M;
+				}
+
+				for (unsigned int Li1 = 0;
+						Li1 < pos2nuc[i + 1].size(); Li1++) {
+					int Li1_nuc = pos2nuc[i + 1][Li1];
+					if(NCflg == 1 && i2r[Li1_nuc] != NucConst[i + 1]){	continue;}
+					if(DEPflg && Dep1[ii2r[L_nuc*10+Li1_nuc]][i] == 0){ continue;}
+
+					int energy_M = M[getIndx(i+1, j, w_tmp, indx)][Li1][R]+P->MLbase;
+			        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+				}
+
+				for (unsigned int Rj1 = 0;
+						Rj1 < pos2nuc[j - 1].size(); Rj1++) {
+					int Rj1_nuc = pos2nuc[j - 1][Rj1];
+					if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j - 1]){	continue;}
+					if(DEPflg && Dep1[ii2r[Rj1_nuc*10+R_nuc]][j-1] == 0){ continue;}
+
+					int energy_M = M[getIndx(i,j-1, w_tmp,indx)][L][Rj1]+P->MLbase;
+			        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+				}
+
+				/* modular decomposition -------------------------------*/
+				for (int k = i + 2 + TURN; k <= j - TURN - 1; k++) { // Is this correct?
+					for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
+							Rk1++) {
+						int Rk1_nuc = pos2nuc[k-1][Rk1];
+						if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
+
+						for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
+								Lk++) {
+							int Lk_nuc = pos2nuc[k][Lk];
+							if(NCflg == 1 && i2r[Lk_nuc] != NucConst[k]){	continue;}
+							if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
+
+							int energy_M =  M[getIndx(i,k-1,w_tmp,indx)][L][Rk1]+M[getIndx(k,j,w_tmp,indx)][Lk][R];
+							DMl[i][L][R] = MIN2(energy_M, DMl[i][L][R]);
+					        M[ij][L][R] = MIN2(energy_M, M[ij][L][R]);
+
+						}
+					}
+				}
+
+					chkC[ij] = MIN2(chkC[ij], C[ij][L][R]);
+					chkM[ij] = MIN2(chkM[ij], M[ij][L][R]);
+			}
+		}
+	}
+}
+
+void ref_fill_CM(fold_context &ctx){
+	ref_fill_short_cells(ctx);
+
+	for (int l = 5; l <= ctx.nuclen; l++) {
+		if(l > ctx.w) break;
+
+		ref_fill_diagonal(ctx, l);
+
+		int ***FF;
+		FF = ctx.DMl2; ctx.DMl2 = ctx.DMl1; ctx.DMl1 = ctx.DMl; ctx.DMl = FF;
+		for(int j = 1; j <= ctx.nuclen; j++){
+			for(unsigned int L = 0; L < 4; L++){
+				fill(ctx.DMl[j][L], ctx.DMl[j][L]+4,INF);
+			}
+		}
+	}
+}
+
+void ref_fill_F(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<int> &band_lo = ctx.band_lo;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const vector<vector<int> > &Dep2 = ctx.Dep2;
+	const vector<int> &NucConst = ctx.NucConst;
+	const int NCflg = ctx.NCflg;
+	const int DEPflg = ctx.DEPflg;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	paramT *P = ctx.P;
+	int ***C = ctx.C, ***F = ctx.F;
+
+	for (unsigned int L = 0; L < pos2nuc[1].size(); L++) {
+		for (unsigned int R = 0; R < pos2nuc[1].size(); R++) {
+			F[1][L][R] = 0;
+		}
+	}
+
+	for (unsigned int L1 = 0; L1 < pos2nuc[1].size(); L1++) {
+		int L1_nuc = pos2nuc[1][L1];
+		if(NCflg == 1 && i2r[L1_nuc] != NucConst[1]){	continue;}
+
+		for (int j = 2; j <= nuclen; j++) {
+
+			for (unsigned int Rj = 0; Rj < pos2nuc[j].size(); Rj++) {
+				int Rj_nuc = pos2nuc[j][Rj];
+				if(NCflg == 1 && i2r[Rj_nuc] != NucConst[j]){	continue;}
+
+				if(DEPflg && j == 2 && Dep1[ii2r[L1_nuc*10+Rj_nuc]][1] == 0){ continue;}
+				if(DEPflg && j == 3 && Dep2[ii2r[L1_nuc*10+Rj_nuc]][1] == 0){ continue;}
+
+				F[j][L1][Rj] = INF;
+
+				int type_L1Rj = BP_pair[i2r[L1_nuc]][i2r[Rj_nuc]];
+				if (type_L1Rj) {
+						int au_penalty = 0;
+						if (type_L1Rj > 2)
+							au_penalty = P->TerminalAU;
+						if(band_lo[j] == 1)
+							F[j][L1][Rj] = MIN2(F[j][L1][Rj], C[getIndx(1,j,w_tmp,indx)][L1][Rj] + au_penalty); // recc 1
+				}
+
+				for (unsigned int Rj1 = 0; Rj1 < pos2nuc[j - 1].size();
+						Rj1++) {
+					int Rj1_nuc = pos2nuc[j-1][Rj1];
+					if(NCflg == 1 && i2r[Rj1_nuc] != NucConst[j-1]){	continue;}
+					if(DEPflg && Dep1[ii2r[Rj1_nuc*10+Rj_nuc]][j-1] == 0){ continue;}
+
+					F[j][L1][Rj] = MIN2(F[j][L1][Rj], F[j - 1][L1][Rj1]); // recc 2
+				}
+
+				for (int k = MAX2(2, band_lo[j]); k <= j - TURN - 1; k++) { // Is this correct?
+
+					for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
+							Rk1++) {
+						int Rk1_nuc = pos2nuc[k-1][Rk1];
+						if(NCflg == 1 && i2r[Rk1_nuc] != NucConst[k - 1]){	continue;}
+						if(DEPflg && k == 3 && Dep1[ii2r[L1_nuc*10+Rk1_nuc]][1] == 0){ continue;} // dependency between 1(i) and 2(k-1)
+						if(DEPflg && k == 4 && Dep2[ii2r[L1_nuc*10+Rk1_nuc]][1] == 0){ continue;} // dependency between 1(i) and 3(k-1)
+
+						for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
+								Lk++) {
+							int Lk_nuc = pos2nuc[k][Lk];
+							if(NCflg == 1 && i2r[Lk_nuc] != NucConst[k]){	continue;}
+
+							if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k-1 and k
+
+							int type_LkRj =
+									BP_pair[i2r[Lk_nuc]][i2r[Rj_nuc]];
+
+							int au_penalty = 0;
+							if (type_LkRj > 2)
+								au_penalty = P->TerminalAU;
+							int kj = getIndx(k,j,w_tmp,indx);
+
+							int energy = F[k - 1][L1][Rk1] + C[kj][Lk][Rj]
+									+ au_penalty; // recc 4
+
+							F[j][L1][Rj] = MIN2(F[j][L1][Rj], energy);
+						}
+
+					}
+				}
+
+			}
+		}
+	}
+}
+
+void ref_fill_F2(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const int w_tmp = ctx.w;
+	int *const indx = ctx.indx;
+	const vector<int> &band_lo = ctx.band_lo;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	const vector<vector<int> > &Dep1 = ctx.Dep1;
+	const int DEPflg = ctx.DEPflg;
+	const int *i2r = ctx.i2r;
+	const int *ii2r = ctx.ii2r;
+	paramT *P = ctx.P;
+	int ***C = ctx.C, ***F2 = ctx.F2;
+
+	for (int l = 5; l <= nuclen; l++) {
+		if(l > w_tmp) break;
+
+		for (int i = 1; i <= nuclen - l + 1; i++) {
+			int j = i + l - 1;
+			if(i < band_lo[j]) continue;
+
+			for (unsigned int L = 0; L < pos2nuc[i].size(); L++) {
+				int L_nuc = pos2nuc[i][L];
+
+				for (unsigned int R = 0; R < pos2nuc[j].size(); R++) {
+					int R_nuc = pos2nuc[j][R];
+					int ij = getIndx(i,j,w_tmp,indx);
+
+					F2[ij][L][R] = 0;
+
+					int type = BP_pair[i2r[L_nuc]][i2r[R_nuc]];
+
+					for (unsigned int R1 = 0; R1 < pos2nuc[j-1].size(); R1++) {
+						int R1_nuc = pos2nuc[j-1][R1];
+						if(DEPflg && Dep1[ii2r[R1_nuc*10+R_nuc]][j-1] == 0){continue;}
+						int ij1 = getIndx(i,j-1,w_tmp,indx);
+						F2[ij][L][R] = MIN2(F2[ij][L][R], F2[ij1][L][R1]);
+					}
+					for (unsigned int L1 = 0; L1 < pos2nuc[i+1].size(); L1++) {
+						int L1_nuc = pos2nuc[i+1][L1];
+						if(DEPflg && Dep1[ii2r[L_nuc*10+L1_nuc]][i] == 0){continue;}
+						int i1j = getIndx(i+1,j,w_tmp,indx);
+						F2[ij][L][R] = MIN2(F2[ij][L][R], F2[i1j][L1][R]);
+					}
+
+					int au_penalty = 0;
+					if (type > 2)
+						au_penalty = P->TerminalAU;
+					if(j - i + 1 <= w_tmp){
+						F2[ij][L][R] = MIN2(F2[ij][L][R], C[ij][L][R] + au_penalty);
+					}
+
+					/* modular decomposition -------------------------------*/
+					for (int k = i + 2 + TURN; k <= j - TURN - 1; k++) { // Is this correct?
+
+						for (unsigned int Rk1 = 0; Rk1 < pos2nuc[k - 1].size();
+								Rk1++) {
+							int Rk1_nuc = pos2nuc[k-1][Rk1];
+
+							for (unsigned int Lk = 0; Lk < pos2nuc[k].size();
+									Lk++) {
+								int Lk_nuc = pos2nuc[k][Lk];
+								if(DEPflg && Dep1[ii2r[Rk1_nuc*10+Lk_nuc]][k-1] == 0){ continue;} // dependency between k - 1 and k
+
+								int energy =  F2[getIndx(i,k-1,w_tmp,indx)][L][Rk1]+F2[getIndx(k,j,w_tmp,indx)][Lk][R];
+								F2[ij][L][R] = MIN2(F2[ij][L][R], energy);
+
+							}
+						}
+					}
+
+				}
+			}
+		}
+	}
+}
+
+#endif /* CDSFOLD_REF_H_ */
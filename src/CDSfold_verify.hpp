@@ -0,0 +1,194 @@
+/*
+ * CDSfold_verify.hpp - --verify
+ *
+ * Runs the reference kernel (CDSfold_ref.hpp) on a copy of a record's
+ * inputs and compares its matrices, MFE and design with those of the fast
+ * kernels. What counts as equal is decided here.
+ */
+
+#ifndef CDSFOLD_VERIFY_H_
+#define CDSFOLD_VERIFY_H_
+
+// Discards the trace output of the reference backtrack.
+class null_streambuf : public streambuf {
+protected:
+	int overflow(int c){ return c; }
+	streamsize xsputn(const char *, streamsize n){ return n; }
+};
+
+// Sets every allocated C/M/F (and F2) entry to INF, so that entries a
+// kernel never writes compare equal between the two runs.
+void clear_matrices(fold_context &ctx){
+	const int nuclen = ctx.nuclen;
+	const vector<vector<int> > &pos2nuc = ctx.pos2nuc;
+	for(int i = 1; i <= nuclen; i++){
+		for(int j = i; j <= ctx.band_hi[i]; j++){
+			int ij = getIndx(i, j, ctx.w, ctx.indx);
+			for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
+				if(ctx.C[ij])
+					fill(ctx.C[ij][L], ctx.C[ij][L] + pos2nuc[j].size(), INF);
+				fill(ctx.M[ij][L], ctx.M[ij][L] + pos2nuc[j].size(), INF);
+				if(ctx.rand_tb_flg)
+					fill(ctx.F2[ij][L], ctx.F2[ij][L] + pos2nuc[j].size(), INF);
+			}
+		}
+		for(unsigned int L = 0; L < pos2nuc[1].size(); L++){
+			fill(ctx.F[i][L], ctx.F[i][L] + pos2nuc[i].size(), INF);
+		}
+	}
+}
+
+// Entries at or above INF/2 are unreachable. Their exact value depends on
+// which INF operands a kernel adds up (the sparse split skips some), so
+// they only need to be unreachable in both.
+inline bool same_entry(int fast, int ref){
+	return fast == ref || (fast >= INF / 2 && ref >= INF / 2);
+}
+
+// Compares C/M (and F2) of two contexts cell by cell. All cells when
+// sample == 0, otherwise `sample` randomly chosen (i,j) cells.
+// Returns the number of mismatching entries; the first few are printed.
+long verify_cells(const fold_context &fast, const fold_context &ref, long sample, long &compared){
+	const int nuclen = fast.nuclen;
+	const int w = fast.w;
+	const vector<vector<int> > &pos2nuc = fast.pos2nuc;
+	const vector<int> &band_hi = fast.band_hi;
+	long bad = 0;
+	compared = 0;
+
+	cell_view fastC(fast.C, fast.packC);
+	auto check = [&](int i, int j){
+		int ij = getIndx(i, j, w, fast.indx);
+		for(unsigned int L = 0; L < pos2nuc[i].size(); L++){
+			for(unsigned int R = 0; R < pos2nuc[j].size(); R++){
+				const char *name[3] = {"C", "M", "F2"};
+				int a[3] = {fastC[ij][L][R], fast.M[ij][L][R], 0};
+				int b[3] = {ref.C[ij][L][R], ref.M[ij][L][R], 0};
+				int n = 2;
+				if(fast.rand_tb_flg){
+					a[2] = fast.F2[ij][L][R];
+					b[2] = ref.F2[ij][L][R];
+					n = 3;
+				}
+				for(int k = 0; k < n; k++){
+					compared++;
+					if(!same_entry(a[k], b[k])){
+						if(bad < 10)
+							cerr << "verify: " << name[k] << "[" << i << "," << j << "][" << L << "][" << R
+							     << "] fast=" << a[k] << " reference=" << b[k] << endl;
+						bad++;
+					}
+				}
+			}
+		}
+	};
+
+	if(sample == 0){
+		for(int i = 1; i <= nuclen; i++)
+			for(int j = i; j <= band_hi[i]; j++)
+				check(i, j);
+	}
+	else{
+		mt19937 rng(rand_seed ? rand_seed : 12345);
+		for(long s = 0; s < sample; s++){
+			int i = 1 + rng() % nuclen;
+			int j = i + rng() % (band_hi[i] - i + 1);
+			check(i, j);
+		}
+	}
+
+	for(int j = 1; j <= nuclen; j++){
+		for(unsigned int L = 0; L < pos2nuc[1].size(); L++){
+			for(unsigned int R = 0; R < pos2nuc[j].size(); R++){
+				compared++;
+				if(!same_entry(fast.F[j][L][R], ref.F[j][L][R])){
+					if(bad < 10)
+						cerr << "verify: F[" << j << "][" << L << "][" << R << "] fast=" << fast.F[j][L][R]
+						     << " reference=" << ref.F[j][L][R] << endl;
+					bad++;
+				}
+			}
+		}
+	}
+	return bad;
+}
+
+// Runs the reference kernel on a copy of the inputs of `fast` and compares
+// matrices, MFE and design with the fast result. Exits with status 3 on
+// any difference.
+void verify_record(const fold_context &fast, const string &optseq, const int MFE, const long sample){
+	fold_context ref = fast;
+	ref.packC = nullptr;
+	const int nuclen = ref.nuclen;
+	const int w = ref.w;
+
+	// the reference run must not add to the normal output
+	null_streambuf nb;
+	streambuf *orig = redirect_cout(&nb);
+
+	allocate_arrays(nuclen, ref.indx, ref.band_hi, w, ref.pos2nuc, &ref.C, &ref.M, &ref.F, &ref.DMl, &ref.DMl1, &ref.DMl2, &ref.chkC, &ref.chkM, &ref.base_pair);
+	if(ref.rand_tb_flg)
+		allocate_F2(nuclen, ref.indx, ref.band_hi, w, ref.pos2nuc, &ref.F2);
+	clear_matrices(ref);
+
+	ref_fill_CM(ref);
+	ref_fill_F(ref);
+	int minL = 0, minR = 0;
+	int ref_MFE = find_mfe(ref, minL, minR);
+	if(ref.rand_tb_flg)
+		ref_fill_F2(ref);
+
+	long compared = 0;
+	long bad = verify_cells(fast, ref, sample, compared);
+	if(ref_MFE != MFE){
+		cerr << "verify: MFE fast=" << MFE << " reference=" << ref_MFE << endl;
+		bad++;
+	}
+
+	// -R traces back randomly; the designs are only comparable with --seed
+	bool design_checked = ref_MFE != INF && (!ref.rand_tb_flg || rand_seed != 0);
+	if(design_checked){
+		string ref_seq;
+		ref_seq.resize(nuclen+1, 'N');
+		ref_seq[0] = ' ';
+		vector<stack> sector(500);
+		vector<vector<vector<vector<pair<int, string> > > > > predefHPN;
+		if(ref.rand_tb_flg){
+			backtrack2(&ref_seq, sector.data(), ref.base_pair, ref.C, ref.M, ref.F2,
+					ref.indx, ref.band_lo, minL, minR, ref.P, ref.NucConst, ref.pos2nuc, ref.NCflg, ref.i2r, nuclen, w, BP_pair, ref.i2n, rtype, ref.ii2r, ref.Dep1, ref.Dep2, ref.DEPflg, predefHPN, ref.predefHPN_E, ref.substr, ref.n2i, ref.NucDef);
+		}
+		else{
+			backtrack(&ref_seq, sector.data(), ref.base_pair, ref.C, ref.M, ref.F,
+					ref.indx, ref.band_lo, minL, minR, ref.P, ref.NucConst, ref.pos2nuc, ref.NCflg, ref.i2r, nuclen, w, BP_pair, ref.i2n, rtype, ref.ii2r, ref.Dep1, ref.Dep2, ref.DEPflg, predefHPN, ref.predefHPN_E, ref.substr, ref.n2i, ref.NucDef, ref.nuc_cost, ref.loop_cost);
+		}
+
+		if(ref_seq != optseq){
+			size_t k = 0;
+			while(k < optseq.size() && ref_seq[k] == optseq[k]) k++;
+			cerr << "verify: designed sequence differs at position " << k << endl;
+			bad++;
+		}
+		bool same_pairs = ref.base_pair[0].i == fast.base_pair[0].i;
+		for(int k = 1; same_pairs && k <= ref.base_pair[0].i; k++){
+			same_pairs = ref.base_pair[k].i == fast.base_pair[k].i && ref.base_pair[k].j == fast.base_pair[k].j;
+		}
+		if(!same_pairs){
+			cerr << "verify: structure differs" << endl;
+			bad++;
+		}
+	}
+
+	free_arrays(nuclen, ref.indx, ref.band_hi, w, ref.pos2nuc, &ref.C, &ref.M, &ref.F, &ref.DMl, &ref.DMl1, &ref.DMl2, &ref.chkC, &ref.chkM, &ref.base_pair);
+	if(ref.rand_tb_flg)
+		free_F2(nuclen, ref.indx, ref.band_hi, w, ref.pos2nuc, &ref.F2);
+	redirect_cout(orig);
+
+	if(bad){
+		cerr << "VERIFY FAILED: " << bad << " difference(s) between the fast and the reference kernel" << endl;
+		exit(3);
+	}
+	cerr << "verify: ok (" << compared << " entries" << (sample ? " sampled" : "")
+	     << ", MFE " << MFE << (design_checked ? ", design identical" : ", design not compared") << ")" << endl;
+}
+
+#endif /* CDSFOLD_VERIFY_H_ */
@@ -0,0 +1,223 @@
+/*
+ * CodonCost.hpp - additive per-codon cost in the design objective
+ * (--codon-cost table.tsv --lambda x)
+ *
+ * The objective becomes MFE + lambda * (sum of the codon costs), in
+ * kcal/mol. The DP fixes the nucleotides of base pairs, so the cost of a
+ * codon is split over its positions: nucleotide n at a position costs the
+ * cheapest codon of the residue with n there, minus the cheapest codon of
+ * the residue (V/W count as U, X/Y as G). Every nucleotide the recursions
+ * fix is charged: C(i,j) for i and j and for the bases of hairpins and
+ * interior loops, M and F for their unpaired ends. Positions the traceback
+ * leaves open then take the cheapest codon that agrees with the fixed
+ * ones, and the cost printed is the table sum of the final design. The
+ * split is exact per nucleotide but only approximates the per-codon sum,
+ * so the design is not guaranteed to minimise the combined objective.
+ *
+ * Table: one "codon<TAB>cost" per line (T or U, any case), '#' comments.
+ * Codons missing from the table cost 0.
+ */
+
+#ifndef CODONCOST_H_
+#define CODONCOST_H_
+
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// nuc_cost: cost in dcal/mol of nucleotide code 1..8 (ACGUVWXY) at
+// position i, indexed [i][code]; empty without --codon-cost. Needs codon.hpp.
+inline int pair_cost(const vector<array<int, 9> > &nuc_cost, int i, int Li_nuc, int j, int Rj_nuc){
+	if(nuc_cost.empty())
+		return 0;
+	return nuc_cost[i][Li_nuc] + nuc_cost[j][Rj_nuc];
+}
+
+// Terms of position i by nucleotide code; all zero when cost is empty.
+inline const int *nuc_row(const vector<array<int, 9> > &cost, int i){
+	static const array<int, 9> zero = {};
+	return cost.empty()? zero.data() : cost[i].data();
+}
+
+struct codon_costs {
+	map<string, double> cost;
+	double lambda = 1;
+
+	// Returns an error message, empty on success.
+	string load(const string &fname){
+		ifstream in(fname.c_str());
+		if(!in)
+			return "cannot open " + fname;
+		string line;
+		for(int ln = 1; getline(in, line); ln++){
+			if(line.empty() || line[0] == '#')
+				continue;
+			stringstream ss(line);
+			string c;
+			double v;
+			if(!(ss >> c))
+				continue;
+			if(!(ss >> v) || c.size() != 3)
+				return fname + ":" + to_string(ln) + ": expected \"codon<TAB>cost\"";
+			for(char &x : c){
+				x = toupper(x);
+				if(x == 'T')
+					x = 'U';
+				if(x != 'A' && x != 'C' && x != 'G' && x != 'U')
+					return fname + ":" + to_string(ln) + ": bad codon " + c;
+			}
+			cost[c] = v;
+		}
+		return "";
+	}
+
+	double of(const string &c) const {
+		map<string, double>::const_iterator it = cost.find(c);
+		return it == cost.end() ? 0 : it->second;
+	}
+
+	// lambda-weighted cost of a designed CDS (ACGU, 0-based)
+	double design(const string &seq) const {
+		double sum = 0;
+		for(size_t p = 0; p + 3 <= seq.size(); p += 3)
+			sum += of(seq.substr(p, 3));
+		return lambda * sum;
+	}
+};
+
+// Nucleotide of an extended code letter (V/W -> U, X/Y -> G)
+inline char codon_real_nuc(char c){
+	switch(c){
+	case 'V': case 'W': return 'U';
+	case 'X': case 'Y': return 'G';
+	default: return c;
+	}
+}
+
+// Fills nuc_cost for the protein (1-based nucleotide positions).
+void set_nuc_cost(vector<array<int, 9> > &nuc_cost, const codon_costs &cc, codon &codon_table, const string &exc, const char *aaseq, int aalen){
+	static const char codes[] = " ACGUVWXY";
+	nuc_cost.assign(3 * aalen + 1, array<int, 9>());
+	for(int k = 0; k < aalen; k++){
+		vector<string> cand = codon_table.getCodons(aaseq[k], exc);
+		double best = INFINITY;
+		for(const string &c : cand)
+			best = min(best, cc.of(c));
+		for(int o = 0; o < 3; o++){
+			array<int, 9> &pc = nuc_cost[3 * k + o + 1];
+			for(int n = 1; n <= 8; n++){
+				double m = INFINITY;
+				for(const string &c : cand)
+					if(c[o] == codon_real_nuc(codes[n]))
+						m = min(m, cc.of(c));
+				// nucleotides the residue cannot use never reach the DP
+				pc[n] = isinf(m) ? 0 : (int)lround(100 * cc.lambda * (m - best));
+			}
+		}
+	}
+}
+
+// Sets the 'N' positions of each run of open codons to the cheapest codons,
+// by cost(residue, codon), that agree with the nucleotides already fixed
+// and chain through Dep1, inside the codons and across their boundaries
+// (Dep1 also carries the --forbid-motifs blocks). A run without such a
+// chain is left to the generic fix-up. optseq is 1-based.
+void fill_open_codons(string &optseq, const function<double(int, const string &)> &cost, codon &codon_table, const string &exc, const char *aaseq, int aalen,
+		const vector<vector<int> > &Dep1, const int *ii2r){
+	static const string codes = " ACGUVWXY";
+	const int n = 3 * aalen;
+	auto open = [&](int k){
+		const int p = 3 * k + 1;
+		return optseq[p] == 'N' || optseq[p + 1] == 'N' || optseq[p + 2] == 'N';
+	};
+	// code of nucleotide o of codon c as pos2nuc has it (U/G of L/R are V-Y)
+	auto code = [&](char aa, const string &c, int o){
+		char x = c[o];
+		if(o == 1 && (aa == 'L' || aa == 'R')){
+			const bool purine = c[2] == 'A' || c[2] == 'G';
+			x = (aa == 'L') ? (purine ? 'V' : 'W') : (purine ? 'X' : 'Y');
+		}
+		return (int)codes.find(x);
+	};
+	auto allowed = [&](int x, int y, int q){
+		return Dep1[ii2r[x * 10 + y]][q] != 0;
+	};
+	for(int k0 = 0; k0 < aalen; k0++){
+		if(!open(k0))
+			continue;
+		int k1 = k0;
+		while(k1 + 1 < aalen && open(k1 + 1))
+			k1++;
+		// codons of the run that agree with the fixed nucleotides
+		vector<vector<string> > cand(k1 - k0 + 1);
+		for(int k = k0; k <= k1; k++){
+			const int p = 3 * k + 1;
+			for(const string &c : codon_table.getCodons(aaseq[k], exc)){
+				bool ok = true;
+				for(int o = 0; o < 3 && ok; o++){
+					const char f = optseq[p + o];
+					if(f != 'N' && codon_real_nuc(f) != c[o])
+						ok = false;
+					// V/X: next is A or G, W/Y: next is C or U
+					if((f == 'V' || f == 'X') && o < 2 && c[o + 1] != 'A' && c[o + 1] != 'G')
+						ok = false;
+					if((f == 'W' || f == 'Y') && o < 2 && c[o + 1] != 'C' && c[o + 1] != 'U')
+						ok = false;
+				}
+				for(int o = 0; o < 2 && ok; o++)
+					ok = allowed(code(aaseq[k], c, o), code(aaseq[k], c, o + 1), p + o);
+				if(ok && k == k0 && p > 1 && optseq[p - 1] != 'N')
+					ok = allowed(codes.find(optseq[p - 1]), code(aaseq[k], c, 0), p - 1);
+				if(ok && k == k1 && p + 3 <= n && optseq[p + 3] != 'N')
+					ok = allowed(code(aaseq[k], c, 2), codes.find(optseq[p + 3]), p + 2);
+				if(ok)
+					cand[k - k0].push_back(c);
+			}
+		}
+		// cheapest chain, codon by codon
+		vector<vector<double> > best(cand.size());
+		vector<vector<int> > from(cand.size());
+		for(size_t r = 0; r < cand.size(); r++){
+			const int p = 3 * (k0 + r) + 1;
+			best[r].assign(cand[r].size(), INFINITY);
+			from[r].assign(cand[r].size(), -1);
+			for(size_t a = 0; a < cand[r].size(); a++){
+				const double own = cost(k0 + r, cand[r][a]);
+				if(r == 0){
+					best[r][a] = own;
+					continue;
+				}
+				for(size_t b = 0; b < cand[r - 1].size(); b++){
+					if(isinf(best[r - 1][b]) || !allowed(code(aaseq[k0 + r - 1], cand[r - 1][b], 2), code(aaseq[k0 + r], cand[r][a], 0), p - 1))
+						continue;
+					if(best[r - 1][b] + own < best[r][a]){
+						best[r][a] = best[r - 1][b] + own;
+						from[r][a] = b;
+					}
+				}
+			}
+		}
+		int a = -1;
+		const vector<double> &last = best.back();
+		for(size_t b = 0; b < last.size(); b++)
+			if(!isinf(last[b]) && (a < 0 || last[b] < last[a]))
+				a = b;
+		for(int r = cand.size() - 1; r >= 0 && a >= 0; r--){
+			const int p = 3 * (k0 + r) + 1;
+			for(int o = 0; o < 3; o++)
+				if(optseq[p + o] == 'N')
+					optseq[p + o] = cand[r][a][o];
+			a = from[r][a];
+		}
+		k0 = k1;
+	}
+}
+
+#endif /* CODONCOST_H_ */
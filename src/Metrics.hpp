@@ -0,0 +1,267 @@
+/*
+ * Metrics.hpp - counters of the --serve mode and their exposition on a
+ * local socket (--metrics-socket)
+ *
+ * The scheduler and design_record() update relaxed atomics as jobs and
+ * records pass; a connection to the socket gets a snapshot in the
+ * Prometheus text format (as an HTTP response when the request is a GET,
+ * so that curl --unix-socket and scrapers through a socket proxy work).
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Seconds, cumulative buckets as in the exposition format.
+class latency_histogram {
+public:
+	static const int N = 7;
+
+	latency_histogram(){
+		for(int b = 0; b <= N; b++)
+			count[b].store(0);
+		sum_ns.store(0);
+	}
+
+	void observe(double s){
+		int b = 0;
+		while(b < N && s > bound(b))
+			b++;
+		count[b].fetch_add(1, memory_order_relaxed);
+		sum_ns.fetch_add((uint64_t)(s * 1e9), memory_order_relaxed);
+	}
+
+	void write(ostream &os, const string &name, const string &label) const {
+		const string sep = label.empty() ? "" : ",";
+		uint64_t n = 0;
+		for(int b = 0; b <= N; b++){
+			n += count[b].load(memory_order_relaxed);
+			os << name << "_bucket{" << label << sep << "le=\"";
+			if(b < N) os << bound(b); else os << "+Inf";
+			os << "\"} " << n << "\n";
+		}
+		const string l = label.empty() ? "" : "{" + label + "}";
+		os << name << "_sum" << l << " " << sum_ns.load(memory_order_relaxed) / 1e9 << "\n";
+		os << name << "_count" << l << " " << n << "\n";
+	}
+
+private:
+	atomic<uint64_t> count[N + 1];
+	atomic<uint64_t> sum_ns;
+
+	static double bound(int b){
+		static const double le[N] = { 0.001, 0.01, 0.1, 1, 10, 60, 600 };
+		return le[b];
+	}
+};
+
+struct service_metrics {
+	enum Phase { PREPROCESS = 0, FILL = 1, TRACEBACK = 2, FIXED_FOLD = 3, N_PHASES = 4 };
+
+	// jobs (Scheduler)
+	atomic<long> queued[2];          // per lane: submitted, not yet started
+	atomic<long> in_flight;          // started, running or parked
+	atomic<long> jobs_done[2];
+	atomic<long> preemptions;
+	atomic<uint64_t> busy_ns;        // a job held the CPU
+	latency_histogram queue_wait[2];
+
+	// records (design_record)
+	atomic<long> records;
+	latency_histogram phase[N_PHASES];
+	atomic<uint64_t> cells;          // band cells filled
+	atomic<uint64_t> fill_ns;
+	atomic<uint64_t> thread_busy_ns; // fill threads at work
+	atomic<uint64_t> thread_ns;      // fill threads x fill time
+	atomic<uint64_t> cache_hits, cache_misses; // --compress decode cache
+	atomic<long long> workspace, workspace_peak; // estimated C/M bytes
+
+	chrono::steady_clock::time_point t0;
+
+	service_metrics() : t0(chrono::steady_clock::now()) {
+		for(int l = 0; l < 2; l++){
+			queued[l].store(0);
+			jobs_done[l].store(0);
+		}
+		in_flight.store(0);
+		preemptions.store(0);
+		busy_ns.store(0);
+		records.store(0);
+		cells.store(0);
+		fill_ns.store(0);
+		thread_busy_ns.store(0);
+		thread_ns.store(0);
+		cache_hits.store(0);
+		cache_misses.store(0);
+		workspace.store(0);
+		workspace_peak.store(0);
+	}
+
+	static uint64_t ns(double s){
+		return (uint64_t)(s * 1e9);
+	}
+
+	void add_workspace(long long bytes){
+		const long long now = workspace.fetch_add(bytes, memory_order_relaxed) + bytes;
+		long long peak = workspace_peak.load(memory_order_relaxed);
+		while(now > peak && !workspace_peak.compare_exchange_weak(peak, now, memory_order_relaxed))
+			;
+	}
+
+	void write(ostream &os) const {
+		static const char *lane[2] = { "interactive", "batch" };
+		static const char *phase_name[N_PHASES] = { "preprocess", "fill", "traceback", "fixed_fold" };
+		const double uptime = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		auto load = [](const atomic<uint64_t> &a){ return a.load(memory_order_relaxed); };
+
+		os << "# HELP cdsfold_uptime_seconds Time since the service started.\n";
+		os << "# TYPE cdsfold_uptime_seconds gauge\n";
+		os << "cdsfold_uptime_seconds " << uptime << "\n";
+		os << "# HELP cdsfold_jobs_in_flight Jobs started and not finished (running or parked).\n";
+		os << "# TYPE cdsfold_jobs_in_flight gauge\n";
+		os << "cdsfold_jobs_in_flight " << in_flight.load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_jobs_queued Jobs waiting for their first dispatch.\n";
+		os << "# TYPE cdsfold_jobs_queued gauge\n";
+		for(int l = 0; l < 2; l++)
+			os << "cdsfold_jobs_queued{lane=\"" << lane[l] << "\"} " << queued[l].load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_jobs_total Finished jobs.\n";
+		os << "# TYPE cdsfold_jobs_total counter\n";
+		for(int l = 0; l < 2; l++)
+			os << "cdsfold_jobs_total{lane=\"" << lane[l] << "\"} " << jobs_done[l].load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_preemptions_total Batch jobs parked for interactive work.\n";
+		os << "# TYPE cdsfold_preemptions_total counter\n";
+		os << "cdsfold_preemptions_total " << preemptions.load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_queue_wait_seconds Submit to first dispatch, per lane.\n";
+		os << "# TYPE cdsfold_queue_wait_seconds histogram\n";
+		for(int l = 0; l < 2; l++)
+			queue_wait[l].write(os, "cdsfold_queue_wait_seconds", string("lane=\"") + lane[l] + "\"");
+
+		os << "# HELP cdsfold_records_total Designed records.\n";
+		os << "# TYPE cdsfold_records_total counter\n";
+		os << "cdsfold_records_total " << records.load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_phase_seconds Time per record and phase.\n";
+		os << "# TYPE cdsfold_phase_seconds histogram\n";
+		for(int p = 0; p < N_PHASES; p++)
+			phase[p].write(os, "cdsfold_phase_seconds", string("phase=\"") + phase_name[p] + "\"");
+		os << "# HELP cdsfold_cells_total Band cells filled.\n";
+		os << "# TYPE cdsfold_cells_total counter\n";
+		os << "cdsfold_cells_total " << load(cells) << "\n";
+		os << "# HELP cdsfold_cells_per_second Band cells filled per second of fill.\n";
+		os << "# TYPE cdsfold_cells_per_second gauge\n";
+		os << "cdsfold_cells_per_second " << (load(fill_ns) ? load(cells) / (load(fill_ns) / 1e9) : 0) << "\n";
+		os << "# HELP cdsfold_packed_cache_hits_total --compress decodes served by the per-thread cache.\n";
+		os << "# TYPE cdsfold_packed_cache_hits_total counter\n";
+		os << "cdsfold_packed_cache_hits_total " << load(cache_hits) << "\n";
+		os << "# HELP cdsfold_packed_cache_misses_total --compress blocks decoded afresh.\n";
+		os << "# TYPE cdsfold_packed_cache_misses_total counter\n";
+		os << "cdsfold_packed_cache_misses_total " << load(cache_misses) << "\n";
+		const uint64_t lookups = load(cache_hits) + load(cache_misses);
+		os << "# HELP cdsfold_packed_cache_hit_ratio Share of --compress decodes served by the cache.\n";
+		os << "# TYPE cdsfold_packed_cache_hit_ratio gauge\n";
+		os << "cdsfold_packed_cache_hit_ratio " << (lookups ? (double)load(cache_hits) / lookups : 0) << "\n";
+		os << "# HELP cdsfold_workspace_bytes Estimated C/M bytes of the records in flight.\n";
+		os << "# TYPE cdsfold_workspace_bytes gauge\n";
+		os << "cdsfold_workspace_bytes " << workspace.load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_workspace_peak_bytes Largest cdsfold_workspace_bytes so far.\n";
+		os << "# TYPE cdsfold_workspace_peak_bytes gauge\n";
+		os << "cdsfold_workspace_peak_bytes " << workspace_peak.load(memory_order_relaxed) << "\n";
+		os << "# HELP cdsfold_busy_ratio Share of the uptime a job held the CPU.\n";
+		os << "# TYPE cdsfold_busy_ratio gauge\n";
+		os << "cdsfold_busy_ratio " << (uptime > 0 ? load(busy_ns) / 1e9 / uptime : 0) << "\n";
+		os << "# HELP cdsfold_fill_thread_utilisation Busy share of the fill threads during the fill.\n";
+		os << "# TYPE cdsfold_fill_thread_utilisation gauge\n";
+		os << "cdsfold_fill_thread_utilisation " << (load(thread_ns) ? (double)load(thread_busy_ns) / load(thread_ns) : 0) << "\n";
+	}
+};
+
+// Answers every connection to a Unix socket with a snapshot of m.
+class metrics_server {
+public:
+	metrics_server(const service_metrics &m, const string &path) : m(m), path(path), stop(false) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(fd < 0 || path.size() >= sizeof(addr.sun_path)){
+			cerr << "Cannot create the metrics socket " << path << endl;
+			exit(1);
+		}
+		strcpy(addr.sun_path, path.c_str());
+		unlink(path.c_str());
+		if(bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0){
+			cerr << "Cannot listen on the metrics socket " << path << ": " << strerror(errno) << endl;
+			exit(1);
+		}
+		th = thread(&metrics_server::loop, this);
+	}
+
+	~metrics_server(){
+		stop.store(true);
+		th.join();
+		close(fd);
+		unlink(path.c_str());
+	}
+
+private:
+	const service_metrics &m;
+	const string path;
+	int fd;
+	atomic<bool> stop;
+	thread th;
+
+	void loop(){
+		while(!stop.load()){
+			pollfd p = { fd, POLLIN, 0 };
+			if(poll(&p, 1, 200) <= 0)
+				continue;
+			const int c = accept(fd, NULL, NULL);
+			if(c < 0)
+				continue;
+			answer(c);
+			close(c);
+		}
+	}
+
+	void answer(int c){
+		// the request, if the client sends one without waiting for data
+		char req[1024];
+		ssize_t n = 0;
+		pollfd p = { c, POLLIN, 0 };
+		if(poll(&p, 1, 100) > 0)
+			n = read(c, req, sizeof(req) - 1);
+		const bool http = n >= 3 && strncmp(req, "GET", 3) == 0;
+
+		ostringstream body;
+		m.write(body);
+		const string b = body.str();
+		string out;
+		if(http){
+			out = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+			    + to_string(b.size()) + "\r\nConnection: close\r\n\r\n";
+		}
+		out += b;
+		for(size_t at = 0; at < out.size(); ){
+			const ssize_t w = send(c, out.data() + at, out.size() - at, MSG_NOSIGNAL);
+			if(w <= 0)
+				break;
+			at += w;
+		}
+	}
+};
+
+#endif /* METRICS_H_ */
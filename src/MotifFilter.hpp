@@ -0,0 +1,332 @@
+/*
+ * MotifFilter.hpp - forbidden motifs (--forbid-motifs file)
+ *
+ * The motifs (restriction sites, repeats, one per line, ACGT/U, '#'
+ * comments) are compiled into an Aho-Corasick automaton. Before the fill,
+ * the automaton is run over all nucleotide choices the codons allow, with
+ * the adjacent pairs restricted by Dep1. Wherever a motif can still be
+ * completed, one of its adjacent nucleotide pairs is removed from Dep1 at
+ * that position, so the recursions, the hairpin substrings and the
+ * traceback can no longer build it. The pair whose removal leaves the most
+ * choices is taken, provided every position keeps a nucleotide. Pairs left
+ * without a neighbour on both sides are then dropped too, and Dep2 is
+ * narrowed to what Dep1 still connects, so the nucleotides fixed in
+ * separate recursions always leave a valid choice in between. The final
+ * design is scanned again; sites that could not be blocked are reported.
+ */
+
+#ifndef MOTIFFILTER_H_
+#define MOTIFFILTER_H_
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// A C G U (and V/W = U, X/Y = G) -> 0..3, -1 otherwise
+inline int motif_nuc(char c){
+	switch(c){
+	case 'A': return 0;
+	case 'C': return 1;
+	case 'G': case 'X': case 'Y': return 2;
+	case 'U': case 'V': case 'W': return 3;
+	default: return -1;
+	}
+}
+
+class motif_automaton {
+public:
+	vector<string> motifs;
+
+	// Returns an error message, empty on success.
+	string load(const string &fname){
+		ifstream in(fname.c_str());
+		if(!in)
+			return "cannot open " + fname;
+		string line;
+		for(int ln = 1; getline(in, line); ln++){
+			string m;
+			for(char c : line){
+				if(c == '#')
+					break;
+				if(isspace((unsigned char)c))
+					continue;
+				c = toupper(c);
+				if(c == 'T')
+					c = 'U';
+				if(c != 'A' && c != 'C' && c != 'G' && c != 'U')
+					return fname + ":" + to_string(ln) + ": bad nucleotide in motif";
+				m += c;
+			}
+			if(m.empty())
+				continue;
+			if(m.size() < 2)
+				return fname + ":" + to_string(ln) + ": motifs need 2 or more nucleotides";
+			motifs.push_back(m);
+		}
+		build();
+		return "";
+	}
+
+	bool empty() const { return motifs.empty(); }
+	int states() const { return go.size(); }
+	int next(int s, int c) const { return go[s][c]; }
+	const vector<int> &matches(int s) const { return out[s]; }
+
+	// (start, motif) of every occurrence in an ACGU string, start 1-based
+	vector<pair<int, int> > find(const string &seq) const {
+		vector<pair<int, int> > hits;
+		int s = 0;
+		for(size_t p = 0; p < seq.size(); p++){
+			const int c = motif_nuc(seq[p]);
+			s = (c < 0) ? 0 : go[s][c];
+			for(int k : out[s])
+				hits.push_back(make_pair((int)p + 2 - (int)motifs[k].size(), k));
+		}
+		return hits;
+	}
+
+private:
+	vector<array<int, 4> > go;
+	vector<vector<int> > out; // motifs ending in each state, through the fail links
+
+	void build(){
+		go.assign(1, array<int, 4>{{-1, -1, -1, -1}});
+		out.assign(1, vector<int>());
+		for(size_t k = 0; k < motifs.size(); k++){
+			int s = 0;
+			for(char ch : motifs[k]){
+				const int c = motif_nuc(ch);
+				if(go[s][c] < 0){
+					go[s][c] = go.size();
+					go.push_back(array<int, 4>{{-1, -1, -1, -1}});
+					out.push_back(vector<int>());
+				}
+				s = go[s][c];
+			}
+			out[s].push_back(k);
+		}
+		// breadth-first: fail links folded into a complete transition table
+		vector<int> fail(go.size(), 0);
+		queue<int> q;
+		for(int c = 0; c < 4; c++){
+			if(go[0][c] < 0)
+				go[0][c] = 0;
+			else
+				q.push(go[0][c]);
+		}
+		while(!q.empty()){
+			const int s = q.front();
+			q.pop();
+			out[s].insert(out[s].end(), out[fail[s]].begin(), out[fail[s]].end());
+			for(int c = 0; c < 4; c++){
+				const int t = go[s][c];
+				if(t < 0){
+					go[s][c] = go[fail[s]][c];
+				}
+				else{
+					fail[t] = go[fail[s]][c];
+					q.push(t);
+				}
+			}
+		}
+	}
+};
+
+// Removes adjacent pairs from Dep1 (and the hairpin substrings using them)
+// until no motif can be completed. Returns the number of pairs removed.
+int block_motifs(const motif_automaton &ac, const vector<vector<int> > &pos2nuc, vector<vector<int> > &Dep1,
+		vector<vector<int> > &Dep2, vector<vector<vector<string> > > &substr, const int *ii2r, const char *i2n, const int nuclen){
+	const int S = ac.states();
+	// reach[j][s * 9 + x]: state s after position j with nucleotide code x at j
+	vector<vector<char> > reach(nuclen + 1, vector<char>(S * 9, 0));
+	vector<array<bool, 16> > banned(nuclen + 1);
+	for(array<bool, 16> &b : banned)
+		b.fill(false);
+
+	auto allowed = [&](int x, int y, int j){
+		return Dep1[ii2r[x * 10 + y]][j] != 0;
+	};
+	auto step = [&](int j){ // reach[j + 1] from reach[j]
+		vector<char> &r = reach[j + 1];
+		fill(r.begin(), r.end(), 0);
+		for(int y : pos2nuc[j + 1]){
+			const int c = motif_nuc(i2n[y]);
+			if(j == 0){
+				r[ac.next(0, c) * 9 + y] = 1;
+				continue;
+			}
+			for(int s = 0; s < S; s++)
+				for(int x : pos2nuc[j])
+					if(reach[j][s * 9 + x] && allowed(x, y, j))
+						r[ac.next(s, c) * 9 + y] = 1;
+		}
+	};
+	auto clear_pair = [&](int q, int a, int b){ // real pair (a,b) at q, q+1
+		vector<pair<int, int> > was;
+		for(int x : pos2nuc[q])
+			for(int y : pos2nuc[q + 1])
+				if(motif_nuc(i2n[x]) == a && motif_nuc(i2n[y]) == b){
+					int &d = Dep1[ii2r[x * 10 + y]][q];
+					was.push_back(make_pair(ii2r[x * 10 + y], d));
+					d = 0;
+				}
+		return was;
+	};
+	auto pairs_left = [&](int q){
+		int n = 0;
+		for(int x : pos2nuc[q])
+			for(int y : pos2nuc[q + 1])
+				n += allowed(x, y, q);
+		return n;
+	};
+	auto feasible = [&](int q){ // every position from q on keeps a nucleotide
+		vector<char> cur(9, 0), nxt(9);
+		for(int s = 0; s < S; s++)
+			for(int x : pos2nuc[q])
+				cur[x] |= reach[q][s * 9 + x];
+		for(int j = q; j < nuclen; j++){
+			fill(nxt.begin(), nxt.end(), 0);
+			bool any = false;
+			for(int x : pos2nuc[j])
+				for(int y : pos2nuc[j + 1])
+					if(cur[x] && allowed(x, y, j)){
+						nxt[y] = 1;
+						any = true;
+					}
+			if(!any)
+				return false;
+			cur.swap(nxt);
+		}
+		return true;
+	};
+
+	// drops nucleotides without Dep1 support on either side, from q outwards
+	auto propagate = [&](int q){
+		vector<int> work = { q, q + 1 };
+		set<int> touched;
+		while(!work.empty()){
+			const int r = work.back();
+			work.pop_back();
+			if(r < 1 || r > nuclen)
+				continue;
+			touched.insert(r);
+			for(int y : pos2nuc[r]){
+				bool left = (r == 1), right = (r == nuclen), used = false;
+				if(r > 1)
+					for(int x : pos2nuc[r - 1]){
+						left |= allowed(x, y, r - 1);
+						used |= allowed(x, y, r - 1);
+					}
+				if(r < nuclen)
+					for(int z : pos2nuc[r + 1]){
+						right |= allowed(y, z, r);
+						used |= allowed(y, z, r);
+					}
+				if((left && right) || !used)
+					continue;
+				if(r > 1)
+					for(int x : pos2nuc[r - 1])
+						Dep1[ii2r[x * 10 + y]][r - 1] = 0;
+				if(r < nuclen)
+					for(int z : pos2nuc[r + 1])
+						Dep1[ii2r[y * 10 + z]][r] = 0;
+				work.push_back(r - 1);
+				work.push_back(r + 1);
+			}
+		}
+		for(int r : touched){ // Dep2 over the middle position r
+			if(r < 2 || r >= nuclen)
+				continue;
+			for(int x : pos2nuc[r - 1])
+				for(int z : pos2nuc[r + 1]){
+					bool path = false;
+					for(int y : pos2nuc[r])
+						path |= allowed(x, y, r - 1) && allowed(y, z, r);
+					if(!path)
+						Dep2[ii2r[x * 10 + z]][r - 1] = 0;
+				}
+		}
+	};
+
+	set<pair<int, int> > given_up; // (end, motif)
+	int blocked = 0;
+	for(int j = 0; j < nuclen; j++){
+		step(j);
+		const int e = j + 1;
+		int hit = -1;
+		for(int s = 0; s < S && hit < 0; s++){
+			if(ac.matches(s).empty())
+				continue;
+			for(int x : pos2nuc[e]){
+				if(!reach[e][s * 9 + x])
+					continue;
+				for(int k : ac.matches(s))
+					if(!given_up.count(make_pair(e, k))){
+						hit = k;
+						break;
+					}
+				if(hit >= 0)
+					break;
+			}
+		}
+		if(hit < 0)
+			continue;
+
+		// block one pair of the motif ending at e
+		const string &m = ac.motifs[hit];
+		const int p = e - m.size() + 1;
+		int best_q = -1, best_left = -1;
+		for(int q = p; q < e; q++){
+			const int a = motif_nuc(m[q - p]), b = motif_nuc(m[q - p + 1]);
+			if(banned[q][a * 4 + b])
+				continue;
+			vector<pair<int, int> > was = clear_pair(q, a, b);
+			const int left = pairs_left(q);
+			if(left > best_left && feasible(q)){
+				best_q = q;
+				best_left = left;
+			}
+			for(const pair<int, int> &d : was)
+				Dep1[d.first][q] = d.second;
+		}
+		if(best_q < 0){
+			given_up.insert(make_pair(e, hit));
+			j--; // look at e again for the other motifs
+			continue;
+		}
+		const int a = motif_nuc(m[best_q - p]), b = motif_nuc(m[best_q - p + 1]);
+		clear_pair(best_q, a, b);
+		propagate(best_q);
+		banned[best_q][a * 4 + b] = true;
+		blocked++;
+		j = best_q - 1; // reach[best_q + 1] onwards changes
+	}
+
+	// special hairpins are taken as whole strings
+	for(int i = 1; i < (int)substr.size(); i++){
+		for(vector<string> &hp : substr[i]){
+			vector<string> keep;
+			for(const string &h : hp){
+				bool ok = true;
+				for(size_t t = 0; t + 1 < h.size() && ok && i + (int)t < nuclen; t++){
+					const int a = motif_nuc(h[t]), b = motif_nuc(h[t + 1]);
+					if(a >= 0 && b >= 0 && banned[i + t][a * 4 + b])
+						ok = false;
+				}
+				if(ok)
+					keep.push_back(h);
+			}
+			hp.swap(keep);
+		}
+	}
+	return blocked;
+}
+
+#endif /* MOTIFFILTER_H_ */
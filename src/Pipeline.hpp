@@ -0,0 +1,270 @@
+/*
+ * Pipeline.hpp - overlapped record processing (--pipeline)
+ *
+ * Each record runs design_record() on its own thread and passes through
+ * four stages: prepare (tables, band, parameters), fill (allocation, DP
+ * fill, traceback), finish (verification, repair, output) and write.
+ * Prepare, fill and finish are entered in record order, one record at a
+ * time each, so record n+1 prepares and record n-1 finishes while record n
+ * fills. At most `depth` records are in flight. A record's cout goes to
+ * its own buffer; finish hands the buffer to the writer thread through a
+ * bounded lock-free queue, so the console sees the records in order.
+ *
+ * Stage occupancy (busy time / wall time) is reported with --stats.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Bounded single-producer single-consumer ring.
+template <typename T>
+class spsc_ring {
+public:
+	explicit spsc_ring(size_t n) : slot(n + 1), head(0), tail(0) {}
+
+	bool try_push(const T &v){
+		const size_t t = tail.load(memory_order_relaxed);
+		const size_t next = (t + 1) % slot.size();
+		if(next == head.load(memory_order_acquire))
+			return false;
+		slot[t] = v;
+		tail.store(next, memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T &v){
+		const size_t h = head.load(memory_order_relaxed);
+		if(h == tail.load(memory_order_acquire))
+			return false;
+		v = slot[h];
+		head.store((h + 1) % slot.size(), memory_order_release);
+		return true;
+	}
+
+private:
+	vector<T> slot;
+	atomic<size_t> head, tail;
+};
+
+// cout while a pipeline runs: each thread writes to its own target,
+// threads without one to the console.
+class thread_streambuf : public streambuf {
+public:
+	static thread_local streambuf *target;
+	static atomic<thread_streambuf *> active;
+
+	explicit thread_streambuf(streambuf *console) : console(console) {}
+
+protected:
+	int overflow(int c) override {
+		if(c == EOF)
+			return 0;
+		return out()->sputc(c);
+	}
+	streamsize xsputn(const char *s, streamsize n) override {
+		return out()->sputn(s, n);
+	}
+	int sync() override {
+		return out()->pubsync();
+	}
+
+private:
+	streambuf *console;
+	streambuf *out() const { return target ? target : console; }
+};
+
+thread_local streambuf *thread_streambuf::target = nullptr;
+atomic<thread_streambuf *> thread_streambuf::active(nullptr);
+
+// Sends the calling thread's cout to sb and returns the previous buffer;
+// only that thread is affected while a pipeline runs.
+inline streambuf *redirect_cout(streambuf *sb){
+	if(thread_streambuf::active.load()){
+		streambuf *prev = thread_streambuf::target;
+		thread_streambuf::target = sb;
+		return prev;
+	}
+	return cout.rdbuf(sb);
+}
+
+class record_pipeline {
+public:
+	enum Stage { PREPARE = 0, FILL = 1, FINISH = 2, WRITE = 3, N_STAGES = 4 };
+
+	// The position of one record in the pipeline.
+	class ticket {
+	public:
+		// Leaves the current stage and waits for the record's turn in s;
+		// stages skipped on the way are passed through in order.
+		void enter(Stage s){
+			const int from = stage;
+			leave();
+			for(int g = max(from + 1, (int)PREPARE); g < s; g++){
+				p.gates[g].wait(k);
+				p.gates[g].pass();
+			}
+			p.gates[s].wait(k);
+			stage = s;
+			t_in = p.now();
+		}
+
+	private:
+		friend class record_pipeline;
+		record_pipeline &p;
+		const long k;
+		int stage;
+		double t_in;
+		ostringstream out;
+
+		ticket(record_pipeline &p, long k) : p(p), k(k), stage(-1), t_in(0) {}
+
+		void leave(){
+			if(stage < PREPARE || stage > FINISH)
+				return;
+			p.busy[stage] += p.now() - t_in; // only the gate holder adds
+			p.gates[stage].pass();
+			stage = -1;
+		}
+	};
+
+	typedef function<void(ticket &)> RecordFn;
+
+	explicit record_pipeline(int depth)
+		: depth(depth), queue(depth), n_submitted(0), closed(false),
+		  console(cout.rdbuf()), dispatch(console), t0(chrono::steady_clock::now()) {
+		for(int s = 0; s < N_STAGES; s++)
+			busy[s] = 0;
+		cout.rdbuf(&dispatch);
+		thread_streambuf::active.store(&dispatch);
+		writer = thread(&record_pipeline::write_loop, this);
+	}
+
+	~record_pipeline(){
+		wait();
+	}
+
+	// Starts fn on the next record, after the record `depth` places ahead
+	// has left the pipeline.
+	void submit(const RecordFn &fn){
+		const long k = n_submitted++;
+		if(k >= depth)
+			records[k - depth].join();
+		records.emplace_back(&record_pipeline::run, this, fn, k);
+	}
+
+	// Waits for every record and restores cout.
+	void wait(){
+		if(closed.load())
+			return;
+		for(thread &t : records)
+			if(t.joinable())
+				t.join();
+		closed.store(true);
+		writer.join();
+		t_wall = now();
+		thread_streambuf::active.store(nullptr);
+		cout.rdbuf(console);
+	}
+
+	void report(ostream &os) const {
+		static const char *name[N_STAGES] = { "prepare", "fill", "finish", "write" };
+		os << "stats: pipeline_records " << n_submitted << endl;
+		os << "stats: pipeline_depth " << depth << endl;
+		os << "stats: pipeline_wall " << t_wall << endl;
+		for(int s = 0; s < N_STAGES; s++){
+			os << "stats: pipeline_busy_" << name[s] << " " << busy[s] << endl;
+			os << "stats: pipeline_occupancy_" << name[s] << " " << (t_wall > 0 ? busy[s] / t_wall : 0) << endl;
+		}
+	}
+
+private:
+	// Admits records in order, one at a time.
+	struct stage_gate {
+		mutex m;
+		condition_variable cv;
+		long next = 0;
+
+		void wait(long k){
+			unique_lock<mutex> lk(m);
+			cv.wait(lk, [this, k] { return next == k; });
+		}
+		void pass(){
+			{
+				lock_guard<mutex> lk(m);
+				next++;
+			}
+			cv.notify_all();
+		}
+	};
+
+	const int depth;
+	stage_gate gates[FINISH + 1];
+	double busy[N_STAGES];
+	spsc_ring<string *> queue;
+	vector<thread> records;
+	long n_submitted;
+	atomic<bool> closed;
+	streambuf *console;
+	thread_streambuf dispatch;
+	thread writer;
+	chrono::steady_clock::time_point t0;
+	double t_wall = 0;
+
+	double now() const {
+		return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	}
+
+	void run(RecordFn fn, long k){
+		ticket t(*this, k);
+		thread_streambuf::target = t.out.rdbuf();
+		t.enter(PREPARE);
+		fn(t);
+		if(t.stage != FINISH)
+			t.enter(FINISH);
+		// still holding finish, so the queue sees the records in order
+		string *text = new string(t.out.str());
+		while(!queue.try_push(text))
+			this_thread::sleep_for(chrono::microseconds(200));
+		t.leave();
+		thread_streambuf::target = nullptr;
+	}
+
+	void write_loop(){
+		int idle = 0;
+		for(;;){
+			const bool last = closed.load(); // every record has been queued
+			string *text;
+			if(queue.try_pop(text)){
+				const double t_in = now();
+				console->sputn(text->data(), text->size());
+				console->pubsync();
+				delete text;
+				busy[WRITE] += now() - t_in;
+				idle = 0;
+				continue;
+			}
+			if(last)
+				break;
+			// back off while the records are busy filling
+			this_thread::sleep_for(chrono::microseconds(idle < 10 ? 50 : 1000));
+			idle++;
+		}
+	}
+};
+
+#endif /* PIPELINE_H_ */
@@ -0,0 +1,150 @@
+/*
+ * Regions.hpp - per-region structure objective (--regions)
+ *
+ * Each region of residues is tagged stabilise, destabilise or neutral and
+ * adds a term per paired nucleotide to C(i,j) through nuc_cost, the hook
+ * of the codon costs: -weight for stabilise, +weight for destabilise, 0
+ * for neutral. So one fill and one traceback design the whole protein;
+ * the traceback takes the terms off again and the reported MFE is the
+ * energy of the designed structure. Codons the traceback leaves open in a
+ * destabilised region take the fewest G and U (the bases with two pairing
+ * partners), which keeps the region from pairing with itself.
+ *
+ * Spec: from-to:kind[=kcal], comma separated, residues 1-based, "to" may
+ * be left out (to the end). Needs CodonCost.hpp.
+ */
+
+#ifndef REGIONS_H_
+#define REGIONS_H_
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct design_region {
+	enum Kind { STABILISE = 0, DESTABILISE = 1, NEUTRAL = 2 };
+	int fm, to;     // residues, 1-based
+	Kind kind;
+	double weight;  // kcal/mol per paired nucleotide
+
+	static const char *name(Kind k){
+		static const char *n[3] = { "stabilise", "destabilise", "neutral" };
+		return n[k];
+	}
+};
+
+// Returns an error message, empty on success.
+string parse_regions(const string &s, vector<design_region> &v)
+{
+	v.clear();
+	stringstream ss(s);
+	string item;
+	while(getline(ss, item, ',')){
+		design_region r;
+		const size_t colon = item.find(':');
+		const size_t dash = item.find('-');
+		if(colon == string::npos || dash == string::npos || dash > colon || dash == 0){
+			return "Invalid --regions entry: " + item + " (use from-to:kind[=kcal], e.g. 1-40:destabilise,41-:stabilise)";
+		}
+		r.fm = atoi(item.substr(0, dash).c_str());
+		r.to = (dash + 1 == colon) ? INT_MAX : atoi(item.substr(dash + 1, colon - dash - 1).c_str());
+		if(r.fm < 1 || r.to < r.fm){
+			return "Invalid --regions range: " + item;
+		}
+		string kind = item.substr(colon + 1);
+		const size_t eq = kind.find('=');
+		string weight;
+		if(eq != string::npos){
+			weight = kind.substr(eq + 1);
+			kind.erase(eq);
+		}
+		if(kind == "stabilise" || kind == "stabilize"){
+			r.kind = design_region::STABILISE;
+			r.weight = 0.5;
+		}
+		else if(kind == "destabilise" || kind == "destabilize"){
+			r.kind = design_region::DESTABILISE;
+			r.weight = 2.0;
+		}
+		else if(kind == "neutral"){
+			r.kind = design_region::NEUTRAL;
+			r.weight = 0;
+		}
+		else{
+			return "Unknown --regions kind: " + kind + " (stabilise, destabilise or neutral)";
+		}
+		if(!weight.empty()){
+			char *end;
+			r.weight = strtod(weight.c_str(), &end);
+			if(*end || r.weight < 0){
+				return "The --regions weight must be 0 or more (you used " + weight + ")";
+			}
+		}
+		v.push_back(r);
+	}
+	if(v.empty()){
+		return "The --regions list is empty.";
+	}
+	return "";
+}
+
+// Adds the region terms to nuc_cost (set_nuc_cost, or zeros without
+// --codon-cost), for every nucleotide code of the positions.
+void add_region_cost(vector<array<int, 9> > &nuc_cost, const vector<design_region> &regions, int aalen)
+{
+	if(nuc_cost.empty())
+		nuc_cost.assign(3 * aalen + 1, array<int, 9>());
+	vector<int> term(aalen, 0);
+	for(const design_region &r : regions){
+		const int t = (int)lround(100 * r.weight) * (r.kind == design_region::STABILISE ? -1 : r.kind == design_region::DESTABILISE ? 1 : 0);
+		for(int k = r.fm - 1; k < min(r.to, aalen); k++)
+			term[k] = t;
+	}
+	for(int k = 0; k < aalen; k++)
+		for(int o = 1; o <= 3; o++)
+			for(int n = 1; n <= 8; n++)
+				nuc_cost[3 * k + o][n] += term[k];
+}
+
+// Choice cost of an open codon of residue k (0-based): its G and U, in a
+// destabilised region; 0 elsewhere.
+double region_codon_score(const vector<design_region> &regions, int k, const string &c)
+{
+	double w = -1;
+	for(const design_region &r : regions)
+		if(k + 1 >= r.fm && k + 1 <= r.to)
+			w = (r.kind == design_region::DESTABILISE) ? r.weight : -1;
+	if(w < 0)
+		return 0;
+	int gu = 0;
+	for(char x : c)
+		gu += (x == 'G' || x == 'U');
+	return w * gu / 3;
+}
+
+// Paired nucleotides of each region in a structure (1-based pairs).
+void print_region_report(ostream &os, const vector<design_region> &regions, int aalen, const vector<pair<int, int> > &pairs)
+{
+	vector<char> paired(3 * aalen + 1, 0);
+	for(const pair<int, int> &bp : pairs)
+		paired[bp.first] = paired[bp.second] = 1;
+	for(const design_region &r : regions){
+		if(r.fm > aalen)
+			continue;
+		const int to = min(r.to, aalen);
+		int n = 0;
+		for(int p = 3 * (r.fm - 1) + 1; p <= 3 * to; p++)
+			n += paired[p];
+		os << "Region " << r.fm << "-" << to << " " << design_region::name(r.kind) << ": "
+		   << n << " of " << 3 * (to - r.fm + 1) << " nucleotides paired" << endl;
+	}
+}
+
+#endif /* REGIONS_H_ */
@@ -0,0 +1,205 @@
+/*
+ * ResourceLimits.h
+ *
+ * CPU and memory actually available to the process: sched_getaffinity,
+ * the cgroup v1/v2 CPU quota, cpuset and memory limit, and MemAvailable.
+ * Under Kubernetes or Slurm these are much smaller than the host.
+ */
+
+#ifndef RESOURCELIMITS_H_
+#define RESOURCELIMITS_H_
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <climits>
+#include <cmath>
+#include <sched.h>
+#include <unistd.h>
+
+using namespace std;
+
+class ResourceLimits {
+public:
+	int cgroup_version;     // 0: none found, 1 or 2
+	int affinity_cpus;      // sched_getaffinity
+	int cpuset_cpus;        // cgroup cpuset, 0 if unknown
+	double cpu_quota;       // cgroup quota in CPUs, 0 if unlimited
+	long long mem_limit;    // cgroup memory limit in bytes, 0 if unlimited
+	long long mem_available;// MemAvailable in bytes, 0 if unknown
+
+	ResourceLimits()
+		: cgroup_version(0), affinity_cpus(0), cpuset_cpus(0), cpu_quota(0), mem_limit(0), mem_available(0) {
+	}
+
+	void detect() {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			affinity_cpus = CPU_COUNT(&set);
+		}
+		else {
+			affinity_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		mem_available = meminfoAvailable();
+
+		map<string, string> paths = cgroupPaths();
+		if (fileExists("/sys/fs/cgroup/cgroup.controllers")) {
+			cgroup_version = 2;
+			detectV2(paths.count("") ? paths[""] : "/");
+		}
+		else if (!paths.empty() && fileExists("/sys/fs/cgroup/memory")) {
+			cgroup_version = 1;
+			detectV1(paths);
+		}
+	}
+
+	// Threads to use when --threads and OMP_NUM_THREADS are not given.
+	int threads() const {
+		int n = affinity_cpus > 0 ? affinity_cpus : 1;
+		if (cpuset_cpus > 0 && cpuset_cpus < n) n = cpuset_cpus;
+		if (cpu_quota > 0 && (int)ceil(cpu_quota) < n) n = (int)ceil(cpu_quota);
+		return n > 0 ? n : 1;
+	}
+
+	// Bytes the matrices may use: the tighter of the cgroup limit and
+	// MemAvailable, 0 if neither is known.
+	long long memoryBudget() const {
+		long long b = mem_available;
+		if (mem_limit > 0 && (b == 0 || mem_limit < b)) b = mem_limit;
+		return b;
+	}
+
+	void report(ostream &os) const {
+		os << "stats: cgroup_version " << cgroup_version << endl;
+		os << "stats: cpu_affinity " << affinity_cpus << endl;
+		os << "stats: cpu_cpuset " << cpuset_cpus << endl;
+		os << "stats: cpu_quota " << cpu_quota << endl;
+		os << "stats: mem_limit " << mem_limit << endl;
+		os << "stats: mem_available " << mem_available << endl;
+		os << "stats: default_threads " << threads() << endl;
+	}
+
+private:
+	static bool fileExists(const string &f) {
+		return access(f.c_str(), F_OK) == 0;
+	}
+
+	static bool readLine(const string &f, string &line) {
+		ifstream ifs(f.c_str());
+		return ifs && getline(ifs, line);
+	}
+
+	// "0-3,8,10-11" -> 7
+	static int countCpuList(const string &s) {
+		int n = 0;
+		stringstream ss(s);
+		string item;
+		while (getline(ss, item, ',')) {
+			if (item.empty()) continue;
+			size_t dash = item.find('-');
+			if (dash == string::npos) n++;
+			else n += atoi(item.substr(dash + 1).c_str()) - atoi(item.substr(0, dash).c_str()) + 1;
+		}
+		return n;
+	}
+
+	static long long meminfoAvailable() {
+		ifstream ifs("/proc/meminfo");
+		string key;
+		long long kb;
+		string unit;
+		while (ifs >> key >> kb >> unit) {
+			if (key == "MemAvailable:") return kb * 1024;
+		}
+		return 0;
+	}
+
+	// controller -> cgroup path ("" is the v2 unified hierarchy)
+	static map<string, string> cgroupPaths() {
+		map<string, string> m;
+		ifstream ifs("/proc/self/cgroup");
+		string line;
+		while (getline(ifs, line)) {
+			size_t a = line.find(':');
+			size_t b = line.find(':', a + 1);
+			if (a == string::npos || b == string::npos) continue;
+			string ctrls = line.substr(a + 1, b - a - 1);
+			string path = line.substr(b + 1);
+			stringstream ss(ctrls);
+			string c;
+			if (ctrls.empty()) m[""] = path;
+			while (getline(ss, c, ',')) m[c] = path;
+		}
+		return m;
+	}
+
+	// Directories from the own cgroup up to the root of a hierarchy; a
+	// container usually sees its own cgroup as the mount root.
+	static vector<string> cgroupDirs(const string &mount, string path) {
+		vector<string> dirs;
+		if (!fileExists(mount + path)) path = "/";
+		while (true) {
+			dirs.push_back(mount + (path == "/" ? "" : path));
+			if (path == "/" || path.empty()) break;
+			size_t p = path.rfind('/');
+			path = (p == 0 || p == string::npos) ? "/" : path.substr(0, p);
+		}
+		return dirs;
+	}
+
+	void minMemLimit(long long v) {
+		if (v > 0 && v < (1LL << 60) && (mem_limit == 0 || v < mem_limit)) mem_limit = v;
+	}
+
+	void minCpuQuota(double q) {
+		if (q > 0 && (cpu_quota == 0 || q < cpu_quota)) cpu_quota = q;
+	}
+
+	void detectV2(const string &path) {
+		string line;
+		for (const string &d : cgroupDirs("/sys/fs/cgroup", path)) {
+			if (readLine(d + "/cpu.max", line)) {
+				stringstream ss(line);
+				string quota;
+				double period = 100000;
+				ss >> quota >> period;
+				if (quota != "max" && period > 0) minCpuQuota(atof(quota.c_str()) / period);
+			}
+			if (readLine(d + "/memory.max", line) && line != "max") {
+				minMemLimit(atoll(line.c_str()));
+			}
+			if (cpuset_cpus == 0 && readLine(d + "/cpuset.cpus.effective", line)) {
+				cpuset_cpus = countCpuList(line);
+			}
+		}
+	}
+
+	void detectV1(map<string, string> &paths) {
+		string line;
+		const string cpu_mount = fileExists("/sys/fs/cgroup/cpu,cpuacct") ? "/sys/fs/cgroup/cpu,cpuacct" : "/sys/fs/cgroup/cpu";
+		for (const string &d : cgroupDirs(cpu_mount, paths["cpu"])) {
+			string period;
+			if (readLine(d + "/cpu.cfs_quota_us", line) && readLine(d + "/cpu.cfs_period_us", period)) {
+				double q = atof(line.c_str()), p = atof(period.c_str());
+				if (q > 0 && p > 0) minCpuQuota(q / p);
+			}
+		}
+		for (const string &d : cgroupDirs("/sys/fs/cgroup/memory", paths["memory"])) {
+			if (readLine(d + "/memory.limit_in_bytes", line)) minMemLimit(atoll(line.c_str()));
+		}
+		for (const string &d : cgroupDirs("/sys/fs/cgroup/cpuset", paths["cpuset"])) {
+			if (readLine(d + "/cpuset.effective_cpus", line) || readLine(d + "/cpuset.cpus", line)) {
+				if (!line.empty()) {
+					cpuset_cpus = countCpuList(line);
+					break;
+				}
+			}
+		}
+	}
+};
+
+#endif /* RESOURCELIMITS_H_ */
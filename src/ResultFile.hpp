@@ -0,0 +1,326 @@
+/*
+ * ResultFile.hpp - columnar binary results (--results)
+ *
+ * Layout (little-endian, all offsets from the start of the file):
+ *
+ *   header, 64 bytes
+ *     char     magic[8]      "CDSFRES1"
+ *     uint32   version       1
+ *     uint32   header_size   64
+ *     uint64   n_records     0 until the writer is closed
+ *     uint64   index_offset  0 until the writer is closed
+ *     (zero padding)
+ *   data, one entry per record in input order, each padded to 4 bytes
+ *     id       FASTA header line without '>'
+ *     seq      designed CDS, 2 bits per nucleotide (A=0 C=1 G=2 U=3),
+ *              nucleotide k (0-based) in bits 2(k%4)..2(k%4)+1 of byte k/4
+ *     pairs    uint32 i, j per base pair (1-based, i < j)
+ *   (RESULT_MFE_ONLY records have neither: nuclen is the CDS length,
+ *   n_pairs is 0 and seq_off points at the pairs)
+ *   index, one column after the other, each n_records long
+ *     uint64   id_off, seq_off, pair_off
+ *     uint32   id_len, nuclen, n_pairs
+ *     int32    mfe           dcal/mol (kcal/mol * 100)
+ *     float    t_fill        seconds in the C/M, F and F2 fills
+ *     float    t_total       seconds for the whole record
+ *     uint32   flags         RESULT_* bits
+ *
+ * The data section is streamed; the index is kept in memory (about 50
+ * bytes per record) and written by close(), which then fills in the
+ * header. A file without n_records/index_offset was not closed. The reader
+ * checks every offset, length and pair index against the file before use.
+ */
+
+#ifndef RESULTFILE_H_
+#define RESULTFILE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum {
+	RESULT_REVERSE   = 1,  // -r
+	RESULT_PARTIAL   = 2,  // -f/-t
+	RESULT_RANDOM_TB = 4,  // -R
+	RESULT_WINDOWED  = 8,  // -w or --span narrower than the sequence
+	RESULT_COMPRESS  = 16, // --compress
+	RESULT_AA_DIFF   = 32, // design does not translate back to the protein
+	RESULT_MFE_ONLY  = 64  // --mfe-only: MFE without a design
+};
+
+struct design_result {
+	string id;
+	string seq;                     // ACGU, 0-based
+	int nuclen = 0;                 // CDS length, for RESULT_MFE_ONLY
+	vector<pair<int, int> > pairs;  // 1-based
+	int mfe = 0;                    // dcal/mol
+	float t_fill = 0;
+	float t_total = 0;
+	uint32_t flags = 0;
+};
+
+struct result_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t n_records;
+	uint64_t index_offset;
+	char pad[32];
+};
+
+static const char RESULT_MAGIC[8] = { 'C', 'D', 'S', 'F', 'R', 'E', 'S', '1' };
+
+inline int result_nuc_code(char c){
+	switch(c){
+	case 'A': return 0;
+	case 'C': return 1;
+	case 'G': return 2;
+	default:  return 3;
+	}
+}
+
+class ResultWriter {
+public:
+	ResultWriter() : fp(NULL), offset(sizeof(result_header)), ok(true) {}
+
+	~ResultWriter(){
+		close();
+	}
+
+	bool open(const string &fname){
+		fp = fopen(fname.c_str(), "wb");
+		if(!fp)
+			return false;
+		result_header h = {};
+		memcpy(h.magic, RESULT_MAGIC, 8);
+		h.version = 1;
+		h.header_size = sizeof(result_header);
+		ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+		return ok;
+	}
+
+	void append(const design_result &r){
+		id_off.push_back(offset);
+		id_len.push_back(r.id.size());
+		put(r.id.data(), r.id.size());
+
+		string packed((r.seq.size() + 3) / 4, '\0');
+		for(size_t k = 0; k < r.seq.size(); k++)
+			packed[k / 4] |= (char)(result_nuc_code(r.seq[k]) << (2 * (k % 4)));
+		seq_off.push_back(offset);
+		nuclen.push_back((r.flags & RESULT_MFE_ONLY) ? r.nuclen : r.seq.size());
+		put(packed.data(), packed.size());
+
+		vector<uint32_t> p;
+		for(const auto &ij : r.pairs){
+			p.push_back(ij.first);
+			p.push_back(ij.second);
+		}
+		pair_off.push_back(offset);
+		n_pairs.push_back(r.pairs.size());
+		put(p.data(), p.size() * sizeof(uint32_t));
+
+		mfe.push_back(r.mfe);
+		t_fill.push_back(r.t_fill);
+		t_total.push_back(r.t_total);
+		flags.push_back(r.flags);
+	}
+
+	// Writes the index and completes the header. Returns false when any
+	// write failed, and then the file has no valid index.
+	bool close(){
+		if(!fp)
+			return ok;
+		pad_to(8);
+		result_header h = {};
+		memcpy(h.magic, RESULT_MAGIC, 8);
+		h.version = 1;
+		h.header_size = sizeof(result_header);
+		h.n_records = id_off.size();
+		h.index_offset = offset;
+		column(id_off);
+		column(seq_off);
+		column(pair_off);
+		column(id_len);
+		column(nuclen);
+		column(n_pairs);
+		column(mfe);
+		column(t_fill);
+		column(t_total);
+		column(flags);
+		if(ok && fseek(fp, 0, SEEK_SET) == 0)
+			ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+		else
+			ok = false;
+		if(fclose(fp) != 0)
+			ok = false;
+		fp = NULL;
+		return ok;
+	}
+
+private:
+	FILE *fp;
+	uint64_t offset;
+	vector<uint64_t> id_off, seq_off, pair_off;
+	vector<uint32_t> id_len, nuclen, n_pairs;
+	vector<int32_t> mfe;
+	vector<float> t_fill, t_total;
+	vector<uint32_t> flags;
+	bool ok;  // every write so far succeeded
+
+	void put(const void *p, size_t n){
+		if(fwrite(p, 1, n, fp) != n)
+			ok = false;
+		offset += n;
+		pad_to(4);
+	}
+
+	void pad_to(size_t a){
+		static const char zero[8] = {};
+		size_t n = (a - offset % a) % a;
+		if(fwrite(zero, 1, n, fp) != n)
+			ok = false;
+		offset += n;
+	}
+
+	template<class T> void column(const vector<T> &v){
+		if(fwrite(v.data(), sizeof(T), v.size(), fp) != v.size())
+			ok = false;
+		offset += v.size() * sizeof(T);
+		pad_to(8);
+	}
+};
+
+// Read-only mmap view of a results file.
+class ResultReader {
+public:
+	ResultReader() : base(NULL), len(0), n(0) {}
+
+	~ResultReader(){
+		if(base)
+			munmap(base, len);
+	}
+
+	// Returns an error message, empty on success.
+	string open(const string &fname){
+		int fd = ::open(fname.c_str(), O_RDONLY);
+		if(fd < 0)
+			return "cannot open " + fname;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(result_header)){
+			::close(fd);
+			return fname + " is not a results file";
+		}
+		len = st.st_size;
+		void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(p == MAP_FAILED)
+			return "cannot map " + fname;
+		base = (char *)p;
+		const result_header *h = (const result_header *)base;
+		if(memcmp(h->magic, RESULT_MAGIC, 8) != 0 || h->version != 1)
+			return fname + " is not a results file";
+		if(h->index_offset == 0)
+			return fname + " was not closed (no index)";
+		// 52 bytes of index per record, before the column padding
+		if(h->index_offset < sizeof(result_header) || h->index_offset > len || h->index_offset % 8
+				|| h->n_records > (len - h->index_offset) / 52)
+			return fname + " is truncated";
+		n = h->n_records;
+		uint64_t at = h->index_offset;
+		id_off = (const uint64_t *)col(at, 8);
+		seq_off = (const uint64_t *)col(at, 8);
+		pair_off = (const uint64_t *)col(at, 8);
+		id_len = (const uint32_t *)col(at, 4);
+		nuclen_ = (const uint32_t *)col(at, 4);
+		n_pairs_ = (const uint32_t *)col(at, 4);
+		mfe_ = (const int32_t *)col(at, 4);
+		t_fill_ = (const float *)col(at, 4);
+		t_total_ = (const float *)col(at, 4);
+		flags_ = (const uint32_t *)col(at, 4);
+		if(at > len)
+			return fname + " is truncated";
+		for(size_t k = 0; k < n; k++){
+			if(!fits(id_off[k], id_len[k]) || pair_off[k] % 4
+					|| !fits(seq_off[k], (flags_[k] & RESULT_MFE_ONLY)? 0 : ((uint64_t)nuclen_[k] + 3) / 4)
+					|| !fits(pair_off[k], 0) || n_pairs_[k] > (len - pair_off[k]) / 8)
+				return fname + ": record " + to_string(k) + " is out of bounds";
+			const uint32_t *p = pairs(k);
+			for(uint32_t t = 0; t < 2 * n_pairs_[k]; t++)
+				if(p[t] < 1 || p[t] > nuclen_[k])
+					return fname + ": record " + to_string(k) + " pairs a position outside 1.." + to_string(nuclen_[k]);
+		}
+		return "";
+	}
+
+	size_t size() const { return n; }
+	string id(size_t k) const { return string(base + id_off[k], id_len[k]); }
+	uint32_t nuclen(size_t k) const { return nuclen_[k]; }
+	uint32_t n_pairs(size_t k) const { return n_pairs_[k]; }
+	const uint32_t *pairs(size_t k) const { return (const uint32_t *)(base + pair_off[k]); }
+	int32_t mfe(size_t k) const { return mfe_[k]; }
+	float t_fill(size_t k) const { return t_fill_[k]; }
+	float t_total(size_t k) const { return t_total_[k]; }
+	uint32_t flags(size_t k) const { return flags_[k]; }
+
+	// Whole columns, for analytics over all records
+	const int32_t *mfe_column() const { return mfe_; }
+	const uint32_t *nuclen_column() const { return nuclen_; }
+
+	// empty for RESULT_MFE_ONLY records
+	string seq(size_t k) const {
+		if(flags_[k] & RESULT_MFE_ONLY)
+			return "";
+		static const char nuc[4] = { 'A', 'C', 'G', 'U' };
+		const unsigned char *p = (const unsigned char *)(base + seq_off[k]);
+		string s(nuclen_[k], 'N');
+		for(size_t i = 0; i < s.size(); i++)
+			s[i] = nuc[(p[i / 4] >> (2 * (i % 4))) & 3];
+		return s;
+	}
+
+	string structure(size_t k) const {
+		if(flags_[k] & RESULT_MFE_ONLY)
+			return "";
+		string s(nuclen_[k], '.');
+		const uint32_t *p = pairs(k);
+		for(uint32_t t = 0; t < n_pairs_[k]; t++){
+			s[p[2 * t] - 1] = '(';
+			s[p[2 * t + 1] - 1] = ')';
+		}
+		return s;
+	}
+
+private:
+	char *base;
+	size_t len;
+	size_t n;
+	const uint64_t *id_off, *seq_off, *pair_off;
+	const uint32_t *id_len, *nuclen_, *n_pairs_;
+	const int32_t *mfe_;
+	const float *t_fill_, *t_total_;
+	const uint32_t *flags_;
+
+	// n bytes at off lie within the file
+	bool fits(uint64_t off, uint64_t n) const {
+		return off <= len && n <= len - off;
+	}
+
+	const void *col(uint64_t &at, size_t width){
+		const void *p = base + at;
+		at += n * width;
+		at = (at + 7) / 8 * 8;
+		return p;
+	}
+};
+
+#endif /* RESULTFILE_H_ */
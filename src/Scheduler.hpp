@@ -0,0 +1,235 @@
+/*
+ * Scheduler.hpp
+ *
+ * Two priority lanes for --serve. One design runs at a time (the DP fill
+ * already uses every granted CPU); interactive jobs are dispatched before
+ * batch jobs, and a running batch job parks at its next yield point (the
+ * end of a diagonal) while interactive work is queued. Each job runs on
+ * its own thread so that a parked job keeps its stack and matrices.
+ * Queue, dispatch and CPU time go to a service_metrics when given one.
+ * Resident processes (--serve, --spool) free finished jobs with reap().
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Metrics.hpp"
+
+using namespace std;
+
+class Scheduler {
+public:
+	enum Lane { INTERACTIVE = 0, BATCH = 1 };
+	// A job receives its yield point; calling it may block until the job
+	// is scheduled again.
+	typedef function<void(const function<void()> &)> JobFn;
+
+	explicit Scheduler(service_metrics *metrics = nullptr)
+		: metrics(metrics), console(cout.rdbuf()), running(nullptr), n_done(0), t0(chrono::steady_clock::now()) {
+	}
+
+	~Scheduler() {
+		wait();
+		for (Job *j : jobs) delete j;
+	}
+
+	// cout is redirected to out while the job holds the CPU, and back to
+	// the console when it ends, so out may go with the job.
+	void submit(Lane lane, const JobFn &fn, streambuf *out) {
+		lock_guard<mutex> lk(m);
+		Job *j = new Job();
+		j->lane = lane;
+		j->fn = fn;
+		j->out = out;
+		j->t_submit = now();
+		jobs.push_back(j);
+		queue[lane].push_back(j);
+		if (metrics) metrics->queued[lane]++;
+		dispatch();
+	}
+
+	// Blocks until every submitted job has finished.
+	void wait() {
+		unique_lock<mutex> lk(m);
+		cv.wait(lk, [this] { return n_done == jobs.size(); });
+		lk.unlock();
+		for (Job *j : jobs) {
+			if (j->th.joinable()) j->th.join();
+		}
+	}
+
+	// Jobs submitted and not finished.
+	size_t pending() {
+		lock_guard<mutex> lk(m);
+		return jobs.size() - n_done;
+	}
+
+	// Joins and frees the finished jobs; report() keeps their numbers.
+	void reap() {
+		vector<Job *> done, live;
+		{
+			lock_guard<mutex> lk(m);
+			for (Job *j : jobs) {
+				if (j->finished) {
+					done.push_back(j);
+					reaped_wait[j->lane].push_back(j->t_start - j->t_submit);
+					reaped_preemptions[j->lane] += j->preemptions;
+				}
+				else {
+					live.push_back(j);
+				}
+			}
+			jobs.swap(live);
+			n_done -= done.size();
+		}
+		for (Job *j : done) {
+			if (j->th.joinable()) j->th.join(); // wait() may have joined it
+			delete j;
+		}
+	}
+
+	// Queue latency (submit to first dispatch) per lane and preemptions.
+	void report(ostream &os) const {
+		static const char *name[2] = { "interactive", "batch" };
+		for (int lane = 0; lane < 2; lane++) {
+			vector<double> lat = reaped_wait[lane];
+			long preempt = reaped_preemptions[lane];
+			for (const Job *j : jobs) {
+				if (j->lane != lane || j->t_start < 0) continue;
+				lat.push_back(j->t_start - j->t_submit);
+				preempt += j->preemptions;
+			}
+			sort(lat.begin(), lat.end());
+			os << "stats: lane " << name[lane] << " jobs " << lat.size()
+			   << " wait_p50 " << percentile(lat, 50)
+			   << " wait_p90 " << percentile(lat, 90)
+			   << " wait_p99 " << percentile(lat, 99)
+			   << " preemptions " << preempt << endl;
+		}
+	}
+
+private:
+	struct Job {
+		Lane lane;
+		JobFn fn;
+		streambuf *out;
+		thread th;
+		bool granted = false;
+		bool finished = false;
+		int preemptions = 0;
+		double t_submit = 0, t_start = -1, t_grant = 0;
+	};
+
+	service_metrics *metrics;
+	streambuf *console;
+	mutex m;
+	condition_variable cv;
+	vector<Job *> jobs;
+	deque<Job *> queue[2];
+	deque<Job *> parked;
+	Job *running;
+	size_t n_done;
+	vector<double> reaped_wait[2];
+	long reaped_preemptions[2] = { 0, 0 };
+	chrono::steady_clock::time_point t0;
+
+	double now() const {
+		return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	}
+
+	// nearest rank, sorted input
+	static double percentile(const vector<double> &v, int p) {
+		if (v.empty()) return 0;
+		size_t k = (v.size() * p + 99) / 100;
+		return v[k > 0 ? k - 1 : 0];
+	}
+
+	// Hands the CPU to the next job: queued interactive work first, then
+	// parked batch jobs, then new batch jobs. Called with m held.
+	void dispatch() {
+		if (running) return;
+		Job *j = nullptr;
+		if (!queue[INTERACTIVE].empty()) {
+			j = queue[INTERACTIVE].front();
+			queue[INTERACTIVE].pop_front();
+		}
+		else if (!parked.empty()) {
+			j = parked.front();
+			parked.pop_front();
+		}
+		else if (!queue[BATCH].empty()) {
+			j = queue[BATCH].front();
+			queue[BATCH].pop_front();
+		}
+		if (!j) return;
+		running = j;
+		j->granted = true;
+		j->t_grant = now();
+		if (j->t_start < 0) {
+			j->t_start = j->t_grant;
+			if (metrics) {
+				metrics->queued[j->lane]--;
+				metrics->in_flight++;
+				metrics->queue_wait[j->lane].observe(j->t_start - j->t_submit);
+			}
+			j->th = thread(&Scheduler::run, this, j);
+		}
+		else {
+			cv.notify_all();
+		}
+	}
+
+	void acquire(Job *j) {
+		cout.rdbuf(j->out);
+	}
+
+	// Adds the CPU time since j was granted. Called with m held.
+	void release(Job *j) {
+		if (metrics) metrics->busy_ns += service_metrics::ns(now() - j->t_grant);
+	}
+
+	void run(Job *j) {
+		acquire(j);
+		j->fn([this, j] { yieldPoint(j); });
+		cout.flush();
+		cout.rdbuf(console);
+		lock_guard<mutex> lk(m);
+		release(j);
+		if (metrics) {
+			metrics->in_flight--;
+			metrics->jobs_done[j->lane]++;
+		}
+		running = nullptr;
+		j->finished = true;
+		n_done++;
+		dispatch();
+		cv.notify_all();
+	}
+
+	void yieldPoint(Job *j) {
+		unique_lock<mutex> lk(m);
+		if (j->lane != BATCH || queue[INTERACTIVE].empty()) return;
+		cout.flush();
+		j->preemptions++;
+		if (metrics) metrics->preemptions++;
+		release(j);
+		j->granted = false;
+		parked.push_back(j);
+		running = nullptr;
+		dispatch();
+		cv.wait(lk, [j] { return j->granted; });
+		acquire(j);
+	}
+};
+
+#endif /* SCHEDULER_H_ */
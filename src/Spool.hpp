@@ -0,0 +1,210 @@
+/*
+ * Spool.hpp - spool directory of a resident --spool process
+ *
+ * FASTA files dropped into the input directory are claimed by renaming
+ * them into its .work directory as "name@host:pid". rename() is atomic
+ * on one file system, also over NFS, so of several instances watching the
+ * same directory exactly one gets each file. Results are written to a
+ * hidden temporary file in the output directory and renamed to
+ * "name.out" when complete. A file with records that cannot be designed
+ * goes to .work/failed instead, its errors to "name.err".
+ *
+ * inotify wakes the process when a file is closed after writing or moved
+ * in; it does not see files written on other NFS clients, so the
+ * directory is also scanned every few seconds, and files found that way
+ * are only claimed once they have not changed for a few seconds. Names
+ * starting with '.' are ignored: write to ".name" and rename to "name".
+ */
+
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+class spool_dir {
+public:
+	static const int RESCAN_MS = 2000; // directory scan without events
+	static const int SETTLE_S = 5;     // unchanged time of scanned files
+
+	spool_dir(const string &in, const string &out) : in(in), out(out), work(in + "/.work"), failed(work + "/failed") {
+		char host_name[HOST_NAME_MAX + 1] = "";
+		gethostname(host_name, sizeof(host_name) - 1);
+		host = host_name;
+		tag = "@" + host + ":" + to_string(getpid());
+
+		struct stat st;
+		if(stat(in.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)){
+			cerr << "spool: " << in << " is not a directory" << endl;
+			exit(1);
+		}
+		if(stat(out.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)){
+			cerr << "spool: " << out << " is not a directory" << endl;
+			exit(1);
+		}
+		for(const string &d : {work, failed}){
+			if(mkdir(d.c_str(), 0777) != 0 && errno != EEXIST){
+				cerr << "spool: cannot create " << d << ": " << strerror(errno) << endl;
+				exit(1);
+			}
+		}
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(fd < 0 || inotify_add_watch(fd, in.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+			cerr << "spool: cannot watch " << in << ": " << strerror(errno) << endl;
+			exit(1);
+		}
+		recover();
+	}
+
+	~spool_dir(){
+		close(fd);
+	}
+
+	// Waits up to RESCAN_MS for files to be written or moved in.
+	void wait(){
+		pollfd p = { fd, POLLIN, 0 };
+		if(poll(&p, 1, RESCAN_MS) <= 0)
+			return;
+		alignas(inotify_event) char buf[16384];
+		ssize_t n;
+		while((n = read(fd, buf, sizeof(buf))) > 0){
+			for(char *e = buf; e < buf + n; e += sizeof(inotify_event) + ((inotify_event *)e)->len){
+				const inotify_event *ev = (const inotify_event *)e;
+				if(ev->len)
+					announced.insert(ev->name);
+			}
+		}
+	}
+
+	// Claims up to max of the files that are ready, oldest first, and
+	// returns their names. Taking only what the scheduler is about to run
+	// leaves the rest to the other instances.
+	vector<string> claim(size_t max){
+		vector<pair<time_t, string> > ready;
+		const time_t now = time(NULL);
+		for(const string &name : list(in)){
+			struct stat st;
+			if(stat((in + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+				continue;
+			if(announced.count(name) || now - st.st_mtime >= SETTLE_S)
+				ready.push_back(make_pair(st.st_mtime, name));
+		}
+		sort(ready.begin(), ready.end());
+		vector<string> got;
+		set<string> left;
+		for(const pair<time_t, string> &r : ready){
+			const string &name = r.second;
+			if(got.size() == max){
+				if(announced.count(name))
+					left.insert(name);
+			}
+			else if(rename((in + "/" + name).c_str(), claimed(name).c_str()) == 0){
+				got.push_back(name);
+			}
+			// ENOENT: another instance was faster
+		}
+		announced.swap(left);
+		return got;
+	}
+
+	string claimed(const string &name) const { return work + "/" + name + tag; }
+	string temporary(const string &name) const { return out + "/." + name + tag + ".tmp"; }
+	string result(const string &name) const { return out + "/" + name + ".out"; }
+	string error(const string &name) const { return out + "/" + name + ".err"; }
+
+	// Publishes the result of a claim and drops the claim. Returns an error
+	// message, empty on success.
+	string finish(const string &name) const {
+		if(rename(temporary(name).c_str(), result(name).c_str()) != 0)
+			return "cannot rename " + temporary(name) + ": " + strerror(errno);
+		unlink(claimed(name).c_str());
+		unlink(retried(name).c_str());
+		return "";
+	}
+
+	// Moves a claim to .work/failed and publishes errors as "name.err" in
+	// place of the result. Returns an error message, empty on success.
+	string fail(const string &name, const string &errors) const {
+		unlink(temporary(name).c_str());
+		return fail(claimed(name), name, errors);
+	}
+
+private:
+	const string in, out, work, failed;
+	string host, tag;
+	int fd;
+	set<string> announced; // inotify names since the last claim()
+
+	static vector<string> list(const string &dir){
+		vector<string> v;
+		DIR *d = opendir(dir.c_str());
+		if(!d)
+			return v;
+		while(const dirent *e = readdir(d)){
+			if(e->d_name[0] != '.')
+				v.push_back(e->d_name);
+		}
+		closedir(d);
+		return v;
+	}
+
+	// marks a file that came back from a stopped instance once
+	string retried(const string &name) const { return work + "/." + name + ".retry"; }
+
+	string fail(const string &claim, const string &name, const string &errors) const {
+		unlink(retried(name).c_str());
+		const string tmp = out + "/." + name + tag + ".err.tmp";
+		ofstream(tmp) << errors;
+		if(rename(tmp.c_str(), error(name).c_str()) != 0){
+			unlink(tmp.c_str());
+			return "cannot write " + error(name) + ": " + strerror(errno);
+		}
+		if(rename(claim.c_str(), (failed + "/" + name).c_str()) != 0)
+			return "cannot move " + claim + " to " + failed + ": " + strerror(errno);
+		return "";
+	}
+
+	// Claims of dead processes on this host go back to the input directory,
+	// once: a file whose instance stopped twice goes to .work/failed. Claims
+	// of other hosts are left alone: their process may still run.
+	void recover(){
+		for(const string &w : list(work)){
+			const size_t at = w.rfind('@'), colon = w.rfind(':');
+			if(at == string::npos || colon == string::npos || colon < at || w.substr(at + 1, colon - at - 1) != host)
+				continue;
+			const pid_t pid = atoi(w.c_str() + colon + 1);
+			if(pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH)
+				continue;
+			const string name = w.substr(0, at), back = in + "/" + name;
+			unlink((out + "/." + w + ".tmp").c_str());
+			if(access(retried(name).c_str(), F_OK) == 0){
+				const string err = fail(work + "/" + w, name, "stopped twice while designing this file\n");
+				cerr << "spool: " << (err.empty() ? name + " stopped two instances, moved to " + failed : err) << endl;
+			}
+			else if(access(back.c_str(), F_OK) != 0 && rename((work + "/" + w).c_str(), back.c_str()) == 0){
+				ofstream(retried(name));
+				cerr << "spool: recovered " << name << " from a stopped instance" << endl;
+			}
+		}
+	}
+};
+
+#endif /* SPOOL_H_ */
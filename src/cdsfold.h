@@ -0,0 +1,77 @@
+/*
+ * cdsfold.h - C interface of libcdsfold.so (make lib)
+ *
+ * An engine holds the design options; cdsfold_design_batch() designs a
+ * list of amino acid sequences in one call, on the engine's threads, and
+ * writes each design into a result buffer the caller allocated with
+ * cdsfold_result_bytes(). Results are read through the cdsfold_result_*
+ * accessors, so their layout is not part of the ABI.
+ *
+ *   cdsfold_engine *e = cdsfold_engine_new();
+ *   cdsfold_engine_set(e, "w", "100");
+ *   void *r = malloc(cdsfold_result_bytes(strlen(aa)));
+ *   cdsfold_design_batch(e, &aa, 1, &r);
+ *   printf("%s %d\n", cdsfold_result_sequence(r), cdsfold_result_mfe(r));
+ *   free(r);
+ *   cdsfold_engine_free(e);
+ *
+ * An engine may be used by one thread at a time; separate engines may run
+ * concurrently. The engine's stdout output is discarded; its warnings go
+ * to the process's stderr.
+ */
+
+#ifndef CDSFOLD_C_H_
+#define CDSFOLD_C_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CDSFOLD_API __attribute__((visibility("default")))
+
+/* cdsfold_abi_version() of this header */
+#define CDSFOLD_ABI_VERSION 1
+
+/* Result status */
+#define CDSFOLD_OK          0
+#define CDSFOLD_E_SEQUENCE  1 /* not an amino acid, or every codon excluded */
+#define CDSFOLD_E_LENGTH    2 /* fewer than 3 amino acids */
+#define CDSFOLD_E_NO_MFE    3 /* no structure satisfies the constraints */
+
+typedef struct cdsfold_engine cdsfold_engine;
+
+CDSFOLD_API int cdsfold_abi_version(void);
+
+CDSFOLD_API cdsfold_engine *cdsfold_engine_new(void);
+CDSFOLD_API void cdsfold_engine_free(cdsfold_engine *e);
+
+/* Sets an option by its command line name: "w" (number or "auto"), "e",
+ * "span", "compress" ("0"/"1"), "threads", "codon-cost" (file), "lambda",
+ * "forbid-motifs" (file) and "regions". Returns 0, or -1 with the reason in
+ * cdsfold_engine_error(). */
+CDSFOLD_API int cdsfold_engine_set(cdsfold_engine *e, const char *key, const char *value);
+CDSFOLD_API const char *cdsfold_engine_error(const cdsfold_engine *e);
+
+/* Bytes of the result buffer for a sequence of aalen amino acids */
+CDSFOLD_API size_t cdsfold_result_bytes(int aalen);
+
+/* Designs seqs[0..n-1] (NUL-terminated, one letter per amino acid) into
+ * results[0..n-1], each cdsfold_result_bytes(strlen(seqs[k])) bytes.
+ * Returns the number of results with status CDSFOLD_OK. */
+CDSFOLD_API int cdsfold_design_batch(cdsfold_engine *e, const char *const *seqs, int n, void *const *results);
+
+CDSFOLD_API int cdsfold_result_status(const void *r);
+CDSFOLD_API int cdsfold_result_length(const void *r);          /* nucleotides */
+CDSFOLD_API int cdsfold_result_mfe(const void *r);             /* dcal/mol */
+CDSFOLD_API const char *cdsfold_result_sequence(const void *r);  /* ACGU */
+CDSFOLD_API const char *cdsfold_result_structure(const void *r); /* dot-bracket */
+
+CDSFOLD_API const char *cdsfold_strerror(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CDSFOLD_C_H_ */
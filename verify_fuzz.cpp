@@ -0,0 +1,289 @@
+/*
+ * CDSfold --verify fuzz driver
+ *
+ * Runs the executable with --verify on random proteins, random codon
+ * exclusion sets, random windows and --span profiles, thread counts and
+ * modes (-R, -f/-t), and --forbid-motifs files.
+ * Every run compares the fast kernels with the reference kernel
+ * (src/CDSfold_ref.hpp); a mismatch makes CDSfold exit with status 3.
+ * Failing inputs are kept in fuzz_failures/ together with the command.
+ *
+ * Usage: verify_fuzz [-b binary] [-s seed] [-n iterations] [-L max_aalen] [-d dir]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Standard genetic code (RNA), one entry per amino acid.
+static const map<char, vector<string> > CODONS = {
+    {'A', {"GCU", "GCC", "GCA", "GCG"}},
+    {'R', {"CGU", "CGC", "CGA", "CGG", "AGA", "AGG"}},
+    {'N', {"AAU", "AAC"}},
+    {'D', {"GAU", "GAC"}},
+    {'C', {"UGU", "UGC"}},
+    {'Q', {"CAA", "CAG"}},
+    {'E', {"GAA", "GAG"}},
+    {'G', {"GGU", "GGC", "GGA", "GGG"}},
+    {'H', {"CAU", "CAC"}},
+    {'I', {"AUU", "AUC", "AUA"}},
+    {'L', {"UUA", "UUG", "CUU", "CUC", "CUA", "CUG"}},
+    {'K', {"AAA", "AAG"}},
+    {'M', {"AUG"}},
+    {'F', {"UUU", "UUC"}},
+    {'P', {"CCU", "CCC", "CCA", "CCG"}},
+    {'S', {"UCU", "UCC", "UCA", "UCG", "AGU", "AGC"}},
+    {'T', {"ACU", "ACC", "ACA", "ACG"}},
+    {'W', {"UGG"}},
+    {'Y', {"UAU", "UAC"}},
+    {'V', {"GUU", "GUC", "GUA", "GUG"}},
+    {'*', {"UAA", "UAG", "UGA"}}
+};
+
+struct FuzzCase {
+    string protein;
+    vector<string> args;
+    string motifs; // --forbid-motifs file contents, empty for none
+};
+
+class VerifyFuzzer {
+private:
+    string binary;
+    string dir;
+    mt19937 rng;
+
+    int uniform(int lo, int hi) {
+        return uniform_int_distribution<int>(lo, hi)(rng);
+    }
+
+public:
+    VerifyFuzzer(const string &bin, const string &d, unsigned seed)
+        : binary(bin), dir(d), rng(seed) {}
+
+    // Leu/Arg/Ser-rich proteins exercise the V/W/X/Y codes, so they are
+    // drawn more often than in natural proteins.
+    string randomProtein(int aalen) {
+        const string common = "ACDEFGHIKLMNPQRSTVWY";
+        const string lrs = "LRS";
+        string p = "M";
+        while ((int)p.size() < aalen - 1) {
+            p += (uniform(0, 3) == 0) ? lrs[uniform(0, 2)] : common[uniform(0, common.size() - 1)];
+        }
+        p += (uniform(0, 1) == 0) ? '*' : common[uniform(0, common.size() - 1)];
+        return p;
+    }
+
+    // Excludes up to 5 codons but always leaves one codon per amino acid.
+    string randomExclusion(const string &protein) {
+        map<char, int> left;
+        for (const auto &kv : CODONS) left[kv.first] = kv.second.size();
+        vector<string> exc;
+        int n = uniform(0, 5);
+        for (int k = 0; k < n; k++) {
+            char aa = protein[uniform(0, protein.size() - 1)];
+            const vector<string> &cs = CODONS.at(aa);
+            if (left[aa] <= 1) continue;
+            string c = cs[uniform(0, cs.size() - 1)];
+            if (find(exc.begin(), exc.end(), c) != exc.end()) continue;
+            exc.push_back(c);
+            left[aa]--;
+        }
+        string s;
+        for (const auto &c : exc) s += (s.empty() ? "" : ",") + c;
+        return s;
+    }
+
+    // One to three short motifs; most of them block a few pairs, some
+    // leave no codon choice and make the engine refuse the record.
+    string randomMotifs() {
+        const string nuc = "ACGU";
+        string s;
+        int n = uniform(1, 3);
+        for (int k = 0; k < n; k++) {
+            int len = uniform(4, 6);
+            for (int i = 0; i < len; i++) s += nuc[uniform(0, 3)];
+            s += "\n";
+        }
+        return s;
+    }
+
+    FuzzCase randomCase(int max_aalen) {
+        FuzzCase fc;
+        int aalen = uniform(3, max_aalen);
+        fc.protein = randomProtein(aalen);
+        int nuclen = aalen * 3;
+
+        fc.args = {"--verify", "--threads", to_string(1 << uniform(0, 2))};
+        if (uniform(0, 2) == 0) {
+            fc.args.push_back("--compress");
+        }
+        int mode = uniform(0, 9);
+        if (mode == 0) {
+            // -R cannot be combined with -w/-e
+            fc.args.insert(fc.args.end(), {"-R", "--seed", to_string(uniform(1, 1000))});
+            return fc;
+        }
+        if (mode == 1 && aalen >= 4) {
+            int fm = uniform(1, aalen - 1);
+            int to = uniform(fm, aalen);
+            fc.args.insert(fc.args.end(), {"-f", to_string(fm), "-t", to_string(to)});
+        }
+        if (uniform(0, 1) && nuclen > 10) {
+            fc.args.insert(fc.args.end(), {"-w", to_string(uniform(10, nuclen))});
+        }
+        if (uniform(0, 2) == 0 && nuclen > 20) {
+            // two-range --span profile, 0 (no limit) on either side
+            int cut = uniform(1, nuclen - 1);
+            int w1 = uniform(0, 1) ? 0 : uniform(10, nuclen);
+            int w2 = uniform(0, 1) ? 0 : uniform(10, nuclen);
+            fc.args.insert(fc.args.end(), {"--span", "1-" + to_string(cut) + ":" + to_string(w1) + ","
+                                                     + to_string(cut + 1) + "-:" + to_string(w2)});
+        }
+        string exc = randomExclusion(fc.protein);
+        if (!exc.empty()) {
+            fc.args.insert(fc.args.end(), {"-e", exc});
+        }
+        if (uniform(0, 3) == 0) {
+            fc.motifs = randomMotifs();
+        }
+        return fc;
+    }
+
+    // 0: verified, 1: engine refused or failed before verification, 2: verify failure/crash
+    int run(const FuzzCase &fc, int iter, string &detail) {
+        string faa = dir + "/case.faa";
+        string err = dir + "/case.err";
+        string motifs = dir + "/case.motifs";
+        ofstream(faa) << ">fuzz" << iter << "\n" << fc.protein << "\n";
+
+        vector<string> argv_s = {binary};
+        argv_s.insert(argv_s.end(), fc.args.begin(), fc.args.end());
+        if (!fc.motifs.empty()) {
+            ofstream(motifs) << fc.motifs;
+            argv_s.insert(argv_s.end(), {"--forbid-motifs", motifs});
+        }
+        argv_s.push_back(faa);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            int devnull = open("/dev/null", O_WRONLY);
+            int fd = open(err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (devnull < 0 || fd < 0) _exit(127);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            vector<char *> argv;
+            for (auto &a : argv_s) argv.push_back(const_cast<char *>(a.c_str()));
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+
+        ifstream in(err);
+        stringstream ss;
+        ss << in.rdbuf();
+        detail = ss.str();
+
+        bool verified = detail.find("verify: ok") != string::npos;
+        if (WIFSIGNALED(status)) {
+            detail = "killed by signal " + to_string(WTERMSIG(status)) + "\n" + detail;
+            return 2;
+        }
+        if (WEXITSTATUS(status) == 3 || (WEXITSTATUS(status) == 0 && !verified && detail.find("backtrack failed") == string::npos)) {
+            return 2;
+        }
+        return verified ? 0 : 1;
+    }
+
+    void saveFailure(const FuzzCase &fc, int iter, const string &detail) {
+        string base = dir + "/failure_" + to_string(iter);
+        ofstream(base + ".faa") << ">fuzz" << iter << "\n" << fc.protein << "\n";
+        ofstream cmd(base + ".txt");
+        cmd << binary;
+        for (const auto &a : fc.args) cmd << " " << a;
+        if (!fc.motifs.empty()) {
+            ofstream(base + ".motifs") << fc.motifs;
+            cmd << " --forbid-motifs " << base << ".motifs";
+        }
+        cmd << " " << base << ".faa\n\n" << detail;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    string binary = "./src/CDSfold";
+    unsigned seed = 1;
+    int iterations = 200;
+    int max_aalen = 60;
+    string dir = "fuzz_failures";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:s:n:L:d:h")) != -1) {
+        switch (opt) {
+        case 'b': binary = optarg; break;
+        case 's': seed = atoi(optarg); break;
+        case 'n': iterations = atoi(optarg); break;
+        case 'L': max_aalen = atoi(optarg); break;
+        case 'd': dir = optarg; break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-b binary] [-s seed] [-n iterations] [-L max_aalen] [-d dir]" << endl;
+            return 1;
+        }
+    }
+    if (max_aalen < 3 || iterations < 1) {
+        cerr << "max_aalen must be at least 3 and iterations at least 1." << endl;
+        return 1;
+    }
+    if (access(binary.c_str(), X_OK) != 0) {
+        cerr << "CDSfold executable not found: " << binary << endl;
+        return 1;
+    }
+    mkdir(dir.c_str(), 0755);
+
+    VerifyFuzzer fuzzer(binary, dir, seed);
+    int ok = 0, skipped = 0, failed = 0;
+    for (int iter = 0; iter < iterations; iter++) {
+        FuzzCase fc = fuzzer.randomCase(max_aalen);
+        string detail;
+        int r = fuzzer.run(fc, iter, detail);
+        if (r == 0) {
+            ok++;
+        }
+        else if (r == 1) {
+            skipped++;
+        }
+        else {
+            failed++;
+            fuzzer.saveFailure(fc, iter, detail);
+            cerr << "FAILED case " << iter << " (" << fc.protein.size() << " aa), see "
+                 << dir << "/failure_" << iter << ".txt" << endl;
+        }
+        if ((iter + 1) % 20 == 0) {
+            cerr << iter + 1 << "/" << iterations << ": " << ok << " verified, "
+                 << skipped << " skipped, " << failed << " failed" << endl;
+        }
+    }
+    unlink((dir + "/case.faa").c_str());
+    unlink((dir + "/case.err").c_str());
+    unlink((dir + "/case.motifs").c_str());
+
+    cout << "verify_fuzz: " << ok << " verified, " << skipped
+         << " skipped (engine error before verification), " << failed << " failed" << endl;
+    return failed ? 1 : 0;
+}